@@ -10,6 +10,19 @@
  * - wrap column (-w, --wrap=COLS)
  * - ignore garbage (-i, --ignore-garbage)
  * 
+ * Extensions:
+ * - run statistics on standard error (--stats, BASENC_STATS=1)
+ * - SSSE3/AVX2/AVX-512 kernels chosen at run time; BASENC_ISA=scalar|ssse3|
+ *   avx2|avx512 caps the instruction set used
+ * - one huge-page backed buffer arena per run; BASENC_PREFAULT=1 touches
+ *   its pages before the first read
+ * - non-blocking push/pull stream API (basenc_stream_init/run); build with
+ *   -DBASENC_NO_MAIN to embed it
+ * - base58 (--base58), base45 (--base45), Adobe Ascii85 (--ascii85),
+ *   uuencode (--uuencode), quoted-printable (--qp), percent-encoding
+ *   (--percent) and one item per input line (--lines)
+ * - run-time alphabets and padding for base64/32/16 (--alphabet, --padding)
+ * 
  * Usage: basenc [OPTION]... [FILE]
  * 
  * Compile with:
@@ -17,6 +30,10 @@
  *   MSVC:  cl basenc.c /Fe:basenc.exe
  */
 
+#ifndef _WIN32
+#define _GNU_SOURCE     /* SEEK_DATA and SEEK_HOLE */
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,11 +41,58 @@
 #include <errno.h>
 
 #ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
 #include <fcntl.h>
 #include <io.h>
+#include <sys/stat.h>
 #define SET_BINARY_MODE(file) _setmode(_fileno(file), _O_BINARY)
+#define FSEEK64 _fseeki64
+#define FTELL64 _ftelli64
 #else
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #define SET_BINARY_MODE(file) ((void)0)
+#define FSEEK64 fseeko
+#define FTELL64 ftello
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BASENC_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+#define BASENC_X86_64 1
+#endif
+#endif
+
+/* Per-function instruction set selection; MSVC accepts intrinsics anywhere */
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET(isa) __attribute__((target(isa)))
+#else
+#define TARGET(isa)
+#endif
+
+/* Generic kernel bodies are always inlined into their specializations */
+#if defined(_MSC_VER)
+#define KERNEL_INLINE static __forceinline
+#elif defined(__GNUC__) || defined(__clang__)
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
 #endif
 
 
@@ -41,6 +105,13 @@ char *PROGRAM_NAME = "basenc";
 
 #define ENC_BLOCKSIZE (1024 * 3 * 10)
 #define DEC_BLOCKSIZE (1024 * 5)
+#define DEC_DENSE_SIZE 4096
+
+/* --count-bytes default: decode to the end */
+#define DEC_COUNT_ALL ((unsigned long long)-1)
+
+/* Decode table value of characters outside the alphabet */
+#define DEC_INVALID 0xFF
 
 
 typedef enum {
@@ -52,9 +123,30 @@ typedef enum {
     ENC_BASE16,
     ENC_BASE2MSBF,
     ENC_BASE2LSBF,
-    ENC_Z85
+    ENC_Z85,
+    ENC_ASCII85,
+    ENC_UUENCODE,
+    ENC_QP,
+    ENC_BASE58,
+    ENC_BASE45,
+    ENC_PERCENT
 } encoding_type_t;
 
+typedef enum {
+    CHECKSUM_NONE,
+    CHECKSUM_CRC32C,
+    CHECKSUM_XXH64
+} checksum_type_t;
+
+/* One --emit output */
+typedef struct {
+    encoding_type_t encoding_type;
+    size_t wrap_column;
+    const char *path;           /* "-" for standard output */
+} emit_t;
+
+#define EMIT_MAX 8
+
 /* Program parameters */
 typedef struct {
     int decode;
@@ -62,793 +154,7820 @@ typedef struct {
     int wrap_column;
     encoding_type_t encoding_type;
     const char *input_file;
+    const char *output_file;    /* -o FILE, NULL for standard output */
+    unsigned long long skip_bytes;
+    unsigned long long count_bytes;
+    const char *write_index;    /* --write-index FILE, NULL for none */
+    const char *index_file;     /* --index FILE, NULL for none */
+    unsigned long long index_interval; /* --index-interval in bytes, 0 for the default */
+    int in_place;
+    int lines;                  /* --lines: each input line is a separate item */
+    const char *alphabet;       /* --alphabet STRING, NULL for the built-in one */
+    const char *padding;        /* --padding CHAR or "none", NULL for '=' */
+    int stats;
+    int auto_detect;            /* --auto: pick the decoding from the input */
+    int verbose;
+    encoding_type_t to_encoding;  /* --to ENC with --from, ENC_NONE otherwise */
+    emit_t emit[EMIT_MAX];      /* --emit outputs, the main encoding first if one was given */
+    int emit_count;
+    checksum_type_t checksum;   /* --checksum ALG */
+    const char *checksum_file;  /* --checksum ALG:FILE, NULL for standard error */
+    const char *expect;         /* --expect HEX, NULL for none */
+    const char *verify;         /* --verify ORIGINAL, NULL for none */
+    int check;                  /* --check: validate only */
+    int size;                   /* --size: print the size of the output */
 } params_t;
 
+/* Run statistics (--stats) */
+typedef struct {
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long read_calls;
+    unsigned long long write_calls;
+    unsigned long long read_ns;
+    unsigned long long transform_ns;
+    unsigned long long write_ns;
+    unsigned long long start_ns;
+    const char *kernel;
+    int threads;
+    unsigned long long arena_bytes;
+    const char *arena_pages;
+    const char *output;         /* "stdout", "file", "mmap" or "in-place" */
+} stats_t;
+
+static int stats_enabled = 0;
+static stats_t stats = { 0, 0, 0, 0, 0, 0, 0, 0, "scalar", 1, 0, "none", "stdout" };
+
+/* Cheap monotonic timestamps around the block loop, only taken with --stats */
+#define STATS_START(t) ((t) = stats_enabled ? monotonic_ns() : 0)
+#define STATS_STOP(field, t) do { if (stats_enabled) stats.field += monotonic_ns() - (t); } while (0)
+
 
 void usage(int status);
 void version(void);
 void write_error(void);
 void exit_with_error(const char *message, const char *arg);
 int parse_arguments(int argc, char **argv, params_t *params);
-void wrap_write(const char *buffer, size_t len, size_t wrap_column, size_t *current_column, FILE *out);
-void do_encode(FILE *in, const char *infile, FILE *out, size_t wrap_column, encoding_type_t encoding_type);
-void do_decode(FILE *in, const char *infile, FILE *out, int ignore_garbage, encoding_type_t encoding_type);
-
-/* Base64 implementation */
-static const char base64_chars[] = 
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-static const char base64url_chars[] = 
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
-
-static int is_base64(unsigned char c) {
-    return (isalnum(c) || (c == '+') || (c == '/'));
-}
+void do_encode(FILE *in, const params_t *params);
+void do_decode(FILE *in, const params_t *params);
+void do_transcode(FILE *in, const params_t *params);
+void do_emit(FILE *in, const params_t *params);
+void do_check(FILE *in, const params_t *params);
+void do_in_place(const params_t *params);
+void do_base58(FILE *in, const params_t *params);
+void do_ascii85(FILE *in, const params_t *params);
+void do_uuencode(FILE *in, const params_t *params);
+void do_uudecode(FILE *in, const params_t *params);
+void do_qp(FILE *in, const params_t *params);
+void do_percent(FILE *in, const params_t *params);
+void do_lines(FILE *in, const params_t *params);
+static unsigned long long monotonic_ns(void);
+static void print_stats(const char *mode, encoding_type_t encoding_type);
 
-static int is_base64url(unsigned char c) {
-    return (isalnum(c) || (c == '-') || (c == '_'));
-}
+/*
+ * Working memory arena.  Every buffer of a run is carved out of a single
+ * page-aligned mapping, each piece starting on a 64-byte boundary, so the
+ * kernels see aligned buffers and the layout is the same from run to run.
+ * Mappings of 2 MiB or more use explicit huge pages when the system has
+ * them reserved (MAP_HUGETLB), else ask for transparent huge pages.
+ */
+#define ARENA_ALIGN 64
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
-static int base64_char_to_value(char c) {
-    if (c >= 'A' && c <= 'Z') return c - 'A';
-    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-    if (c >= '0' && c <= '9') return c - '0' + 52;
-    if (c == '+') return 62;
-    if (c == '/') return 63;
-    return -1;
-}
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+} arena_t;
 
-static int base64url_char_to_value(char c) {
-    if (c >= 'A' && c <= 'Z') return c - 'A';
-    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-    if (c >= '0' && c <= '9') return c - '0' + 52;
-    if (c == '-') return 62;
-    if (c == '_') return 63;
-    return -1;
-}
+static void arena_init(arena_t *arena, size_t size) {
+    const char *prefault = getenv("BASENC_PREFAULT");
+    const char *pages = "4k";
+    void *base;
 
-static size_t base64_encode_block(const unsigned char *in, size_t inlen, char *out, size_t outlen, const char *charset) {
-    size_t i = 0, j = 0;
-    unsigned char char_array_3[3];
-    unsigned char char_array_4[4];
-    size_t out_len = 0;
-
-    while (inlen--) {
-        char_array_3[i++] = *(in++);
-        if (i == 3) {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
-
-            for (i = 0; i < 4; i++) {
-                if (j < outlen) {
-                    out[j++] = charset[char_array_4[i]];
-                    out_len++;
-                }
-            }
-            i = 0;
-        }
+    size = (size + 4095) & ~(size_t)4095;
+    if (size >= HUGE_PAGE_SIZE) {
+        size = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
     }
 
-    if (i) {
-        for (size_t k = i; k < 3; k++) {
-            char_array_3[k] = '\0';
+#ifdef _WIN32
+    /* Large pages need SeLockMemoryPrivilege, which ordinary users lack */
+    base = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (size >= HUGE_PAGE_SIZE) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        pages = "hugetlb";
+    }
+#endif
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        pages = "4k";
+#ifdef MADV_HUGEPAGE
+        if (base != MAP_FAILED && size >= HUGE_PAGE_SIZE && madvise(base, size, MADV_HUGEPAGE) == 0) {
+            pages = "thp";
         }
+#endif
+    }
+    if (base == MAP_FAILED) {
+        base = NULL;
+    }
+#endif
 
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-        char_array_4[3] = char_array_3[2] & 0x3f;
-
-        for (size_t k = 0; k < i + 1; k++) {
-            if (j < outlen) {
-                out[j++] = charset[char_array_4[k]];
-                out_len++;
-            }
-        }
+    if (!base) {
+        exit_with_error("memory allocation failed", NULL);
+    }
 
-        if (charset == base64_chars) {
-            while (i++ < 3) {
-                if (j < outlen) {
-                    out[j++] = '=';
-                    out_len++;
-                }
-            }
+    if (prefault && *prefault && strcmp(prefault, "0") != 0) {
+        for (size_t offset = 0; offset < size; offset += 4096) {
+            ((volatile unsigned char *)base)[offset] = 0;
         }
     }
 
-    return out_len;
+    arena->base = (unsigned char *)base;
+    arena->size = size;
+    arena->used = 0;
+    stats.arena_bytes = size;
+    stats.arena_pages = pages;
 }
 
-static size_t base64_decode_block(const char *in, size_t inlen, unsigned char *out, size_t outlen, int is_url, int ignore_garbage) {
-    size_t i = 0, j = 0, k = 0;
-    unsigned char char_array_4[4], char_array_3[3];
-    size_t out_len = 0;
-    int (*is_valid_char)(unsigned char) = is_url ? is_base64url : is_base64;
-    int (*char_to_value)(char) = is_url ? base64url_char_to_value : base64_char_to_value;
-
-    while (inlen-- && (in[k] != '=') && (is_valid_char(in[k]) || ignore_garbage)) {
-        if (!is_valid_char(in[k])) {
-            if (ignore_garbage) {
-                k++;
-                continue;
-            } else {
-                exit_with_error("invalid input", NULL);
-            }
-        }
-        char_array_4[i++] = in[k++];
-        if (i == 4) {
-            for (i = 0; i < 4; i++) {
-                char_array_4[i] = char_to_value(char_array_4[i]);
-            }
-
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+/* Next 64-byte aligned piece of SIZE bytes; arena_init() must have reserved room for it */
+static void *arena_alloc(arena_t *arena, size_t size) {
+    void *p = arena->base + arena->used;
 
-            for (i = 0; i < 3; i++) {
-                if (j < outlen) {
-                    out[j++] = char_array_3[i];
-                    out_len++;
-                }
-            }
-            i = 0;
-        }
+    if (ARENA_ROUND(size) > arena->size - arena->used) {
+        exit_with_error("memory allocation failed", NULL);
     }
+    arena->used += ARENA_ROUND(size);
+    return p;
+}
 
-    if (i) {
-        for (size_t l = i; l < 4; l++) {
-            char_array_4[l] = 0;
-        }
-
-        for (size_t l = 0; l < 4; l++) {
-            if (in[k-i+l] != '=') {
-                char_array_4[l] = char_to_value(in[k-i+l]);
-            } else {
-                char_array_4[l] = 0;
-            }
-        }
-
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
-
-        for (size_t l = 0; l < i - 1; l++) {
-            if (j < outlen) {
-                out[j++] = char_array_3[l];
-                out_len++;
-            }
-        }
+static void arena_release(arena_t *arena) {
+    if (arena->base) {
+#ifdef _WIN32
+        VirtualFree(arena->base, 0, MEM_RELEASE);
+#else
+        munmap(arena->base, arena->size);
+#endif
+        arena->base = NULL;
     }
-
-    return out_len;
 }
 
-/* Base32 implementation */
-static const char base32_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-static const char base32hex_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+/*
+ * Mapped output file (-o FILE).  When the input is a regular file the
+ * output size is known up front (exactly for encoding, as an upper bound
+ * for decoding), so the file is preallocated, mapped, and written in
+ * place by the kernels; output_map_close() truncates it to the bytes
+ * actually produced.
+ */
+typedef struct {
+    unsigned char *base;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} output_map_t;
 
-static int is_base32(unsigned char c, const char *alphabet) {
-    return (strchr(alphabet, toupper(c)) != NULL);
-}
+/* Bytes left to read from IN if it is a regular file */
+static int input_regular_size(FILE *in, unsigned long long *size) {
+#ifdef _WIN32
+    struct _stat64 st;
+    int fd = _fileno(in);
+    long long pos;
 
-static int base32_char_to_value(char c, const char *alphabet) {
-    const char *p = strchr(alphabet, toupper(c));
-    if (p) {
-        return p - alphabet;
+    if (_fstat64(fd, &st) != 0 || !(st.st_mode & _S_IFREG)) {
+        return -1;
     }
-    return -1;
+    pos = _lseeki64(fd, 0, SEEK_CUR);
+#else
+    struct stat st;
+    int fd = fileno(in);
+    off_t pos;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    pos = lseek(fd, 0, SEEK_CUR);
+#endif
+    if (pos < 0 || pos > st.st_size) {
+        return -1;
+    }
+    *size = (unsigned long long)(st.st_size - pos);
+    return 0;
 }
 
-static size_t base32_encode_block(const unsigned char *in, size_t inlen, char *out, size_t outlen, const char *alphabet) {
-    size_t i = 0, index = 0;
-    size_t out_len = 0;
-    unsigned char buffer[5];
+/* IN is a regular file with holes: fewer blocks allocated than its size covers */
+static int input_sparse(FILE *in) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    struct stat st;
 
-    while (i < inlen) {
-        size_t buffer_size = 0;
+    return fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) &&
+           (unsigned long long)st.st_blocks * 512 < (unsigned long long)st.st_size;
+#else
+    (void)in;
+    return 0;
+#endif
+}
 
-        while (buffer_size < 5 && i < inlen) {
-            buffer[buffer_size++] = in[i++];
-        }
+/*
+ * If the read position of the sparse file IN is in a hole, skip up to MAX
+ * bytes of it and return how many.  Otherwise return 0 and set *DATA to
+ * the bytes, at most MAX, that can be read before the next hole.
+ */
+static size_t input_skip_hole(FILE *in, size_t max, size_t *data) {
+    *data = max;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    int fd = fileno(in);
+    off_t pos = FTELL64(in);
+    off_t next;
 
-        while (buffer_size < 5) {
-            buffer[buffer_size++] = 0;
+    if (pos < 0) {
+        return 0;
+    }
+    next = lseek(fd, pos, SEEK_DATA);
+    if (next < 0 && errno == ENXIO) {
+        // No data past POS: the rest of the file is a hole
+        next = lseek(fd, 0, SEEK_END);
+    }
+    if (next > pos) {
+        size_t hole = (unsigned long long)(next - pos) < max ? (size_t)(next - pos) : max;
+        if (FSEEK64(in, pos + (off_t)hole, SEEK_SET) == 0) {
+            return hole;
         }
-
-
-        if (index < outlen) { out[index++] = alphabet[(buffer[0] >> 3) & 0x1F]; out_len++; }
-        if (index < outlen) { out[index++] = alphabet[((buffer[0] & 0x07) << 2) | ((buffer[1] >> 6) & 0x03)]; out_len++; }
-        if (index < outlen) { out[index++] = alphabet[(buffer[1] >> 1) & 0x1F]; out_len++; }
-        if (index < outlen) { out[index++] = alphabet[((buffer[1] & 0x01) << 4) | ((buffer[2] >> 4) & 0x0F)]; out_len++; }
-        if (index < outlen) { out[index++] = alphabet[((buffer[2] & 0x0F) << 1) | ((buffer[3] >> 7) & 0x01)]; out_len++; }
-        if (index < outlen) { out[index++] = alphabet[(buffer[3] >> 2) & 0x1F]; out_len++; }
-        if (index < outlen) { out[index++] = alphabet[((buffer[3] & 0x03) << 3) | ((buffer[4] >> 5) & 0x07)]; out_len++; }
-        if (index < outlen) { out[index++] = alphabet[buffer[4] & 0x1F]; out_len++; }
-
-        if (i >= inlen) {
-            switch (inlen % 5) {
-                case 1:
-                    if (index > 2 && index <= outlen) {
-                        for (size_t j = 2; j < 8 && index < outlen; j++) {
-                            out[index++] = '=';
-                            out_len++;
-                        }
-                    }
-                    break;
-                case 2:
-                    if (index > 4 && index <= outlen) {
-                        for (size_t j = 4; j < 8 && index < outlen; j++) {
-                            out[index++] = '=';
-                            out_len++;
-                        }
-                    }
-                    break;
-                case 3:
-                    if (index > 5 && index <= outlen) {
-                        for (size_t j = 5; j < 8 && index < outlen; j++) {
-                            out[index++] = '=';
-                            out_len++;
-                        }
-                    }
-                    break;
-                case 4:
-                    if (index > 7 && index <= outlen) {
-                        out[index++] = '=';
-                        out_len++;
-                    }
-                    break;
-            }
+    } else if (next == pos) {
+        next = lseek(fd, pos, SEEK_HOLE);
+        if (next > pos && (unsigned long long)(next - pos) < max) {
+            *data = (size_t)(next - pos);
         }
     }
-
-    return out_len;
+    // The lseek() calls moved the descriptor under stdio
+    FSEEK64(in, pos, SEEK_SET);
+#else
+    (void)in;
+#endif
+    return 0;
 }
 
-static size_t base32_decode_block(const char *in, size_t inlen, unsigned char *out, size_t outlen, const char *alphabet, int ignore_garbage) {
-    size_t i = 0, j = 0;
-    size_t out_len = 0;
-    unsigned char buffer[8];
-    size_t buffer_size = 0;
+/*
+ * Read up to WANT bytes of IN into BUF, stopping short only at the end of
+ * the input or an error.  On a SPARSE file the holes are filled with
+ * zeros instead of being read.
+ */
+static size_t read_block(FILE *in, unsigned char *buf, size_t want, int sparse) {
+    size_t sum = 0;
 
-    while (i < inlen) {
-        // Skip non-alphabet characters if ignore_garbage is set
-        if (in[i] == '\n' || in[i] == '\r') {
-            i++;
-            continue;
-        }
-        
-        if (in[i] == '=') {
-            i++;
-            continue;
-        }
-        
-        int value = base32_char_to_value(in[i], alphabet);
-        if (value == -1) {
-            if (ignore_garbage) {
-                i++;
+    while (sum < want) {
+        size_t chunk = want - sum;
+        if (sparse) {
+            size_t hole = input_skip_hole(in, chunk, &chunk);
+            if (hole > 0) {
+                memset(buf + sum, 0, hole);
+                sum += hole;
                 continue;
-            } else {
-                exit_with_error("invalid input", NULL);
             }
         }
-        
-        buffer[buffer_size++] = value;
-        i++;
-        
-        if (buffer_size == 8) {
-            if (j < outlen) { out[j++] = (buffer[0] << 3) | (buffer[1] >> 2); out_len++; }
-            if (j < outlen) { out[j++] = (buffer[1] << 6) | (buffer[2] << 1) | (buffer[3] >> 4); out_len++; }
-            if (j < outlen) { out[j++] = (buffer[3] << 4) | (buffer[4] >> 1); out_len++; }
-            if (j < outlen) { out[j++] = (buffer[4] << 7) | (buffer[5] << 2) | (buffer[6] >> 3); out_len++; }
-            if (j < outlen) { out[j++] = (buffer[6] << 5) | buffer[7]; out_len++; }
-            
-            buffer_size = 0;
+        size_t n = fread(buf + sum, 1, chunk, in);
+        stats.read_calls++;
+        if (n == 0) {
+            break;
         }
+        sum += n;
+    }
+    return sum;
+}
+
+/* Size the open file of MAP to its SIZE bytes and map it; the file stays open either way */
+static int file_map_handle(output_map_t *map) {
+#ifdef _WIN32
+    LARGE_INTEGER end;
+
+    if (map->size == 0) {
+        return 0;
+    }
+    end.QuadPart = (LONGLONG)map->size;
+    if (!SetFilePointerEx(map->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(map->file)) {
+        return -1;
     }
-    
-    // Handle remaining characters
-    if (buffer_size > 0) {
-        for (size_t k = buffer_size; k < 8; k++) {
-            buffer[k] = 0;
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)map->size >> 32),
+                                      (DWORD)map->size, NULL);
+    if (map->mapping) {
+        map->base = (unsigned char *)MapViewOfFile(map->mapping, FILE_MAP_WRITE, 0, 0, map->size);
+        if (!map->base) {
+            CloseHandle(map->mapping);
         }
-        
-        if (buffer_size >= 2 && j < outlen) { out[j++] = (buffer[0] << 3) | (buffer[1] >> 2); out_len++; }
-        if (buffer_size >= 4 && j < outlen) { out[j++] = (buffer[1] << 6) | (buffer[2] << 1) | (buffer[3] >> 4); out_len++; }
-        if (buffer_size >= 5 && j < outlen) { out[j++] = (buffer[3] << 4) | (buffer[4] >> 1); out_len++; }
-        if (buffer_size >= 7 && j < outlen) { out[j++] = (buffer[4] << 7) | (buffer[5] << 2) | (buffer[6] >> 3); out_len++; }
     }
-    
-    return out_len;
+    return map->base ? 0 : -1;
+#else
+    if (map->size == 0) {
+        return 0;
+    }
+#if defined(__linux__)
+    /* Reserve the blocks now so the file does not grow a page fault at a time */
+    if (posix_fallocate(map->fd, 0, (off_t)map->size) != 0 && ftruncate(map->fd, (off_t)map->size) != 0) {
+#else
+    if (ftruncate(map->fd, (off_t)map->size) != 0) {
+#endif
+        return -1;
+    }
+    void *base = mmap(NULL, map->size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+    map->base = (unsigned char *)base;
+    return 0;
+#endif
 }
 
-/* Base16 (hex) implementation */
-static int is_base16(unsigned char c) {
-    return (isxdigit(c) != 0);
-}
+/* Map the existing file PATH read-write, grown to SIZE bytes; returns -1 if it could not be mapped */
+static int file_map_open(output_map_t *map, const char *path, unsigned long long size) {
+    memset(map, 0, sizeof(*map));
+    if (size > (size_t)-1 / 2) {
+        return -1;
+    }
+    map->size = (size_t)size;
 
-static int base16_char_to_value(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    return -1;
+#ifdef _WIN32
+    map->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    if (file_map_handle(map) != 0) {
+        CloseHandle(map->file);
+        return -1;
+    }
+#else
+    map->fd = open(path, O_RDWR);
+    if (map->fd < 0) {
+        return -1;
+    }
+    if (file_map_handle(map) != 0) {
+        close(map->fd);
+        return -1;
+    }
+#endif
+    return 0;
 }
 
-static size_t base16_encode_block(const unsigned char *in, size_t inlen, char *out, size_t outlen) {
-    static const char hex_chars[] = "0123456789ABCDEF";
-    size_t i, j;
-    size_t out_len = 0;
-    
-    for (i = 0, j = 0; i < inlen && j + 1 < outlen; i++) {
-        out[j++] = hex_chars[(in[i] >> 4) & 0x0F];
-        out[j++] = hex_chars[in[i] & 0x0F];
-        out_len += 2;
+/*
+ * Open the output file PATH.  A regular file is emptied and, if MAPPABLE
+ * is set, mapped at SIZE bytes, and 0 is returned.  Otherwise *OUT is a
+ * stdio stream on the same descriptor, so a named pipe is opened only once,
+ * and 1 is returned.  Exits if PATH cannot be opened or is the input IN.
+ */
+static int output_open(output_map_t *map, const char *path, FILE *in, unsigned long long size, int mappable,
+                       FILE **out) {
+    memset(map, 0, sizeof(*map));
+    if (size > (size_t)-1 / 2) {
+        mappable = 0;
     }
-    
-    return out_len;
-}
+    map->size = (size_t)size;
 
-static size_t base16_decode_block(const char *in, size_t inlen, unsigned char *out, size_t outlen, int ignore_garbage) {
-    size_t i, j;
-    size_t out_len = 0;
-    
-    for (i = 0, j = 0; i + 1 < inlen && j < outlen;) {
-        if (in[i] == '\n' || in[i] == '\r') {
-            i++;
-            continue;
-        }
-        
-        int high = base16_char_to_value(in[i]);
-        if (high == -1) {
-            if (ignore_garbage) {
-                i++;
-                continue;
-            } else {
-                exit_with_error("invalid input", NULL);
-            }
+#ifdef _WIN32
+    BY_HANDLE_FILE_INFORMATION info, in_info;
+    HANDLE in_file = (HANDLE)_get_osfhandle(_fileno(in));
+    int fd;
+
+    map->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        // Write-only files and devices still take the stdio path
+        *out = fopen(path, "wb");
+        if (!*out) {
+            exit_with_error(strerror(errno), path);
         }
-        
-        if (in[i+1] == '\n' || in[i+1] == '\r') {
-            i++;
-            continue;
+        return 1;
+    }
+    if (GetFileType(map->file) == FILE_TYPE_DISK) {
+        if (GetFileInformationByHandle(map->file, &info) && in_file != INVALID_HANDLE_VALUE &&
+            GetFileInformationByHandle(in_file, &in_info) &&
+            info.dwVolumeSerialNumber == in_info.dwVolumeSerialNumber &&
+            info.nFileIndexHigh == in_info.nFileIndexHigh && info.nFileIndexLow == in_info.nFileIndexLow) {
+            CloseHandle(map->file);
+            exit_with_error("input file is output file", path);
         }
-        
-        int low = base16_char_to_value(in[i+1]);
-        if (low == -1) {
-            if (ignore_garbage) {
-                i++;
-                continue;
-            } else {
-                exit_with_error("invalid input", NULL);
-            }
+        if (!SetEndOfFile(map->file)) {
+            CloseHandle(map->file);
+            exit_with_error("cannot truncate the file", path);
         }
-        
-        out[j++] = (high << 4) | low;
-        out_len++;
-        i += 2;
-    }
-    
-    return out_len;
-}
-
-static int is_base2(unsigned char c) {
-    return (c == '0' || c == '1');
-}
+        if (mappable) {
+            LARGE_INTEGER start;
 
-static size_t base2_encode_block(const unsigned char *in, size_t inlen, char *out, size_t outlen, int msb_first) {
-    size_t i, j;
-    size_t out_len = 0;
-    
-    for (i = 0, j = 0; i < inlen && j + 7 < outlen; i++) {
-        unsigned char byte = in[i];
-        
-        if (msb_first) {
-            for (int bit = 7; bit >= 0; bit--) {
-                out[j++] = ((byte >> bit) & 0x01) ? '1' : '0';
+            if (file_map_handle(map) == 0) {
+                return 0;
             }
-        } else {
-            for (int bit = 0; bit < 8; bit++) {
-                out[j++] = ((byte >> bit) & 0x01) ? '1' : '0';
+            // It may have been grown before the mapping failed
+            start.QuadPart = 0;
+            if (!SetFilePointerEx(map->file, start, NULL, FILE_BEGIN) || !SetEndOfFile(map->file)) {
+                CloseHandle(map->file);
+                exit_with_error("cannot truncate the file", path);
             }
         }
-        
-        out_len += 8;
     }
-    
-    return out_len;
-}
+    fd = _open_osfhandle((intptr_t)map->file, _O_WRONLY | _O_BINARY);
+    *out = fd < 0 ? NULL : _fdopen(fd, "wb");
+#else
+    struct stat st;
+    struct stat in_st;
 
-static size_t base2_decode_block(const char *in, size_t inlen, unsigned char *out, size_t outlen, int msb_first, int ignore_garbage) {
-    size_t i, j;
-    size_t out_len = 0;
-    unsigned char byte = 0;
-    int bit_count = 0;
-    
-    for (i = 0, j = 0; i < inlen && j < outlen; i++) {
-        if (in[i] == '\n' || in[i] == '\r') {
-            continue;
+    // Only a regular file is opened for reading too, as mmap() needs; a named pipe waits for its reader here
+    if (stat(path, &st) == 0 && !S_ISREG(st.st_mode)) {
+        map->fd = open(path, O_WRONLY);
+    } else {
+        map->fd = open(path, O_RDWR | O_CREAT, 0666);
+        if (map->fd < 0 && errno == EACCES) {
+            map->fd = open(path, O_WRONLY | O_CREAT, 0666);
+            mappable = 0;
         }
-        
-        if (!is_base2(in[i])) {
-            if (ignore_garbage) {
-                continue;
-            } else {
-                exit_with_error("invalid input", NULL);
-            }
+    }
+    if (map->fd < 0 || fstat(map->fd, &st) != 0) {
+        exit_with_error(strerror(errno), path);
+    }
+    if (S_ISREG(st.st_mode)) {
+        if (fstat(fileno(in), &in_st) == 0 && st.st_dev == in_st.st_dev && st.st_ino == in_st.st_ino) {
+            close(map->fd);
+            exit_with_error("input file is output file", path);
         }
-        
-        int bit = (in[i] == '1') ? 1 : 0;
-        
-        if (msb_first) {
-            byte = (byte << 1) | bit;
-        } else {
-            byte |= (bit << bit_count);
+        if (ftruncate(map->fd, 0) != 0) {
+            exit_with_error(strerror(errno), path);
         }
-        
-        bit_count++;
-        
-        if (bit_count == 8) {
-            out[j++] = byte;
-            out_len++;
-            byte = 0;
-            bit_count = 0;
+        if (mappable) {
+            if (file_map_handle(map) == 0) {
+                return 0;
+            }
+            // It may have been grown before the mapping failed
+            if (ftruncate(map->fd, 0) != 0) {
+                exit_with_error(strerror(errno), path);
+            }
         }
     }
-    
-
-    if (bit_count > 0) {
-        exit_with_error("invalid input: number of bits not a multiple of 8", NULL);
+    *out = fdopen(map->fd, "wb");
+#endif
+    if (!*out) {
+        exit_with_error(strerror(errno), path);
     }
-    
-    return out_len;
+    map->base = NULL;
+    return 1;
 }
 
-/* Z85 implementation */
-static const char z85_encoding_chars[] = 
-    "0123456789"
-    "abcdefghijklmnopqrstuvwxyz"
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-    ".-:+=^!/*?&<>()[]{}@%$#";
+/* Map PATH read-only, whatever its size; returns -1 if it is not a regular file or cannot be mapped */
+static int input_map_open(output_map_t *map, const char *path) {
+    memset(map, 0, sizeof(*map));
 
-// Z85 decoding table for ASCII values 33-125
-static const signed char z85_decoding_table[93] = {
-    68, -1, 84, 83, 82, 72, -1, 75, 76, 70, 65, -1, 63, 62, 69,  // ! to /
-     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 64, -1, 73, 66, 74, 71,  // 0 to ?
-    36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,  // @ to O
-    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 77, -1, 78, 67, -1, -1,  // P to `
-    10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,  // a to p
-    26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 79, -1, 80, -1, -1       // q to DEL-1
-};
+#ifdef _WIN32
+    LARGE_INTEGER size;
 
-static int is_z85(unsigned char c) {
-    return (c >= 33 && c <= 125 && z85_decoding_table[c - 33] != -1);
-}
-
-static size_t z85_encode_block(const unsigned char *in, size_t inlen, char *out, size_t outlen) {
-    size_t i, j;
-    size_t out_len = 0;
-    
-    if (inlen % 4 != 0) {
-        exit_with_error("invalid input: Z85 encoding input length must be a multiple of 4", NULL);
-    }
-    
-    for (i = 0, j = 0; i + 3 < inlen && j + 4 < outlen; i += 4) {
-        unsigned int value = ((unsigned int)in[i] << 24) |
-                             ((unsigned int)in[i+1] << 16) |
-                             ((unsigned int)in[i+2] << 8) |
-                             ((unsigned int)in[i+3]);
-        
-        for (int k = 4; k >= 0; k--) {
-            out[j+k] = z85_encoding_chars[value % 85];
-            value /= 85;
-        }
-        
-        j += 5;
-        out_len += 5;
-    }
-    
-    return out_len;
-}
-
-static size_t z85_decode_block(const char *in, size_t inlen, unsigned char *out, size_t outlen, int ignore_garbage) {
-    size_t i, j;
-    size_t out_len = 0;
-    unsigned char buffer[5];
-    size_t buffer_size = 0;
-    
-    if (inlen % 5 != 0 && !ignore_garbage) {
-        exit_with_error("invalid input: Z85 decoding input length must be a multiple of 5", NULL);
-    }
-    
-    for (i = 0, j = 0; i < inlen && j + 3 < outlen;) {
-        if (in[i] == '\n' || in[i] == '\r') {
-            i++;
-            continue;
-        }
-        
-        if (!is_z85(in[i])) {
-            if (ignore_garbage) {
-                i++;
-                continue;
-            } else {
-                exit_with_error("invalid input", NULL);
-            }
-        }
-        
-        buffer[buffer_size++] = z85_decoding_table[in[i] - 33];
-        i++;
-        
-        if (buffer_size == 5) {
-            unsigned int value = 0;
-            for (int k = 0; k < 5; k++) {
-                value = value * 85 + buffer[k];
-            }
-            
-            out[j++] = (value >> 24) & 0xFF;
-            out[j++] = (value >> 16) & 0xFF;
-            out[j++] = (value >> 8) & 0xFF;
-            out[j++] = value & 0xFF;
-            
-            out_len += 4;
-            buffer_size = 0;
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    if (GetFileType(map->file) != FILE_TYPE_DISK || !GetFileSizeEx(map->file, &size) ||
+        (unsigned long long)size.QuadPart > (size_t)-1 / 2) {
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->size = (size_t)size.QuadPart;
+    if (map->size == 0) {
+        return 0;
+    }
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map->mapping) {
+        map->base = (unsigned char *)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, map->size);
+    }
+    if (!map->base) {
+        if (map->mapping) {
+            CloseHandle(map->mapping);
         }
+        CloseHandle(map->file);
+        return -1;
     }
-    
+#else
+    struct stat st;
 
-    if (buffer_size > 0) {
-        exit_with_error("invalid input: Z85 decoding input length must be a multiple of 5", NULL);
+    map->fd = open(path, O_RDONLY);
+    if (map->fd < 0) {
+        return -1;
+    }
+    if (fstat(map->fd, &st) != 0 || !S_ISREG(st.st_mode) || (unsigned long long)st.st_size > (size_t)-1 / 2) {
+        close(map->fd);
+        return -1;
     }
-    
-    return out_len;
+    map->size = (size_t)st.st_size;
+    if (map->size == 0) {
+        return 0;
+    }
+    void *base = mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+    if (base == MAP_FAILED) {
+        close(map->fd);
+        return -1;
+    }
+    map->base = (unsigned char *)base;
+#ifdef MADV_SEQUENTIAL
+    madvise(base, map->size, MADV_SEQUENTIAL);
+#endif
+#endif
+    return 0;
 }
 
-/* Main encoding/decoding functions */
-void do_encode(FILE *in, const char *infile, FILE *out, size_t wrap_column, encoding_type_t encoding_type) {
-    unsigned char *inbuf;
-    char *outbuf;
-    size_t sum;
-    size_t current_column = 0;
-
-    inbuf = (unsigned char *)malloc(ENC_BLOCKSIZE);
-    if (!inbuf) {
-        exit_with_error("memory allocation failed", NULL);
+static void input_map_close(output_map_t *map) {
+#ifdef _WIN32
+    if (map->base) {
+        UnmapViewOfFile(map->base);
+        CloseHandle(map->mapping);
     }
-
-    size_t outbuf_size;
-    switch (encoding_type) {
+    CloseHandle(map->file);
+#else
+    if (map->base) {
+        munmap(map->base, map->size);
+    }
+    close(map->fd);
+#endif
+    map->base = NULL;
+}
+
+/* Write the dirty pages of MAP back to the file and wait for the disk */
+static void output_map_sync(output_map_t *map) {
+    if (!map->base) {
+        return;
+    }
+#ifdef _WIN32
+    if (!FlushViewOfFile(map->base, 0) || !FlushFileBuffers(map->file)) {
+        write_error();
+    }
+#else
+    if (msync(map->base, map->size, MS_SYNC) != 0) {
+        write_error();
+    }
+#endif
+}
+
+/* Unmap and cut the file down to the LENGTH bytes written */
+static void output_map_close(output_map_t *map, size_t length) {
+#ifdef _WIN32
+    LARGE_INTEGER end;
+
+    if (map->base) {
+        UnmapViewOfFile(map->base);
+        CloseHandle(map->mapping);
+    }
+    end.QuadPart = (LONGLONG)length;
+    if (!SetFilePointerEx(map->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(map->file)) {
+        CloseHandle(map->file);
+        write_error();
+    }
+    CloseHandle(map->file);
+#else
+    if (map->base) {
+        munmap(map->base, map->size);
+    }
+    if ((length != map->size && ftruncate(map->fd, (off_t)length) != 0) || close(map->fd) != 0) {
+        write_error();
+    }
+#endif
+    map->base = NULL;
+}
+
+/* Unmap and cut the file down to LENGTH bytes on the way out after an error; failures are ignored */
+static void output_map_abandon(output_map_t *map, size_t length) {
+#ifdef _WIN32
+    LARGE_INTEGER end;
+
+    if (map->base) {
+        UnmapViewOfFile(map->base);
+        CloseHandle(map->mapping);
+    }
+    end.QuadPart = (LONGLONG)length;
+    if (SetFilePointerEx(map->file, end, NULL, FILE_BEGIN)) {
+        SetEndOfFile(map->file);
+    }
+    CloseHandle(map->file);
+#else
+    if (map->base) {
+        munmap(map->base, map->size);
+    }
+    if (ftruncate(map->fd, (off_t)length) != 0) {
+        // Nothing more can be done on the way out
+    }
+    close(map->fd);
+#endif
+    map->base = NULL;
+}
+
+/* Instruction set levels of the vector kernels, selected once per run */
+typedef enum {
+    ISA_SCALAR = 0,
+    ISA_SSSE3,
+    ISA_AVX2,
+    ISA_AVX512      /* AVX512BW + VBMI + VBMI2 */
+} isa_t;
+
+static const char *isa_name(isa_t isa) {
+    switch (isa) {
+        case ISA_SSSE3:  return "ssse3";
+        case ISA_AVX2:   return "avx2";
+        case ISA_AVX512: return "avx512";
+        default:         return "scalar";
+    }
+}
+
+#ifdef BASENC_X86
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    regs[0] = (unsigned int)r[0];
+    regs[1] = (unsigned int)r[1];
+    regs[2] = (unsigned int)r[2];
+    regs[3] = (unsigned int)r[3];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0(void) {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+/* Best instruction set supported by the CPU and OS, capped by BASENC_ISA */
+static isa_t detect_isa(void) {
+    static int detected = 0;
+    static isa_t isa = ISA_SCALAR;
+
+    if (detected) {
+        return isa;
+    }
+    detected = 1;
+
+#ifdef BASENC_X86
+    unsigned int regs[4];
+    cpuid(0, 0, regs);
+    unsigned int max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    if (regs[2] & (1u << 9)) {
+        isa = ISA_SSSE3;
+    }
+    if ((regs[2] & (1u << 27)) && max_leaf >= 7) {
+        unsigned long long xcr0 = xgetbv0();
+        cpuid(7, 0, regs);
+        if ((xcr0 & 0x06) == 0x06 && (regs[1] & (1u << 5))) {
+            isa = ISA_AVX2;
+#ifdef BASENC_X86_64
+            /* AVX512F, AVX512BW, VBMI and VBMI2, with ZMM/opmask state enabled */
+            if ((xcr0 & 0xE6) == 0xE6 && (regs[1] & (1u << 16)) && (regs[1] & (1u << 30)) &&
+                (regs[2] & (1u << 1)) && (regs[2] & (1u << 6))) {
+                isa = ISA_AVX512;
+            }
+#endif
+        }
+    }
+#endif
+
+    const char *cap = getenv("BASENC_ISA");
+    if (cap && *cap) {
+        isa_t limit = ISA_AVX512;
+        if (strcmp(cap, "scalar") == 0) {
+            limit = ISA_SCALAR;
+        } else if (strcmp(cap, "ssse3") == 0) {
+            limit = ISA_SSSE3;
+        } else if (strcmp(cap, "avx2") == 0) {
+            limit = ISA_AVX2;
+        }
+        if (isa > limit) {
+            isa = limit;
+        }
+    }
+
+    return isa;
+}
+
+static unsigned int ctz32(unsigned int x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(x);
+#endif
+}
+
+/*
+ * Compaction pre-pass for irregular decoder input.  Classifies a vector of
+ * bytes at a time as alphabet, newline ('\r', '\n') or other, and packs the
+ * alphabet characters into a dense buffer for the bulk kernels.  Newlines
+ * are always dropped and other bytes are dropped with -i.  A compactor
+ * stops at the first byte the general path has to see ('=' padding, or
+ * garbage without -i) and returns how many input bytes it consumed.
+ *
+ * Alphabet membership is a 8x16 bit matrix indexed by the high and low
+ * nibble, so any ASCII alphabet can be tested with two pshufb lookups.
+ */
+typedef struct {
+    unsigned char lo[16];       /* bit h set if (h << 4 | lo) is in the alphabet */
+    unsigned char hi[16];       /* 1 << h for h < 8, 0 for non-ASCII */
+    const unsigned char *table; /* decode table, for the scalar tail */
+    int pad;                    /* padding character to stop at, -1 for none */
+    int ignore_garbage;
+} compact_class_t;
+
+typedef size_t (*compact_fn)(const unsigned char *in, size_t len, unsigned char *out, size_t *nout, const compact_class_t *cls);
+
+/* Output of a compactor may overrun *nout by up to COMPACT_SLACK bytes */
+#define COMPACT_SLACK 64
+
+static unsigned char compact_shuffle[256][8];   /* 8-bit keep mask -> indices of kept bytes */
+static unsigned char compact_count[256];        /* 8-bit keep mask -> number of kept bytes */
+
+static void build_compact_tables(void) {
+    static int built = 0;
+
+    if (built) {
+        return;
+    }
+    for (int mask = 0; mask < 256; mask++) {
+        int n = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            if (mask & (1 << bit)) {
+                compact_shuffle[mask][n++] = (unsigned char)bit;
+            }
+        }
+        compact_count[mask] = (unsigned char)n;
+        while (n < 8) {
+            compact_shuffle[mask][n++] = 0x80;
+        }
+    }
+    built = 1;
+}
+
+static void build_compact_class(compact_class_t *cls, const unsigned char *table, int pad, int ignore_garbage) {
+    memset(cls, 0, sizeof(*cls));
+    for (int c = 0; c < 128; c++) {
+        if (table[c] != DEC_INVALID) {
+            cls->lo[c & 0x0F] |= (unsigned char)(1 << (c >> 4));
+        }
+    }
+    for (int h = 0; h < 8; h++) {
+        cls->hi[h] = (unsigned char)(1 << h);
+    }
+    cls->table = table;
+    cls->pad = pad;
+    cls->ignore_garbage = ignore_garbage;
+}
+
+static size_t compact_scalar(const unsigned char *in, size_t len, unsigned char *out, size_t *nout, const compact_class_t *cls) {
+    size_t o = *nout;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        unsigned char c = in[i];
+        if (cls->table[c] != DEC_INVALID) {
+            out[o++] = c;
+        } else if (c == '\n' || c == '\r') {
+            continue;
+        } else if (c == cls->pad || !cls->ignore_garbage) {
+            break;
+        }
+    }
+
+    *nout = o;
+    return i;
+}
+
+#ifdef BASENC_X86
+/*
+ * Classify the bytes of V against CLS, whose nibble tables are loaded in
+ * LO_LUT and HI_LUT: returns the mask of alphabet bytes and sets *STOP to
+ * the mask of bytes a compactor or scanner has to stop at.
+ */
+TARGET("ssse3")
+KERNEL_INLINE unsigned int classify_ssse3(__m128i v, __m128i lo_lut, __m128i hi_lut, const compact_class_t *cls,
+                                          unsigned int *stop) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i lo = _mm_and_si128(v, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+    __m128i bits = _mm_and_si128(_mm_shuffle_epi8(lo_lut, lo), _mm_shuffle_epi8(hi_lut, hi));
+    unsigned int valid = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) & 0xFFFF;
+
+    *stop = 0;
+    if (valid != 0xFFFF) {
+        unsigned int newline = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        unsigned int other = ~(valid | newline) & 0xFFFF;
+        *stop = cls->ignore_garbage ? 0 : other;
+        if (cls->pad >= 0) {
+            *stop |= (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)cls->pad)));
+        }
+    }
+    return valid;
+}
+
+TARGET("avx2")
+KERNEL_INLINE unsigned int classify_avx2(__m256i v, __m256i lo_lut, __m256i hi_lut, const compact_class_t *cls,
+                                         unsigned int *stop) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    __m256i bits = _mm256_and_si256(_mm256_shuffle_epi8(lo_lut, lo), _mm256_shuffle_epi8(hi_lut, hi));
+    unsigned int valid = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, _mm256_setzero_si256()));
+
+    *stop = 0;
+    if (valid != 0xFFFFFFFFu) {
+        unsigned int newline = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        unsigned int other = ~(valid | newline);
+        *stop = cls->ignore_garbage ? 0 : other;
+        if (cls->pad >= 0) {
+            *stop |= (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8((char)cls->pad)));
+        }
+    }
+    return valid;
+}
+
+#ifdef BASENC_X86_64
+TARGET("avx512f,avx512bw")
+KERNEL_INLINE __mmask64 classify_avx512(__m512i v, __m512i lo_lut, __m512i hi_lut, const compact_class_t *cls,
+                                        __mmask64 *stop) {
+    const __m512i nibble = _mm512_set1_epi8(0x0F);
+    __m512i lo = _mm512_and_si512(v, nibble);
+    __m512i hi = _mm512_and_si512(_mm512_srli_epi16(v, 4), nibble);
+    __m512i bits = _mm512_and_si512(_mm512_shuffle_epi8(lo_lut, lo), _mm512_shuffle_epi8(hi_lut, hi));
+    __mmask64 valid = _mm512_test_epi8_mask(bits, bits);
+
+    *stop = 0;
+    if (valid != ~(__mmask64)0) {
+        __mmask64 newline = _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n')) |
+                            _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\r'));
+        __mmask64 other = ~(valid | newline);
+        *stop = cls->ignore_garbage ? 0 : other;
+        if (cls->pad >= 0) {
+            *stop |= _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8((char)cls->pad));
+        }
+    }
+    return valid;
+}
+#endif
+
+/* Store the bytes of V selected by the 16-bit KEEP mask at OUT, return how many */
+TARGET("ssse3")
+static size_t compact_store16(__m128i v, unsigned int keep, unsigned char *out) {
+    unsigned int m0 = keep & 0xFF, m1 = (keep >> 8) & 0xFF;
+    __m128i s0 = _mm_loadl_epi64((const __m128i *)compact_shuffle[m0]);
+    __m128i s1 = _mm_add_epi8(_mm_loadl_epi64((const __m128i *)compact_shuffle[m1]), _mm_set1_epi8(8));
+
+    _mm_storel_epi64((__m128i *)out, _mm_shuffle_epi8(v, s0));
+    _mm_storel_epi64((__m128i *)(out + compact_count[m0]), _mm_shuffle_epi8(v, s1));
+    return compact_count[m0] + compact_count[m1];
+}
+
+TARGET("ssse3")
+static size_t compact_ssse3(const unsigned char *in, size_t len, unsigned char *out, size_t *nout, const compact_class_t *cls) {
+    const __m128i lo_lut = _mm_loadu_si128((const __m128i *)cls->lo);
+    const __m128i hi_lut = _mm_loadu_si128((const __m128i *)cls->hi);
+    size_t o = *nout;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        unsigned int stop;
+        unsigned int valid = classify_ssse3(v, lo_lut, hi_lut, cls, &stop);
+
+        if (stop) {
+            unsigned int pos = ctz32(stop);
+            o += compact_store16(v, valid & ((1u << pos) - 1), out + o);
+            *nout = o;
+            return i + pos;
+        }
+        o += compact_store16(v, valid, out + o);
+    }
+
+    *nout = o;
+    return i + compact_scalar(in + i, len - i, out, nout, cls);
+}
+
+TARGET("avx2")
+static size_t compact_avx2(const unsigned char *in, size_t len, unsigned char *out, size_t *nout, const compact_class_t *cls) {
+    const __m256i lo_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cls->lo));
+    const __m256i hi_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cls->hi));
+    size_t o = *nout;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        unsigned int stop;
+        unsigned int valid = classify_avx2(v, lo_lut, hi_lut, cls, &stop);
+        __m128i v0 = _mm256_castsi256_si128(v);
+        __m128i v1 = _mm256_extracti128_si256(v, 1);
+
+        if (stop) {
+            unsigned int pos = ctz32(stop);
+            unsigned int keep = valid & (unsigned int)((1ull << pos) - 1);
+            o += compact_store16(v0, keep & 0xFFFF, out + o);
+            o += compact_store16(v1, keep >> 16, out + o);
+            *nout = o;
+            return i + pos;
+        }
+        o += compact_store16(v0, valid & 0xFFFF, out + o);
+        o += compact_store16(v1, valid >> 16, out + o);
+    }
+
+    *nout = o;
+    return i + compact_scalar(in + i, len - i, out, nout, cls);
+}
+
+#ifdef BASENC_X86_64
+TARGET("avx512f,avx512bw,avx512vbmi2,popcnt,bmi")
+static size_t compact_avx512(const unsigned char *in, size_t len, unsigned char *out, size_t *nout, const compact_class_t *cls) {
+    const __m512i lo_lut = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)cls->lo));
+    const __m512i hi_lut = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)cls->hi));
+    size_t o = *nout;
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(in + i));
+        __mmask64 stop;
+        __mmask64 valid = classify_avx512(v, lo_lut, hi_lut, cls, &stop);
+
+        if (stop) {
+            unsigned long long pos = _tzcnt_u64(stop);
+            __mmask64 keep = valid & ((1ull << pos) - 1);
+            _mm512_storeu_si512((void *)(out + o), _mm512_maskz_compress_epi8(keep, v));
+            o += (size_t)_mm_popcnt_u64(keep);
+            *nout = o;
+            return i + (size_t)pos;
+        }
+        _mm512_storeu_si512((void *)(out + o), _mm512_maskz_compress_epi8(valid, v));
+        o += (size_t)_mm_popcnt_u64(valid);
+    }
+
+    *nout = o;
+    return i + compact_scalar(in + i, len - i, out, nout, cls);
+}
+#endif
+#endif
+
+static compact_fn select_compactor(isa_t isa) {
+#ifdef BASENC_X86
+#ifdef BASENC_X86_64
+    if (isa >= ISA_AVX512) {
+        return compact_avx512;
+    }
+#endif
+    if (isa >= ISA_AVX2) {
+        return compact_avx2;
+    }
+    if (isa >= ISA_SSSE3) {
+        return compact_ssse3;
+    }
+#else
+    (void)isa;
+#endif
+    return compact_scalar;
+}
+
+/*
+ * Validation scan (--check, --size): the compactors' classification
+ * without the packing.  Counts the alphabet characters of IN into *CHARS
+ * and stops where a compactor would, returning the bytes consumed.
+ */
+typedef size_t (*scan_fn)(const unsigned char *in, size_t len, size_t *chars, const compact_class_t *cls);
+
+static size_t scan_scalar(const unsigned char *in, size_t len, size_t *chars, const compact_class_t *cls) {
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        unsigned char c = in[i];
+        if (cls->table[c] != DEC_INVALID) {
+            n++;
+        } else if (c == '\n' || c == '\r') {
+            continue;
+        } else if (c == cls->pad || !cls->ignore_garbage) {
+            break;
+        }
+    }
+
+    *chars += n;
+    return i;
+}
+
+#ifdef BASENC_X86
+TARGET("ssse3")
+static size_t scan_ssse3(const unsigned char *in, size_t len, size_t *chars, const compact_class_t *cls) {
+    const __m128i lo_lut = _mm_loadu_si128((const __m128i *)cls->lo);
+    const __m128i hi_lut = _mm_loadu_si128((const __m128i *)cls->hi);
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        unsigned int stop;
+        unsigned int valid = classify_ssse3(_mm_loadu_si128((const __m128i *)(in + i)), lo_lut, hi_lut, cls, &stop);
+
+        if (stop) {
+            unsigned int pos = ctz32(stop);
+            valid &= (1u << pos) - 1;
+            *chars += n + compact_count[valid & 0xFF] + compact_count[valid >> 8];
+            return i + pos;
+        }
+        n += compact_count[valid & 0xFF] + compact_count[valid >> 8];
+    }
+
+    *chars += n;
+    return i + scan_scalar(in + i, len - i, chars, cls);
+}
+
+TARGET("avx2,popcnt")
+static size_t scan_avx2(const unsigned char *in, size_t len, size_t *chars, const compact_class_t *cls) {
+    const __m256i lo_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cls->lo));
+    const __m256i hi_lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)cls->hi));
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        unsigned int stop;
+        unsigned int valid = classify_avx2(_mm256_loadu_si256((const __m256i *)(in + i)), lo_lut, hi_lut, cls, &stop);
+
+        if (stop) {
+            unsigned int pos = ctz32(stop);
+            *chars += n + (size_t)_mm_popcnt_u32(valid & (unsigned int)((1ull << pos) - 1));
+            return i + pos;
+        }
+        n += (size_t)_mm_popcnt_u32(valid);
+    }
+
+    *chars += n;
+    return i + scan_scalar(in + i, len - i, chars, cls);
+}
+
+#ifdef BASENC_X86_64
+TARGET("avx512f,avx512bw,popcnt,bmi")
+static size_t scan_avx512(const unsigned char *in, size_t len, size_t *chars, const compact_class_t *cls) {
+    const __m512i lo_lut = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)cls->lo));
+    const __m512i hi_lut = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)cls->hi));
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        __mmask64 stop;
+        __mmask64 valid = classify_avx512(_mm512_loadu_si512((const void *)(in + i)), lo_lut, hi_lut, cls, &stop);
+
+        if (stop) {
+            unsigned long long pos = _tzcnt_u64(stop);
+            *chars += n + (size_t)_mm_popcnt_u64(valid & ((1ull << pos) - 1));
+            return i + (size_t)pos;
+        }
+        n += (size_t)_mm_popcnt_u64(valid);
+    }
+
+    *chars += n;
+    return i + scan_scalar(in + i, len - i, chars, cls);
+}
+#endif
+#endif
+
+static scan_fn select_scanner(isa_t isa) {
+#ifdef BASENC_X86
+#ifdef BASENC_X86_64
+    if (isa >= ISA_AVX512) {
+        return scan_avx512;
+    }
+#endif
+    if (isa >= ISA_AVX2) {
+        return scan_avx2;
+    }
+    if (isa >= ISA_SSSE3) {
+        return scan_ssse3;
+    }
+#else
+    (void)isa;
+#endif
+    return scan_scalar;
+}
+
+/*
+ * Zero-word test: bit K of the result is set when 4-byte word K of the 32
+ * bytes at IN is all zero.  Ascii85 writes such words as 'z'.
+ */
+typedef unsigned int (*zero_words_fn)(const unsigned char *in);
+
+static unsigned int zero_words_scalar(const unsigned char *in) {
+    unsigned int mask = 0;
+
+    for (int k = 0; k < 8; k++) {
+        unsigned int word;
+        memcpy(&word, in + 4 * k, 4);
+        mask |= (unsigned int)(word == 0) << k;
+    }
+    return mask;
+}
+
+#ifdef BASENC_X86
+TARGET("ssse3")
+static unsigned int zero_words_ssse3(const unsigned char *in) {
+    __m128i lo = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)in), _mm_setzero_si128());
+    __m128i hi = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(in + 16)), _mm_setzero_si128());
+
+    return (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(lo)) |
+           ((unsigned int)_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4);
+}
+
+TARGET("avx2")
+static unsigned int zero_words_avx2(const unsigned char *in) {
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)in), _mm256_setzero_si256());
+
+    return (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(eq));
+}
+#endif
+
+static zero_words_fn select_zero_words(isa_t isa, isa_t *used) {
+#ifdef BASENC_X86
+    if (isa >= ISA_AVX2) {
+        *used = ISA_AVX2;
+        return zero_words_avx2;
+    }
+    if (isa >= ISA_SSSE3) {
+        *used = ISA_SSSE3;
+        return zero_words_ssse3;
+    }
+#else
+    (void)isa;
+#endif
+    *used = ISA_SCALAR;
+    return zero_words_scalar;
+}
+/*
+ * Quoted-printable scanners, returning the length of the leading run of
+ * IN that needs no attention: for the encoder, bytes written as they are
+ * (printable ASCII except '=', space and tab); for the decoder, bytes
+ * other than '=' and '\n'.
+ */
+typedef size_t (*qp_scan_fn)(const unsigned char *in, size_t len);
+
+#define QP_LITERAL(c) (((c) >= ' ' && (c) <= '~' && (c) != '=') || (c) == '\t')
+
+static size_t qp_literal_scalar(const unsigned char *in, size_t len) {
+    size_t i = 0;
+
+    while (i < len && QP_LITERAL(in[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t qp_special_scalar(const unsigned char *in, size_t len) {
+    size_t i = 0;
+
+    while (i < len && in[i] != '=' && in[i] != '\n') {
+        i++;
+    }
+    return i;
+}
+
+#ifdef BASENC_X86
+TARGET("ssse3")
+static size_t qp_literal_ssse3(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        // Signed compares: bytes from 0x80 are negative, so below ' '
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(' ' - 1)),
+                                          _mm_cmplt_epi8(v, _mm_set1_epi8('~' + 1)));
+        __m128i literal = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('=')), printable),
+                                       _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        unsigned int stop = ~(unsigned int)_mm_movemask_epi8(literal) & 0xFFFF;
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + qp_literal_scalar(in + i, len - i);
+}
+
+TARGET("ssse3")
+static size_t qp_special_ssse3(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        unsigned int stop = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('=')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + qp_special_scalar(in + i, len - i);
+}
+
+TARGET("avx2")
+static size_t qp_literal_avx2(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i printable = _mm256_andnot_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('~')),
+                                                _mm256_cmpgt_epi8(v, _mm256_set1_epi8(' ' - 1)));
+        __m256i literal = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('=')), printable),
+                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(literal);
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + qp_literal_ssse3(in + i, len - i);
+}
+
+TARGET("avx2")
+static size_t qp_special_avx2(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        unsigned int stop = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('=')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + qp_special_ssse3(in + i, len - i);
+}
+#endif
+
+/* Scanner for encoding (LITERAL) or decoding at or below ISA; *USED gets its level */
+static qp_scan_fn select_qp_scanner(int literal, isa_t isa, isa_t *used) {
+#ifdef BASENC_X86
+    if (isa >= ISA_AVX2) {
+        *used = ISA_AVX2;
+        return literal ? qp_literal_avx2 : qp_special_avx2;
+    }
+    if (isa >= ISA_SSSE3) {
+        *used = ISA_SSSE3;
+        return literal ? qp_literal_ssse3 : qp_special_ssse3;
+    }
+#else
+    (void)isa;
+#endif
+    *used = ISA_SCALAR;
+    return literal ? qp_literal_scalar : qp_special_scalar;
+}
+/*
+ * Percent-encoding scanners, in the same form: for the encoder, RFC 3986
+ * unreserved characters (letters, digits, '-', '.', '_' and '~'); for the
+ * decoder, bytes other than '%', '\r' and '\n'.
+ */
+#define PERCENT_UNRESERVED(c) \
+    ((((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z') || ((c) >= '0' && (c) <= '9') || \
+     (c) == '-' || (c) == '.' || (c) == '_' || (c) == '~')
+
+static size_t percent_literal_scalar(const unsigned char *in, size_t len) {
+    size_t i = 0;
+
+    while (i < len && PERCENT_UNRESERVED(in[i])) {
+        i++;
+    }
+    return i;
+}
+
+static size_t percent_special_scalar(const unsigned char *in, size_t len) {
+    size_t i = 0;
+
+    while (i < len && in[i] != '%' && in[i] != '\n' && in[i] != '\r') {
+        i++;
+    }
+    return i;
+}
+
+#ifdef BASENC_X86
+TARGET("ssse3")
+static size_t percent_literal_ssse3(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        // Signed compares: bytes from 0x80 are negative, so outside every range
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+        __m128i mark = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')), _mm_cmpeq_epi8(v, _mm_set1_epi8('.'))),
+                                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')), _mm_cmpeq_epi8(v, _mm_set1_epi8('~'))));
+        unsigned int stop = ~(unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), mark)) & 0xFFFF;
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + percent_literal_scalar(in + i, len - i);
+}
+
+TARGET("ssse3")
+static size_t percent_special_ssse3(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i newline = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        unsigned int stop = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')), newline));
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + percent_special_scalar(in + i, len - i);
+}
+
+TARGET("avx2")
+static size_t percent_literal_avx2(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i alpha = _mm256_andnot_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('z')),
+                                            _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)));
+        __m256i digit = _mm256_andnot_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('9')),
+                                            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)));
+        __m256i mark = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('~'))));
+        unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), mark));
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + percent_literal_ssse3(in + i, len - i);
+}
+
+TARGET("avx2")
+static size_t percent_special_avx2(const unsigned char *in, size_t len) {
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i newline = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                          _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        unsigned int stop = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('%')), newline));
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return i + percent_special_ssse3(in + i, len - i);
+}
+#endif
+
+static qp_scan_fn select_percent_scanner(int literal, isa_t isa, isa_t *used) {
+#ifdef BASENC_X86
+    if (isa >= ISA_AVX2) {
+        *used = ISA_AVX2;
+        return literal ? percent_literal_avx2 : percent_special_avx2;
+    }
+    if (isa >= ISA_SSSE3) {
+        *used = ISA_SSSE3;
+        return literal ? percent_literal_ssse3 : percent_special_ssse3;
+    }
+#else
+    (void)isa;
+#endif
+    *used = ISA_SCALAR;
+    return literal ? percent_literal_scalar : percent_special_scalar;
+}
+
+
+
+/*
+ * Codec kernels.
+ *
+ * The bodies below are generic over the alphabet: they take the encoding
+ * alphabet and the decode table as parameters and are forced inline.  The
+ * DEFINE_*_KERNELS macros further down instantiate one function per
+ * (encoding, direction, instruction set) with that encoding's tables as
+ * compile-time constants, so every specialization is inlined and unrolled
+ * on its own.  select_encoder() and select_decoder() pick one of them per
+ * run; nothing is looked up per character.
+ *
+ * An encode kernel encodes LEN bytes, including the padded final quantum,
+ * and returns the number of characters written.  A decode kernel decodes
+ * NQUANTA complete quanta of dense alphabet characters (no newlines,
+ * padding or garbage) and returns nonzero if any character was not in the
+ * alphabet.  Invalid characters map to DEC_INVALID, so OR-ing the decoded
+ * values together and testing the top bit is enough to validate a run.
+ */
+typedef size_t (*encode_fn)(const unsigned char *in, size_t len, char *out);
+typedef int (*decode_fn)(const unsigned char *in, size_t nquanta, unsigned char *out);
+
+/* Alphabets */
+static const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char base64url_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+static const char base32_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+static const char base32hex_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUV";
+static const char base16_chars[] = "0123456789ABCDEF";
+
+static const char z85_encoding_chars[] =
+    "0123456789"
+    "abcdefghijklmnopqrstuvwxyz"
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    ".-:+=^!/*?&<>()[]{}@%$#";
+
+/* uuencode: ' ' + value, with '`' rather than ' ' for zero */
+static const char uu_chars[] =
+    "`!\"#$%&'()*+,-./0123456789:;<=>?"
+    "@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_";
+
+/* Adobe/btoa Ascii85: '!' + value */
+static const char ascii85_chars[] =
+    "!\"#$%&'()*+,-./0123456789:;<=>?@"
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+    "abcdefghijklmnopqrstu";
+
+/* RFC 9285; zero-filled so vector lookups may read whole rows */
+static const char base45_chars[64] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+/* Bitcoin alphabet: no 0, O, I or l */
+static const char base58_chars[] =
+    "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+/*
+ * Decode tables, built by the preprocessor: TABLE_256(F) expands to
+ * F(0), F(1), ..., F(255), where F maps a character to its value, or to
+ * DEC_INVALID, as a constant expression.
+ */
+#define TABLE_ROW(F, r) \
+    F((r) + 0), F((r) + 1), F((r) + 2), F((r) + 3), F((r) + 4), F((r) + 5), F((r) + 6), F((r) + 7), \
+    F((r) + 8), F((r) + 9), F((r) + 10), F((r) + 11), F((r) + 12), F((r) + 13), F((r) + 14), F((r) + 15)
+#define TABLE_64(F) TABLE_ROW(F, 0x00), TABLE_ROW(F, 0x10), TABLE_ROW(F, 0x20), TABLE_ROW(F, 0x30)
+#define TABLE_256(F) \
+    TABLE_64(F), TABLE_ROW(F, 0x40), TABLE_ROW(F, 0x50), TABLE_ROW(F, 0x60), TABLE_ROW(F, 0x70), \
+    TABLE_ROW(F, 0x80), TABLE_ROW(F, 0x90), TABLE_ROW(F, 0xA0), TABLE_ROW(F, 0xB0), \
+    TABLE_ROW(F, 0xC0), TABLE_ROW(F, 0xD0), TABLE_ROW(F, 0xE0), TABLE_ROW(F, 0xF0)
+
+#define IN_RANGE(c, lo, hi) ((c) >= (lo) && (c) <= (hi))
+
+#define BASE64_VALUE(c) \
+    (IN_RANGE(c, 'A', 'Z') ? (c) - 'A' : IN_RANGE(c, 'a', 'z') ? (c) - 'a' + 26 : \
+     IN_RANGE(c, '0', '9') ? (c) - '0' + 52 : (c) == '+' ? 62 : (c) == '/' ? 63 : DEC_INVALID)
+#define BASE64URL_VALUE(c) \
+    (IN_RANGE(c, 'A', 'Z') ? (c) - 'A' : IN_RANGE(c, 'a', 'z') ? (c) - 'a' + 26 : \
+     IN_RANGE(c, '0', '9') ? (c) - '0' + 52 : (c) == '-' ? 62 : (c) == '_' ? 63 : DEC_INVALID)
+#define BASE32_VALUE(c) \
+    (IN_RANGE(c, 'A', 'Z') ? (c) - 'A' : IN_RANGE(c, 'a', 'z') ? (c) - 'a' : \
+     IN_RANGE(c, '2', '7') ? (c) - '2' + 26 : DEC_INVALID)
+#define BASE32HEX_VALUE(c) \
+    (IN_RANGE(c, '0', '9') ? (c) - '0' : IN_RANGE(c, 'A', 'V') ? (c) - 'A' + 10 : \
+     IN_RANGE(c, 'a', 'v') ? (c) - 'a' + 10 : DEC_INVALID)
+#define BASE16_VALUE(c) \
+    (IN_RANGE(c, '0', '9') ? (c) - '0' : IN_RANGE(c, 'A', 'F') ? (c) - 'A' + 10 : \
+     IN_RANGE(c, 'a', 'f') ? (c) - 'a' + 10 : DEC_INVALID)
+#define BASE2_VALUE(c) ((c) == '0' ? 0 : (c) == '1' ? 1 : DEC_INVALID)
+#define Z85_VALUE(c) \
+    (IN_RANGE(c, '0', '9') ? (c) - '0' : IN_RANGE(c, 'a', 'z') ? (c) - 'a' + 10 : \
+     IN_RANGE(c, 'A', 'Z') ? (c) - 'A' + 36 : \
+     (c) == '.' ? 62 : (c) == '-' ? 63 : (c) == ':' ? 64 : (c) == '+' ? 65 : (c) == '=' ? 66 : \
+     (c) == '^' ? 67 : (c) == '!' ? 68 : (c) == '/' ? 69 : (c) == '*' ? 70 : (c) == '?' ? 71 : \
+     (c) == '&' ? 72 : (c) == '<' ? 73 : (c) == '>' ? 74 : (c) == '(' ? 75 : (c) == ')' ? 76 : \
+     (c) == '[' ? 77 : (c) == ']' ? 78 : (c) == '{' ? 79 : (c) == '}' ? 80 : (c) == '@' ? 81 : \
+     (c) == '%' ? 82 : (c) == '$' ? 83 : (c) == '#' ? 84 : DEC_INVALID)
+#define BASE45_VALUE(c) \
+    (IN_RANGE(c, '0', '9') ? (c) - '0' : IN_RANGE(c, 'A', 'Z') ? (c) - 'A' + 10 : \
+     (c) == ' ' ? 36 : (c) == '$' ? 37 : (c) == '%' ? 38 : (c) == '*' ? 39 : (c) == '+' ? 40 : \
+     (c) == '-' ? 41 : (c) == '.' ? 42 : (c) == '/' ? 43 : (c) == ':' ? 44 : DEC_INVALID)
+#define UU_VALUE(c) ((c) == '`' ? 0 : IN_RANGE(c, ' ', '_') ? (c) - ' ' : DEC_INVALID)
+#define ASCII85_VALUE(c) (IN_RANGE(c, '!', 'u') ? (c) - '!' : DEC_INVALID)
+#define BASE58_VALUE(c) \
+    (IN_RANGE(c, '1', '9') ? (c) - '1' : IN_RANGE(c, 'A', 'H') ? (c) - 'A' + 9 : \
+     IN_RANGE(c, 'J', 'N') ? (c) - 'J' + 17 : IN_RANGE(c, 'P', 'Z') ? (c) - 'P' + 22 : \
+     IN_RANGE(c, 'a', 'k') ? (c) - 'a' + 33 : IN_RANGE(c, 'm', 'z') ? (c) - 'm' + 44 : DEC_INVALID)
+
+static const unsigned char base64_decode_table[256] = { TABLE_256(BASE64_VALUE) };
+static const unsigned char base64url_decode_table[256] = { TABLE_256(BASE64URL_VALUE) };
+static const unsigned char base32_decode_table[256] = { TABLE_256(BASE32_VALUE) };
+static const unsigned char base32hex_decode_table[256] = { TABLE_256(BASE32HEX_VALUE) };
+static const unsigned char base16_decode_table[256] = { TABLE_256(BASE16_VALUE) };
+static const unsigned char base2_decode_table[256] = { TABLE_256(BASE2_VALUE) };
+static const unsigned char z85_decode_table[256] = { TABLE_256(Z85_VALUE) };
+static const unsigned char base45_decode_table[256] = { TABLE_256(BASE45_VALUE) };
+static const unsigned char uu_decode_table[256] = { TABLE_256(UU_VALUE) };
+static const unsigned char ascii85_decode_table[256] = { TABLE_256(ASCII85_VALUE) };
+static const unsigned char base58_decode_table[256] = { TABLE_256(BASE58_VALUE) };
+
+/*
+ * Run-time alphabet (--alphabet, --padding), replacing the built-in one of
+ * custom_encoding.  The custom* kernels are the same table-driven and
+ * vector kernels as the built-in alphabets reading these arrays instead,
+ * so a custom alphabet runs as fast as the one it replaces.
+ */
+static encoding_type_t custom_encoding = ENC_NONE;
+static char custom_chars[64];
+static unsigned char custom_decode_table[256];
+static int custom_pad = '=';            /* -1 for unpadded output */
+
+/* Base64 implementation */
+KERNEL_INLINE size_t base64_encode_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    char *o = out;
+    size_t i;
+
+    for (i = 0; i + 3 <= len; i += 3, o += 4) {
+        unsigned int value = ((unsigned int)in[i] << 16) | ((unsigned int)in[i + 1] << 8) | in[i + 2];
+        o[0] = alphabet[(value >> 18) & 0x3F];
+        o[1] = alphabet[(value >> 12) & 0x3F];
+        o[2] = alphabet[(value >> 6) & 0x3F];
+        o[3] = alphabet[value & 0x3F];
+    }
+
+    if (i < len) {
+        unsigned int value = (unsigned int)in[i] << 16;
+        if (i + 1 < len) {
+            value |= (unsigned int)in[i + 1] << 8;
+        }
+        o[0] = alphabet[(value >> 18) & 0x3F];
+        o[1] = alphabet[(value >> 12) & 0x3F];
+        o[2] = i + 1 < len ? alphabet[(value >> 6) & 0x3F] : '=';
+        o[3] = '=';
+        o += 4;
+    }
+
+    return (size_t)(o - out);
+}
+
+KERNEL_INLINE int base64_decode_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    unsigned int bad = 0;
+
+    for (size_t q = 0; q < nquanta; q++, in += 4, out += 3) {
+        unsigned int a = table[in[0]], b = table[in[1]], c = table[in[2]], d = table[in[3]];
+        unsigned int value = (a << 18) | (b << 12) | (c << 6) | d;
+        bad |= a | b | c | d;
+        out[0] = (unsigned char)(value >> 16);
+        out[1] = (unsigned char)(value >> 8);
+        out[2] = (unsigned char)value;
+    }
+
+    return (bad & 0x80) != 0;
+}
+
+/* Base32 implementation */
+static const unsigned char base32_partial_chars[5] = { 0, 2, 4, 5, 7 };
+
+KERNEL_INLINE size_t base32_encode_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    char *o = out;
+    size_t i;
+
+    for (i = 0; i + 5 <= len; i += 5, o += 8) {
+        unsigned long long value = ((unsigned long long)in[i] << 32) | ((unsigned long long)in[i + 1] << 24) |
+                                   ((unsigned long long)in[i + 2] << 16) | ((unsigned long long)in[i + 3] << 8) |
+                                   in[i + 4];
+        for (int k = 0; k < 8; k++) {
+            o[k] = alphabet[(value >> (35 - 5 * k)) & 0x1F];
+        }
+    }
+
+    if (i < len) {
+        unsigned char last[5] = { 0, 0, 0, 0, 0 };
+        unsigned long long value = 0;
+        size_t nchars = base32_partial_chars[len - i];
+
+        memcpy(last, in + i, len - i);
+        for (int k = 0; k < 5; k++) {
+            value = (value << 8) | last[k];
+        }
+        for (size_t k = 0; k < 8; k++) {
+            o[k] = k < nchars ? alphabet[(value >> (35 - 5 * k)) & 0x1F] : '=';
+        }
+        o += 8;
+    }
+
+    return (size_t)(o - out);
+}
+
+KERNEL_INLINE int base32_decode_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    unsigned int bad = 0;
+
+    for (size_t q = 0; q < nquanta; q++, in += 8, out += 5) {
+        unsigned long long value = 0;
+        for (int k = 0; k < 8; k++) {
+            unsigned int v = table[in[k]];
+            bad |= v;
+            value = (value << 5) | (v & 0x1F);
+        }
+        out[0] = (unsigned char)(value >> 32);
+        out[1] = (unsigned char)(value >> 24);
+        out[2] = (unsigned char)(value >> 16);
+        out[3] = (unsigned char)(value >> 8);
+        out[4] = (unsigned char)value;
+    }
+
+    return (bad & 0x80) != 0;
+}
+
+/* Base16 (hex) implementation */
+KERNEL_INLINE size_t base16_encode_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = alphabet[in[i] >> 4];
+        out[2 * i + 1] = alphabet[in[i] & 0x0F];
+    }
+
+    return len * 2;
+}
+
+KERNEL_INLINE int base16_decode_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    unsigned int bad = 0;
+
+    for (size_t q = 0; q < nquanta; q++, in += 2) {
+        unsigned int high = table[in[0]], low = table[in[1]];
+        bad |= high | low;
+        out[q] = (unsigned char)((high << 4) | (low & 0x0F));
+    }
+
+    return (bad & 0x80) != 0;
+}
+
+/* Base2 implementation: spread the bits of a byte over eight bytes of a word */
+KERNEL_INLINE size_t base2_encode_impl(const unsigned char *in, size_t len, char *out, int msb_first) {
+    const unsigned long long select = msb_first ? 0x0102040810204080ULL : 0x8040201008040201ULL;
+
+    for (size_t i = 0; i < len; i++, out += 8) {
+        unsigned long long bits = (in[i] * 0x0101010101010101ULL) & select;
+        bits = (((bits + 0x7F7F7F7F7F7F7F7FULL) >> 7) & 0x0101010101010101ULL) | 0x3030303030303030ULL;
+        for (int k = 0; k < 8; k++) {
+            out[k] = (char)(bits >> (8 * k));
+        }
+    }
+
+    return len * 8;
+}
+
+KERNEL_INLINE int base2_decode_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table, int msb_first) {
+    unsigned int bad = 0;
+
+    for (size_t q = 0; q < nquanta; q++, in += 8) {
+        unsigned int byte = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            unsigned int v = table[in[bit]];
+            bad |= v;
+            byte |= (v & 1) << (msb_first ? 7 - bit : bit);
+        }
+        out[q] = (unsigned char)byte;
+    }
+
+    return (bad & 0x80) != 0;
+}
+
+/* Base-85 core shared by Z85 and Ascii85: a big-endian 32-bit word is five digits */
+KERNEL_INLINE unsigned int base85_load_word(const unsigned char *in) {
+    return ((unsigned int)in[0] << 24) | ((unsigned int)in[1] << 16) | ((unsigned int)in[2] << 8) | in[3];
+}
+
+KERNEL_INLINE void base85_store_word(unsigned char *out, unsigned int value) {
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+KERNEL_INLINE void base85_encode_word(unsigned int value, char *out, const char *alphabet) {
+    for (int k = 4; k >= 0; k--) {
+        out[k] = alphabet[value % 85];
+        value /= 85;
+    }
+}
+
+/* Value of five digits, above 0xFFFFFFFF on overflow; ORs the table entries into *BAD */
+KERNEL_INLINE unsigned long long base85_decode_word(const unsigned char *in, const unsigned char *table, unsigned int *bad) {
+    unsigned long long value = 0;
+
+    for (int k = 0; k < 5; k++) {
+        unsigned int v = table[in[k]];
+        *bad |= v;
+        value = value * 85 + (v & 0x7F);
+    }
+    return value;
+}
+
+/* Z85 implementation; the caller rejects input that is not a multiple of 4 bytes */
+KERNEL_INLINE size_t z85_encode_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    size_t i;
+
+    for (i = 0; i + 4 <= len; i += 4, out += 5) {
+        base85_encode_word(base85_load_word(in + i), out, alphabet);
+    }
+
+    return i / 4 * 5;
+}
+
+KERNEL_INLINE int z85_decode_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    unsigned int bad = 0;
+    unsigned long long overflow = 0;
+
+    for (size_t q = 0; q < nquanta; q++, in += 5, out += 4) {
+        unsigned long long value = base85_decode_word(in, table, &bad);
+        overflow |= value >> 32;
+        base85_store_word(out, (unsigned int)value);
+    }
+
+    return (bad & 0x80) != 0 || overflow != 0;
+}
+
+/*
+ * Base45 implementation: two bytes are a number below 65536 written as
+ * three digits, least significant first, and a final odd byte is two
+ * digits.  Division by 45 is a multiply by the reciprocal, exact for every
+ * 16-bit value, so the vector kernels can do it in 16-bit lanes.
+ */
+#define BASE45_RECIPROCAL 46604     /* ceil(2^21 / 45) */
+#define BASE45_DIV(n) (((n) * BASE45_RECIPROCAL) >> 21)
+
+KERNEL_INLINE size_t base45_encode_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    char *o = out;
+    size_t i;
+
+    for (i = 0; i + 2 <= len; i += 2, o += 3) {
+        unsigned int n = ((unsigned int)in[i] << 8) | in[i + 1];
+        unsigned int q = BASE45_DIV(n);
+        unsigned int e = BASE45_DIV(q);
+        o[0] = alphabet[n - q * 45];
+        o[1] = alphabet[q - e * 45];
+        o[2] = alphabet[e];
+    }
+
+    if (i < len) {
+        unsigned int q = BASE45_DIV((unsigned int)in[i]);
+        o[0] = alphabet[in[i] - q * 45];
+        o[1] = alphabet[q];
+        o += 2;
+    }
+
+    return (size_t)(o - out);
+}
+
+KERNEL_INLINE int base45_decode_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    unsigned int bad = 0;
+    unsigned int overflow = 0;
+
+    for (size_t q = 0; q < nquanta; q++, in += 3, out += 2) {
+        unsigned int c = table[in[0]], d = table[in[1]], e = table[in[2]];
+        unsigned int n = c + d * 45 + e * 45 * 45;
+        bad |= c | d | e;
+        overflow |= n >> 16;
+        out[0] = (unsigned char)(n >> 8);
+        out[1] = (unsigned char)n;
+    }
+
+    return (bad & 0x80) != 0 || overflow != 0;
+}
+
+/* The two digits of a final odd byte; returns the bytes decoded, or -1 */
+static int base45_decode_partial(const unsigned char *in, size_t len, unsigned char *out) {
+    unsigned int c, d;
+
+    if (len != 2) {
+        return -1;
+    }
+    c = base45_decode_table[in[0]];
+    d = base45_decode_table[in[1]];
+    if (((c | d) & 0x80) != 0 || c + d * 45 > 0xFF) {
+        return -1;
+    }
+    out[0] = (unsigned char)(c + d * 45);
+    return 1;
+}
+
+#ifdef BASENC_X86
+/*
+ * Vector bodies.  Table lookups go through pshufb on 16-byte rows of the
+ * alphabet or decode table, so they work for any alphabet of printable
+ * ASCII characters: four rows map a sextet to its character, and rows
+ * 2..7 of a decode table map a character to its value by high nibble.
+ */
+TARGET("ssse3")
+KERNEL_INLINE __m128i select_ssse3(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_andnot_si128(mask, a), _mm_and_si128(mask, b));
+}
+
+/* Store the low 12 bytes of V */
+TARGET("ssse3")
+KERNEL_INLINE void store12_ssse3(unsigned char *out, __m128i v) {
+    int high = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+    _mm_storel_epi64((__m128i *)out, v);
+    memcpy(out + 8, &high, 4);
+}
+
+/* The first ROWS rows of ALPHABET; indices must be below 16 * ROWS */
+TARGET("ssse3")
+KERNEL_INLINE __m128i lookup_alphabet_rows_ssse3(__m128i index, const char *alphabet, int rows) {
+    __m128i result = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)alphabet), index);
+    for (int row = 1; row < rows; row++) {
+        __m128i in_row = _mm_cmpgt_epi8(index, _mm_set1_epi8((char)(16 * row - 1)));
+        __m128i chars = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(alphabet + 16 * row)), index);
+        result = select_ssse3(in_row, result, chars);
+    }
+    return result;
+}
+
+TARGET("ssse3")
+KERNEL_INLINE __m128i lookup_alphabet_ssse3(__m128i index, const char *alphabet) {
+    return lookup_alphabet_rows_ssse3(index, alphabet, 4);
+}
+
+/* Rows 2..END-1 of TABLE; bytes outside them map to DEC_INVALID */
+TARGET("ssse3")
+KERNEL_INLINE __m128i lookup_table_rows_ssse3(__m128i v, const unsigned char *table, int end) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i lo = _mm_and_si128(v, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+    __m128i result = _mm_set1_epi8((char)DEC_INVALID);
+    for (int row = 2; row < end; row++) {
+        __m128i in_row = _mm_cmpeq_epi8(hi, _mm_set1_epi8((char)row));
+        __m128i values = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(table + 16 * row)), lo);
+        result = select_ssse3(in_row, result, values);
+    }
+    return result;
+}
+
+TARGET("ssse3")
+KERNEL_INLINE __m128i lookup_table_ssse3(__m128i v, const unsigned char *table) {
+    return lookup_table_rows_ssse3(v, table, 8);
+}
+
+TARGET("avx2")
+KERNEL_INLINE __m256i select_avx2(__m256i mask, __m256i a, __m256i b) {
+    return _mm256_or_si256(_mm256_andnot_si256(mask, a), _mm256_and_si256(mask, b));
+}
+
+TARGET("avx2")
+KERNEL_INLINE __m256i load_row_avx2(const void *row) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)row));
+}
+
+TARGET("avx2")
+KERNEL_INLINE __m256i lookup_alphabet_rows_avx2(__m256i index, const char *alphabet, int rows) {
+    __m256i result = _mm256_shuffle_epi8(load_row_avx2(alphabet), index);
+    for (int row = 1; row < rows; row++) {
+        __m256i in_row = _mm256_cmpgt_epi8(index, _mm256_set1_epi8((char)(16 * row - 1)));
+        __m256i chars = _mm256_shuffle_epi8(load_row_avx2(alphabet + 16 * row), index);
+        result = select_avx2(in_row, result, chars);
+    }
+    return result;
+}
+
+TARGET("avx2")
+KERNEL_INLINE __m256i lookup_alphabet_avx2(__m256i index, const char *alphabet) {
+    return lookup_alphabet_rows_avx2(index, alphabet, 4);
+}
+
+TARGET("avx2")
+KERNEL_INLINE __m256i lookup_table_rows_avx2(__m256i v, const unsigned char *table, int end) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    __m256i result = _mm256_set1_epi8((char)DEC_INVALID);
+    for (int row = 2; row < end; row++) {
+        __m256i in_row = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8((char)row));
+        __m256i values = _mm256_shuffle_epi8(load_row_avx2(table + 16 * row), lo);
+        result = select_avx2(in_row, result, values);
+    }
+    return result;
+}
+
+TARGET("avx2")
+KERNEL_INLINE __m256i lookup_table_avx2(__m256i v, const unsigned char *table) {
+    return lookup_table_rows_avx2(v, table, 8);
+}
+
+/*
+ * Base64 splits each 3 byte group into four sextets with a shuffle and two
+ * multiplies, and merges sextets back with multiply-add (the well known
+ * pshufb/pmaddubsw formulation).  Loops stop early enough that no load or
+ * store goes past the caller's buffers; the scalar body finishes the rest.
+ */
+TARGET("ssse3")
+KERNEL_INLINE size_t base64_encode_ssse3_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 12, out += 16) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i)), spread);
+        __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+        _mm_storeu_si128((__m128i *)out, lookup_alphabet_ssse3(_mm_or_si128(t0, t1), alphabet));
+    }
+
+    return i;
+}
+
+TARGET("ssse3")
+KERNEL_INLINE int base64_decode_ssse3_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    __m128i bad = _mm_setzero_si128();
+    size_t q;
+
+    for (q = 0; q + 4 <= nquanta; q += 4, in += 16, out += 12) {
+        __m128i values = lookup_table_ssse3(_mm_loadu_si128((const __m128i *)in), table);
+        bad = _mm_or_si128(bad, values);
+        __m128i merged = _mm_madd_epi16(_mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140)), _mm_set1_epi32(0x00011000));
+        store12_ssse3(out, _mm_shuffle_epi8(merged, pack));
+    }
+
+    return (_mm_movemask_epi8(bad) != 0) | base64_decode_impl(in, nquanta - q, out, table);
+}
+
+TARGET("avx2")
+KERNEL_INLINE size_t base64_encode_avx2_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    const __m256i spread = _mm256_broadcastsi128_si256(_mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    size_t i;
+
+    for (i = 0; i + 28 <= len; i += 24, out += 32) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),
+                                            _mm_loadu_si128((const __m128i *)(in + i + 12)), 1);
+        v = _mm256_shuffle_epi8(v, spread);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+        _mm256_storeu_si256((__m256i *)out, lookup_alphabet_avx2(_mm256_or_si256(t0, t1), alphabet));
+    }
+
+    return i + base64_encode_ssse3_impl(in + i, len - i, out, alphabet);
+}
+
+TARGET("avx2")
+KERNEL_INLINE int base64_decode_avx2_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    const __m256i pack = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    const __m256i join = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    __m256i bad = _mm256_setzero_si256();
+    size_t q;
+
+    for (q = 0; q + 8 <= nquanta; q += 8, in += 32, out += 24) {
+        __m256i values = lookup_table_avx2(_mm256_loadu_si256((const __m256i *)in), table);
+        bad = _mm256_or_si256(bad, values);
+        __m256i merged = _mm256_madd_epi16(_mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140)), _mm256_set1_epi32(0x00011000));
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(merged, pack), join);
+        _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(packed));
+        _mm_storel_epi64((__m128i *)(out + 16), _mm256_extracti128_si256(packed, 1));
+    }
+
+    return (_mm256_movemask_epi8(bad) != 0) | base64_decode_ssse3_impl(in, nquanta - q, out, table);
+}
+
+/* Base16 spreads nibbles with one shift and mask, and merges value pairs with one multiply-add */
+TARGET("ssse3")
+KERNEL_INLINE size_t base16_encode_ssse3_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    const __m128i lut = _mm_loadu_si128((const __m128i *)alphabet);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16, out += 32) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i high = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i low = _mm_shuffle_epi8(lut, _mm_and_si128(v, nibble));
+        _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi8(high, low));
+    }
+
+    return i;
+}
+
+TARGET("ssse3")
+KERNEL_INLINE int base16_decode_ssse3_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    const __m128i merge = _mm_set1_epi16(0x0110);
+    __m128i bad = _mm_setzero_si128();
+    size_t q;
+
+    for (q = 0; q + 16 <= nquanta; q += 16, in += 32, out += 16) {
+        __m128i a = lookup_table_ssse3(_mm_loadu_si128((const __m128i *)in), table);
+        __m128i b = lookup_table_ssse3(_mm_loadu_si128((const __m128i *)(in + 16)), table);
+        bad = _mm_or_si128(bad, _mm_or_si128(a, b));
+        _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(_mm_maddubs_epi16(a, merge), _mm_maddubs_epi16(b, merge)));
+    }
+
+    return (_mm_movemask_epi8(bad) != 0) | base16_decode_impl(in, nquanta - q, out, table);
+}
+
+TARGET("avx2")
+KERNEL_INLINE size_t base16_encode_avx2_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    const __m256i lut = load_row_avx2(alphabet);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32, out += 64) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i high = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i low = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, nibble));
+        __m256i first = _mm256_unpacklo_epi8(high, low);
+        __m256i second = _mm256_unpackhi_epi8(high, low);
+        _mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+
+    return i + base16_encode_ssse3_impl(in + i, len - i, out, alphabet);
+}
+
+TARGET("avx2")
+KERNEL_INLINE int base16_decode_avx2_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    const __m256i merge = _mm256_set1_epi16(0x0110);
+    __m256i bad = _mm256_setzero_si256();
+    size_t q;
+
+    for (q = 0; q + 32 <= nquanta; q += 32, in += 64, out += 32) {
+        __m256i a = lookup_table_avx2(_mm256_loadu_si256((const __m256i *)in), table);
+        __m256i b = lookup_table_avx2(_mm256_loadu_si256((const __m256i *)(in + 32)), table);
+        bad = _mm256_or_si256(bad, _mm256_or_si256(a, b));
+        __m256i packed = _mm256_packus_epi16(_mm256_maddubs_epi16(a, merge), _mm256_maddubs_epi16(b, merge));
+        _mm256_storeu_si256((__m256i *)out, _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+
+    return (_mm256_movemask_epi8(bad) != 0) | base16_decode_ssse3_impl(in, nquanta - q, out, table);
+}
+
+/*
+ * Base45 takes 16 groups per 128-bit lane.  Each group becomes a 16-bit
+ * number, two reciprocal multiplies split it into digits, and shuffles
+ * interleave the digits into groups of three characters.  The last
+ * digits of both halves share one vector, so three alphabet lookups
+ * cover 48 characters.  Decoding gathers the 48 characters into the same
+ * three vectors, merges the top two digits with one multiply-add, and
+ * flags a number above 65535 as a product above the limit or a sum that
+ * carries out of its lane.
+ */
+TARGET("ssse3")
+KERNEL_INLINE void base45_digits_ssse3(__m128i n, __m128i *cd, __m128i *e) {
+    const __m128i reciprocal = _mm_set1_epi16((short)BASE45_RECIPROCAL);
+    const __m128i base = _mm_set1_epi16(45);
+    __m128i q = _mm_srli_epi16(_mm_mulhi_epu16(n, reciprocal), 5);
+
+    *e = _mm_srli_epi16(_mm_mulhi_epu16(q, reciprocal), 5);
+    *cd = _mm_or_si128(_mm_sub_epi16(n, _mm_mullo_epi16(q, base)),
+                       _mm_slli_epi16(_mm_sub_epi16(q, _mm_mullo_epi16(*e, base)), 8));
+}
+
+/* Numbers of eight groups from the first two digits in DE and the last in C; ORs overflow into *WRAP */
+TARGET("ssse3")
+KERNEL_INLINE __m128i base45_number_ssse3(__m128i de, __m128i c, __m128i *wrap) {
+    __m128i t = _mm_maddubs_epi16(de, _mm_set1_epi16(45 << 8 | 1));
+    __m128i m = _mm_mullo_epi16(t, _mm_set1_epi16(45));
+    __m128i n = _mm_add_epi16(m, c);
+
+    *wrap = _mm_or_si128(*wrap, _mm_or_si128(_mm_cmpgt_epi16(t, _mm_set1_epi16(0xFFFF / 45)),
+                                             _mm_xor_si128(n, _mm_adds_epu16(m, c))));
+    return n;
+}
+
+TARGET("ssse3")
+KERNEL_INLINE size_t base45_encode_ssse3_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const __m128i cd_head = _mm_setr_epi8(0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10);
+    const __m128i cd_tail = _mm_setr_epi8(11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i e_head = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i e_tail = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i e_next = _mm_set1_epi8(8);
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32, out += 48) {
+        __m128i cd0, cd1, e0, e1;
+        base45_digits_ssse3(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i)), swap), &cd0, &e0);
+        base45_digits_ssse3(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(in + i + 16)), swap), &cd1, &e1);
+        cd0 = lookup_alphabet_rows_ssse3(cd0, alphabet, 3);
+        cd1 = lookup_alphabet_rows_ssse3(cd1, alphabet, 3);
+        __m128i ee = lookup_alphabet_rows_ssse3(_mm_packus_epi16(e0, e1), alphabet, 3);
+        _mm_storeu_si128((__m128i *)out, _mm_or_si128(_mm_shuffle_epi8(cd0, cd_head), _mm_shuffle_epi8(ee, e_head)));
+        _mm_storel_epi64((__m128i *)(out + 16), _mm_or_si128(_mm_shuffle_epi8(cd0, cd_tail), _mm_shuffle_epi8(ee, e_tail)));
+        _mm_storeu_si128((__m128i *)(out + 24), _mm_or_si128(_mm_shuffle_epi8(cd1, cd_head),
+                                                             _mm_shuffle_epi8(ee, _mm_or_si128(e_head, e_next))));
+        _mm_storel_epi64((__m128i *)(out + 40), _mm_or_si128(_mm_shuffle_epi8(cd1, cd_tail),
+                                                             _mm_shuffle_epi8(ee, _mm_or_si128(e_tail, e_next))));
+    }
+
+    return i;
+}
+
+TARGET("ssse3")
+KERNEL_INLINE int base45_decode_ssse3_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    const __m128i de_head = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11, 13, 14, -1, -1, -1, -1, -1, -1);
+    const __m128i de_tail = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 3, 4, 6, 7);
+    const __m128i c_head = _mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, 15, -1, -1, -1, -1, -1);
+    const __m128i c_tail = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, -1, 5, -1);
+    const __m128i tail_next = _mm_set1_epi8(8);
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    __m128i bad = _mm_setzero_si128();
+    __m128i wrap = _mm_setzero_si128();
+    size_t q;
+
+    for (q = 0; q + 16 <= nquanta; q += 16, in += 48, out += 32) {
+        __m128i head0 = lookup_table_rows_ssse3(_mm_loadu_si128((const __m128i *)in), table, 6);
+        __m128i head1 = lookup_table_rows_ssse3(_mm_loadu_si128((const __m128i *)(in + 24)), table, 6);
+        __m128i tails = lookup_table_rows_ssse3(_mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(in + 16)),
+                                                                   _mm_loadl_epi64((const __m128i *)(in + 40))), table, 6);
+        bad = _mm_or_si128(bad, _mm_or_si128(_mm_or_si128(head0, head1), tails));
+        __m128i n0 = base45_number_ssse3(_mm_or_si128(_mm_shuffle_epi8(head0, de_head), _mm_shuffle_epi8(tails, de_tail)),
+                                         _mm_or_si128(_mm_shuffle_epi8(head0, c_head), _mm_shuffle_epi8(tails, c_tail)), &wrap);
+        __m128i n1 = base45_number_ssse3(_mm_or_si128(_mm_shuffle_epi8(head1, de_head),
+                                                      _mm_shuffle_epi8(tails, _mm_or_si128(de_tail, tail_next))),
+                                         _mm_or_si128(_mm_shuffle_epi8(head1, c_head),
+                                                      _mm_shuffle_epi8(tails, _mm_or_si128(c_tail, tail_next))), &wrap);
+        _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(n0, swap));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_shuffle_epi8(n1, swap));
+    }
+
+    return (_mm_movemask_epi8(bad) != 0) | (_mm_movemask_epi8(_mm_cmpeq_epi8(wrap, _mm_setzero_si128())) != 0xFFFF) |
+           base45_decode_impl(in, nquanta - q, out, table);
+}
+
+TARGET("avx2")
+KERNEL_INLINE void base45_digits_avx2(__m256i n, __m256i *cd, __m256i *e) {
+    const __m256i reciprocal = _mm256_set1_epi16((short)BASE45_RECIPROCAL);
+    const __m256i base = _mm256_set1_epi16(45);
+    __m256i q = _mm256_srli_epi16(_mm256_mulhi_epu16(n, reciprocal), 5);
+
+    *e = _mm256_srli_epi16(_mm256_mulhi_epu16(q, reciprocal), 5);
+    *cd = _mm256_or_si256(_mm256_sub_epi16(n, _mm256_mullo_epi16(q, base)),
+                          _mm256_slli_epi16(_mm256_sub_epi16(q, _mm256_mullo_epi16(*e, base)), 8));
+}
+
+TARGET("avx2")
+KERNEL_INLINE __m256i base45_number_avx2(__m256i de, __m256i c, __m256i *wrap) {
+    __m256i t = _mm256_maddubs_epi16(de, _mm256_set1_epi16(45 << 8 | 1));
+    __m256i m = _mm256_mullo_epi16(t, _mm256_set1_epi16(45));
+    __m256i n = _mm256_add_epi16(m, c);
+
+    *wrap = _mm256_or_si256(*wrap, _mm256_or_si256(_mm256_cmpgt_epi16(t, _mm256_set1_epi16(0xFFFF / 45)),
+                                                   _mm256_xor_si256(n, _mm256_adds_epu16(m, c))));
+    return n;
+}
+
+/* Store 16 encoded groups: per lane, 16 characters of HEAD and 8 of TAIL */
+TARGET("avx2")
+KERNEL_INLINE void base45_store_avx2(char *out, __m256i head, __m256i tail) {
+    _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(head));
+    _mm_storel_epi64((__m128i *)(out + 16), _mm256_castsi256_si128(tail));
+    _mm_storeu_si128((__m128i *)(out + 24), _mm256_extracti128_si256(head, 1));
+    _mm_storel_epi64((__m128i *)(out + 40), _mm256_extracti128_si256(tail, 1));
+}
+
+TARGET("avx2")
+KERNEL_INLINE size_t base45_encode_avx2_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    const __m256i swap = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+    const __m256i cd_head = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10));
+    const __m256i cd_tail = _mm256_broadcastsi128_si256(_mm_setr_epi8(11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+    const __m256i e_head = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1));
+    const __m256i e_tail = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1));
+    const __m256i e_next = _mm256_set1_epi8(8);
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 64, out += 96) {
+        __m256i cd0, cd1, e0, e1;
+        base45_digits_avx2(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in + i)), swap), &cd0, &e0);
+        base45_digits_avx2(_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(in + i + 32)), swap), &cd1, &e1);
+        cd0 = lookup_alphabet_rows_avx2(cd0, alphabet, 3);
+        cd1 = lookup_alphabet_rows_avx2(cd1, alphabet, 3);
+        __m256i ee = lookup_alphabet_rows_avx2(_mm256_packus_epi16(e0, e1), alphabet, 3);
+        base45_store_avx2(out, _mm256_or_si256(_mm256_shuffle_epi8(cd0, cd_head), _mm256_shuffle_epi8(ee, e_head)),
+                          _mm256_or_si256(_mm256_shuffle_epi8(cd0, cd_tail), _mm256_shuffle_epi8(ee, e_tail)));
+        base45_store_avx2(out + 48,
+                          _mm256_or_si256(_mm256_shuffle_epi8(cd1, cd_head), _mm256_shuffle_epi8(ee, _mm256_or_si256(e_head, e_next))),
+                          _mm256_or_si256(_mm256_shuffle_epi8(cd1, cd_tail), _mm256_shuffle_epi8(ee, _mm256_or_si256(e_tail, e_next))));
+    }
+
+    return i + base45_encode_ssse3_impl(in + i, len - i, out, alphabet);
+}
+
+/* Two 16-character runs, one per lane */
+TARGET("avx2")
+KERNEL_INLINE __m256i base45_load2_avx2(const unsigned char *lo, const unsigned char *hi) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)lo)),
+                                   _mm_loadu_si128((const __m128i *)hi), 1);
+}
+
+TARGET("avx2")
+KERNEL_INLINE int base45_decode_avx2_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    const __m256i de_head = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11, 13, 14, -1, -1, -1, -1, -1, -1));
+    const __m256i de_tail = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 3, 4, 6, 7));
+    const __m256i c_head = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, 15, -1, -1, -1, -1, -1));
+    const __m256i c_tail = _mm256_broadcastsi128_si256(_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, -1, 5, -1));
+    const __m256i tail_next = _mm256_set1_epi8(8);
+    const __m256i swap = _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+    __m256i bad = _mm256_setzero_si256();
+    __m256i wrap = _mm256_setzero_si256();
+    size_t q;
+
+    for (q = 0; q + 32 <= nquanta; q += 32, in += 96, out += 64) {
+        __m128i tails_lo = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(in + 16)), _mm_loadl_epi64((const __m128i *)(in + 64)));
+        __m128i tails_hi = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(in + 40)), _mm_loadl_epi64((const __m128i *)(in + 88)));
+        __m256i head0 = lookup_table_rows_avx2(base45_load2_avx2(in, in + 24), table, 6);
+        __m256i head1 = lookup_table_rows_avx2(base45_load2_avx2(in + 48, in + 72), table, 6);
+        __m256i tails = lookup_table_rows_avx2(_mm256_inserti128_si256(_mm256_castsi128_si256(tails_lo), tails_hi, 1), table, 6);
+        bad = _mm256_or_si256(bad, _mm256_or_si256(_mm256_or_si256(head0, head1), tails));
+        __m256i n0 = base45_number_avx2(_mm256_or_si256(_mm256_shuffle_epi8(head0, de_head), _mm256_shuffle_epi8(tails, de_tail)),
+                                        _mm256_or_si256(_mm256_shuffle_epi8(head0, c_head), _mm256_shuffle_epi8(tails, c_tail)), &wrap);
+        __m256i n1 = base45_number_avx2(_mm256_or_si256(_mm256_shuffle_epi8(head1, de_head),
+                                                        _mm256_shuffle_epi8(tails, _mm256_or_si256(de_tail, tail_next))),
+                                        _mm256_or_si256(_mm256_shuffle_epi8(head1, c_head),
+                                                        _mm256_shuffle_epi8(tails, _mm256_or_si256(c_tail, tail_next))), &wrap);
+        _mm256_storeu_si256((__m256i *)out, _mm256_shuffle_epi8(n0, swap));
+        _mm256_storeu_si256((__m256i *)(out + 32), _mm256_shuffle_epi8(n1, swap));
+    }
+
+    return (_mm256_movemask_epi8(bad) != 0) | !_mm256_testz_si256(wrap, wrap) |
+           base45_decode_ssse3_impl(in, nquanta - q, out, table);
+}
+
+#ifdef BASENC_X86_64
+/*
+ * AVX-512 VBMI: vpermb looks up a whole 64-character alphabet, and vpermt2b
+ * the ASCII half of a decode table, in one instruction each.
+ */
+#define BASE64_SPREAD(p) (3 * ((p) / 4) + ((p) % 4 == 1 ? 0 : (p) % 4 == 2 ? 2 : 1))
+#define BASE64_PACK(p) ((p) < 48 ? 4 * ((p) / 3) + 2 - (p) % 3 : 0)
+
+static const unsigned char base64_spread_avx512[64] = { TABLE_64(BASE64_SPREAD) };
+static const unsigned char base64_pack_avx512[64] = { TABLE_64(BASE64_PACK) };
+
+TARGET("avx512f,avx512bw,avx512vbmi")
+KERNEL_INLINE size_t base64_encode_avx512_impl(const unsigned char *in, size_t len, char *out, const char *alphabet) {
+    const __m512i spread = _mm512_loadu_si512((const void *)base64_spread_avx512);
+    const __m512i lut = _mm512_loadu_si512((const void *)alphabet);
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 48, out += 64) {
+        __m512i v = _mm512_permutexvar_epi8(spread, _mm512_loadu_si512((const void *)(in + i)));
+        __m512i t0 = _mm512_mulhi_epu16(_mm512_and_si512(v, _mm512_set1_epi32(0x0FC0FC00)), _mm512_set1_epi32(0x04000040));
+        __m512i t1 = _mm512_mullo_epi16(_mm512_and_si512(v, _mm512_set1_epi32(0x003F03F0)), _mm512_set1_epi32(0x01000010));
+        _mm512_storeu_si512((void *)out, _mm512_permutexvar_epi8(_mm512_or_si512(t0, t1), lut));
+    }
+
+    return i + base64_encode_avx2_impl(in + i, len - i, out, alphabet);
+}
+
+TARGET("avx512f,avx512bw,avx512vbmi")
+KERNEL_INLINE int base64_decode_avx512_impl(const unsigned char *in, size_t nquanta, unsigned char *out, const unsigned char *table) {
+    const __m512i pack = _mm512_loadu_si512((const void *)base64_pack_avx512);
+    const __m512i lo = _mm512_loadu_si512((const void *)table);
+    const __m512i hi = _mm512_loadu_si512((const void *)(table + 64));
+    __m512i bad = _mm512_setzero_si512();
+    size_t q;
+
+    for (q = 0; q + 16 <= nquanta; q += 16, in += 64, out += 48) {
+        __m512i v = _mm512_loadu_si512((const void *)in);
+        __m512i values = _mm512_permutex2var_epi8(lo, v, hi);
+        /* Non-ASCII input has its own top bit set */
+        bad = _mm512_or_si512(bad, _mm512_or_si512(values, v));
+        __m512i merged = _mm512_madd_epi16(_mm512_maddubs_epi16(values, _mm512_set1_epi32(0x01400140)), _mm512_set1_epi32(0x00011000));
+        _mm512_mask_storeu_epi8(out, (__mmask64)0xFFFFFFFFFFFFULL, _mm512_permutexvar_epi8(pack, merged));
+    }
+
+    return (_mm512_movepi8_mask(bad) != 0) | base64_decode_avx2_impl(in, nquanta - q, out, table);
+}
+#endif
+#endif
+
+/* Kernel instantiation, see the comment at the top of this section */
+#define DEFINE_SCALAR_KERNELS(name, codec, alphabet, table) \
+    static size_t name##_encode_scalar(const unsigned char *in, size_t len, char *out) { \
+        return codec##_encode_impl(in, len, out, alphabet); \
+    } \
+    static int name##_decode_scalar(const unsigned char *in, size_t nquanta, unsigned char *out) { \
+        return codec##_decode_impl(in, nquanta, out, table); \
+    }
+
+#ifdef BASENC_X86
+#define DEFINE_VECTOR_KERNELS(name, codec, isa, target, alphabet, table) \
+    TARGET(target) \
+    static size_t name##_encode_##isa(const unsigned char *in, size_t len, char *out) { \
+        size_t done = codec##_encode_##isa##_impl(in, len, out, alphabet); \
+        return codec##_encode_impl(in + done, len - done, out + codec##_encoded_length(done), alphabet) + \
+               codec##_encoded_length(done); \
+    } \
+    TARGET(target) \
+    static int name##_decode_##isa(const unsigned char *in, size_t nquanta, unsigned char *out) { \
+        return codec##_decode_##isa##_impl(in, nquanta, out, table); \
+    }
+#define VECTOR_KERNEL(f) f
+#else
+#define DEFINE_VECTOR_KERNELS(name, codec, isa, target, alphabet, table)
+#define VECTOR_KERNEL(f) NULL
+#endif
+
+#ifdef BASENC_X86_64
+#define DEFINE_AVX512_KERNELS(name, codec, alphabet, table) \
+    DEFINE_VECTOR_KERNELS(name, codec, avx512, "avx512f,avx512bw,avx512vbmi", alphabet, table)
+#define AVX512_KERNEL(f) f
+#else
+#define DEFINE_AVX512_KERNELS(name, codec, alphabet, table)
+#define AVX512_KERNEL(f) NULL
+#endif
+
+/* Characters produced by the vector part of an encoder, which only consumes whole quanta */
+#define base64_encoded_length(n) ((n) / 3 * 4)
+#define base16_encoded_length(n) ((n) * 2)
+#define base45_encoded_length(n) ((n) / 2 * 3)
+
+DEFINE_SCALAR_KERNELS(base64, base64, base64_chars, base64_decode_table)
+DEFINE_VECTOR_KERNELS(base64, base64, ssse3, "ssse3", base64_chars, base64_decode_table)
+DEFINE_VECTOR_KERNELS(base64, base64, avx2, "avx2", base64_chars, base64_decode_table)
+DEFINE_AVX512_KERNELS(base64, base64, base64_chars, base64_decode_table)
+
+DEFINE_SCALAR_KERNELS(base64url, base64, base64url_chars, base64url_decode_table)
+DEFINE_VECTOR_KERNELS(base64url, base64, ssse3, "ssse3", base64url_chars, base64url_decode_table)
+DEFINE_VECTOR_KERNELS(base64url, base64, avx2, "avx2", base64url_chars, base64url_decode_table)
+DEFINE_AVX512_KERNELS(base64url, base64, base64url_chars, base64url_decode_table)
+
+DEFINE_SCALAR_KERNELS(uu, base64, uu_chars, uu_decode_table)
+DEFINE_VECTOR_KERNELS(uu, base64, ssse3, "ssse3", uu_chars, uu_decode_table)
+DEFINE_VECTOR_KERNELS(uu, base64, avx2, "avx2", uu_chars, uu_decode_table)
+DEFINE_AVX512_KERNELS(uu, base64, uu_chars, uu_decode_table)
+
+DEFINE_SCALAR_KERNELS(base32, base32, base32_chars, base32_decode_table)
+DEFINE_SCALAR_KERNELS(base32hex, base32, base32hex_chars, base32hex_decode_table)
+
+DEFINE_SCALAR_KERNELS(base16, base16, base16_chars, base16_decode_table)
+DEFINE_VECTOR_KERNELS(base16, base16, ssse3, "ssse3", base16_chars, base16_decode_table)
+DEFINE_VECTOR_KERNELS(base16, base16, avx2, "avx2", base16_chars, base16_decode_table)
+
+DEFINE_SCALAR_KERNELS(custom64, base64, custom_chars, custom_decode_table)
+DEFINE_VECTOR_KERNELS(custom64, base64, ssse3, "ssse3", custom_chars, custom_decode_table)
+DEFINE_VECTOR_KERNELS(custom64, base64, avx2, "avx2", custom_chars, custom_decode_table)
+DEFINE_AVX512_KERNELS(custom64, base64, custom_chars, custom_decode_table)
+DEFINE_SCALAR_KERNELS(custom32, base32, custom_chars, custom_decode_table)
+DEFINE_SCALAR_KERNELS(custom16, base16, custom_chars, custom_decode_table)
+DEFINE_VECTOR_KERNELS(custom16, base16, ssse3, "ssse3", custom_chars, custom_decode_table)
+DEFINE_VECTOR_KERNELS(custom16, base16, avx2, "avx2", custom_chars, custom_decode_table)
+
+DEFINE_SCALAR_KERNELS(z85, z85, z85_encoding_chars, z85_decode_table)
+
+DEFINE_SCALAR_KERNELS(base45, base45, base45_chars, base45_decode_table)
+DEFINE_VECTOR_KERNELS(base45, base45, ssse3, "ssse3", base45_chars, base45_decode_table)
+DEFINE_VECTOR_KERNELS(base45, base45, avx2, "avx2", base45_chars, base45_decode_table)
+
+/* Base2 has one alphabet and two bit orders */
+static size_t base2msbf_encode_scalar(const unsigned char *in, size_t len, char *out) {
+    return base2_encode_impl(in, len, out, 1);
+}
+
+static int base2msbf_decode_scalar(const unsigned char *in, size_t nquanta, unsigned char *out) {
+    return base2_decode_impl(in, nquanta, out, base2_decode_table, 1);
+}
+
+static size_t base2lsbf_encode_scalar(const unsigned char *in, size_t len, char *out) {
+    return base2_encode_impl(in, len, out, 0);
+}
+
+static int base2lsbf_decode_scalar(const unsigned char *in, size_t nquanta, unsigned char *out) {
+    return base2_decode_impl(in, nquanta, out, base2_decode_table, 0);
+}
+
+/*
+ * Base58 is not a block code: the whole input is one number, written in
+ * base 58 with leading zero bytes kept as '1's.  The encoder holds the
+ * number in limbs of 58^5, five digits each, and the decoder in 28-bit
+ * limbs; limbs are least significant first, and below 2^30 so that 32
+ * limb products add up in 64 bits.
+ *
+ * Up to BASE58_LEAF symbols are converted by Horner steps of 32 bits or
+ * five digits, each one pass of 64-bit multiply-adds over the limbs.  That
+ * is quadratic, so a longer input is split into its low BASE58_LEAF << K
+ * symbols and the rest, each converted on its own, and joined as
+ * high * B^m + low.  The powers B^m of the input base are squared up once,
+ * and products of long numbers use Karatsuba multiplication.
+ */
+#define BASE58_LIMB 656356768u      /* 58^5 */
+#define BASE58_BINARY (1u << 28)
+#define BASE58_LEAF 1024            /* symbols converted by Horner steps */
+#define BASE58_KARATSUBA 32         /* limbs below which products are schoolbook */
+#define BASE58_POWERS 48
+
+/* Upper bounds of the output and of the limbs for LEN bytes or characters */
+#define BASE58_ENCODED_MAX(len) ((len) / 5 * 7 + 7)
+#define BASE58_DECODED_MAX(len) ((len) + 8)
+#define BASE58_LIMBS_MAX(len) ((len) / 3 + 2)
+
+/* Limbs of temporary space bignum_mul() needs for a product of N limbs */
+#define BIGNUM_MUL_TEMP(n) (8 * (n) + 256)
+
+static unsigned int *bignum_alloc(size_t n) {
+    unsigned int *limbs = (unsigned int *)malloc((n ? n : 1) * sizeof(unsigned int));
+
+    if (!limbs) {
+        exit_with_error("memory allocation failed", NULL);
+    }
+    return limbs;
+}
+
+static size_t bignum_trim(const unsigned int *a, size_t n) {
+    while (n > 0 && a[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+/* LIMBS = LIMBS * FACTOR + ADD in RADIX, where a limb times FACTOR fits 63 bits; returns the new limb count */
+KERNEL_INLINE size_t bignum_mul_add(unsigned int *limbs, size_t n, unsigned long long factor, unsigned long long add,
+                                    unsigned long long radix) {
+    for (size_t l = 0; l < n; l++) {
+        unsigned long long t = limbs[l] * factor + add;
+        limbs[l] = (unsigned int)(t % radix);
+        add = t / radix;
+    }
+    while (add) {
+        limbs[n++] = (unsigned int)(add % radix);
+        add /= radix;
+    }
+    return n;
+}
+
+/* R (RN limbs) += A (AN <= RN limbs); the sum must fit */
+static void bignum_add_to(unsigned int *r, size_t rn, const unsigned int *a, size_t an, unsigned long long radix) {
+    unsigned long long carry = 0;
+    size_t i;
+
+    for (i = 0; i < an; i++) {
+        unsigned long long t = (unsigned long long)r[i] + a[i] + carry;
+        carry = t >= radix;
+        r[i] = (unsigned int)(t - (radix & (0 - carry)));
+    }
+    for (; carry && i < rn; i++) {
+        unsigned long long t = (unsigned long long)r[i] + 1;
+        carry = t == radix;
+        r[i] = (unsigned int)(carry ? 0 : t);
+    }
+}
+
+/* R (RN limbs) -= A (AN <= RN limbs); R must not go below zero */
+static void bignum_sub_from(unsigned int *r, size_t rn, const unsigned int *a, size_t an, unsigned long long radix) {
+    unsigned long long borrow = 0;
+    size_t i;
+
+    for (i = 0; i < an; i++) {
+        // Wraps below zero, leaving the borrow in the top bit
+        unsigned long long t = (unsigned long long)r[i] - a[i] - borrow;
+        borrow = t >> 63;
+        r[i] = (unsigned int)(t + (radix & (0 - borrow)));
+    }
+    for (; borrow && i < rn; i++) {
+        borrow = r[i] == 0;
+        r[i] = (unsigned int)(borrow ? radix - 1 : r[i] - 1u);
+    }
+}
+
+/* Column by column, so one division per limb of R; B has fewer than BASE58_KARATSUBA limbs */
+KERNEL_INLINE void bignum_mul_schoolbook(unsigned int *r, const unsigned int *a, size_t an, const unsigned int *b,
+                                         size_t bn, unsigned long long radix) {
+    unsigned long long carry = 0;
+
+    if (bn == 0) {
+        memset(r, 0, an * sizeof(unsigned int));
+        return;
+    }
+    for (size_t k = 0; k + 1 < an + bn; k++) {
+        size_t lo = k + 1 > bn ? k + 1 - bn : 0;
+        size_t hi = k < an ? k : an - 1;
+        unsigned long long sum = 0;
+        for (size_t i = lo; i <= hi; i++) {
+            sum += (unsigned long long)a[i] * b[k - i];
+        }
+        sum += carry;
+        r[k] = (unsigned int)(sum % radix);
+        carry = sum / radix;
+    }
+    r[an + bn - 1] = (unsigned int)carry;
+}
+
+/* R = A * B in RADIX, AN + BN limbs; TMP holds BIGNUM_MUL_TEMP(AN + BN) limbs */
+static void bignum_mul(unsigned int *r, const unsigned int *a, size_t an, const unsigned int *b, size_t bn,
+                       unsigned long long radix, unsigned int *tmp) {
+    if (an < bn) {
+        const unsigned int *swap = a;
+        size_t swap_n = an;
+        a = b;
+        an = bn;
+        b = swap;
+        bn = swap_n;
+    }
+    if (bn < BASE58_KARATSUBA) {
+        // Constant radixes, so the divisions become multiplications
+        if (radix == BASE58_BINARY) {
+            bignum_mul_schoolbook(r, a, an, b, bn, BASE58_BINARY);
+        } else {
+            bignum_mul_schoolbook(r, a, an, b, bn, BASE58_LIMB);
+        }
+        return;
+    }
+
+    size_t m = (an + 1) / 2;
+    if (bn <= m) {
+        // Too lopsided to split both: the halves of A times B, the high one M limbs up
+        size_t hn = an - m + bn;
+        bignum_mul(r, a, m, b, bn, radix, tmp);
+        memset(r + m + bn, 0, (an - m) * sizeof(unsigned int));
+        bignum_mul(tmp, a + m, an - m, b, bn, radix, tmp + hn);
+        bignum_add_to(r + m, hn, tmp, hn, radix);
+        return;
+    }
+
+    // A = A1 R^m + A0 and B = B1 R^m + B0: A0 B0, A1 B1 and (A0 + A1)(B0 + B1) give the middle term
+    size_t h = m + 1;
+    unsigned int *sa = tmp;
+    unsigned int *sb = tmp + h;
+    unsigned int *z1 = tmp + 2 * h;
+    unsigned int *next = z1 + 2 * h;
+
+    bignum_mul(r, a, m, b, m, radix, next);
+    bignum_mul(r + 2 * m, a + m, an - m, b + m, bn - m, radix, next);
+    memcpy(sa, a, m * sizeof(unsigned int));
+    sa[m] = 0;
+    bignum_add_to(sa, h, a + m, an - m, radix);
+    memcpy(sb, b, m * sizeof(unsigned int));
+    sb[m] = 0;
+    bignum_add_to(sb, h, b + m, bn - m, radix);
+    bignum_mul(z1, sa, h, sb, h, radix, next);
+    bignum_sub_from(z1, 2 * h, r, 2 * m, radix);
+    bignum_sub_from(z1, 2 * h, r + 2 * m, an + bn - 2 * m, radix);
+    bignum_add_to(r + m, an + bn - m, z1, bignum_trim(z1, 2 * h), radix);
+}
+
+/* Limbs of 58^5 for the LEN bytes at IN by Horner steps; returns the limb count */
+static size_t base58_bytes_to_limbs(const unsigned char *in, size_t len, unsigned int *limbs) {
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; ) {
+        // The leading word takes the odd bytes, so the rest are whole 32-bit words
+        size_t k = i == 0 && len % 4 ? len % 4 : 4;
+        unsigned long long word = 0;
+
+        for (size_t j = 0; j < k; j++) {
+            word = (word << 8) | in[i + j];
+        }
+        n = bignum_mul_add(limbs, n, 1ull << (8 * k), word, BASE58_LIMB);
+        i += k;
+    }
+    return n;
+}
+
+/* 28-bit limbs for the LEN base58 digits at IN, all valid, by Horner steps; returns the limb count */
+static size_t base58_digits_to_limbs(const unsigned char *in, size_t len, unsigned int *limbs) {
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; ) {
+        size_t k = i == 0 && len % 5 ? len % 5 : 5;
+        unsigned long long scale = 1;
+        unsigned long long value = 0;
+
+        for (size_t j = 0; j < k; j++) {
+            value = value * 58 + base58_decode_table[in[i + j]];
+            scale *= 58;
+        }
+        n = bignum_mul_add(limbs, n, scale, value, BASE58_BINARY);
+        i += k;
+    }
+    return n;
+}
+
+typedef struct {
+    int decode;                 /* digits to 28-bit limbs, rather than bytes to limbs of 58^5 */
+    unsigned long long radix;
+    unsigned int *power[BASE58_POWERS];     /* input base ^ (BASE58_LEAF << K) */
+    size_t power_len[BASE58_POWERS];
+} base58_split_t;
+
+static size_t base58_leaf(const base58_split_t *c, const unsigned char *in, size_t len, unsigned int *limbs) {
+    return c->decode ? base58_digits_to_limbs(in, len, limbs) : base58_bytes_to_limbs(in, len, limbs);
+}
+
+static const unsigned int *base58_power(base58_split_t *c, int k) {
+    if (!c->power[k]) {
+        if (k == 0) {
+            // One followed by BASE58_LEAF zero symbols
+            unsigned char one[BASE58_LEAF + 1];
+            memset(one, c->decode ? '1' : 0, sizeof(one));
+            one[0] = c->decode ? '2' : 1;
+            c->power[0] = bignum_alloc(BASE58_LIMBS_MAX(sizeof(one)));
+            c->power_len[0] = base58_leaf(c, one, sizeof(one), c->power[0]);
+        } else {
+            const unsigned int *half = base58_power(c, k - 1);
+            size_t n = c->power_len[k - 1];
+            unsigned int *tmp = bignum_alloc(BIGNUM_MUL_TEMP(2 * n));
+            c->power[k] = bignum_alloc(2 * n);
+            bignum_mul(c->power[k], half, n, half, n, c->radix, tmp);
+            c->power_len[k] = bignum_trim(c->power[k], 2 * n);
+            free(tmp);
+        }
+    }
+    return c->power[k];
+}
+
+/* Limbs of the LEN symbols at IN into LIMBS, of BASE58_LIMBS_MAX(LEN); returns the limb count */
+static size_t base58_split_convert(base58_split_t *c, const unsigned char *in, size_t len, unsigned int *limbs) {
+    if (len <= BASE58_LEAF) {
+        return base58_leaf(c, in, len, limbs);
+    }
+
+    int k = 0;
+    while (((size_t)BASE58_LEAF << (k + 1)) < len) {
+        k++;
+    }
+    size_t m = (size_t)BASE58_LEAF << k;
+    const unsigned int *power = base58_power(c, k);
+    size_t pn = c->power_len[k];
+    unsigned int *high = bignum_alloc(BASE58_LIMBS_MAX(len - m));
+    unsigned int *low = bignum_alloc(BASE58_LIMBS_MAX(m));
+    size_t hn = base58_split_convert(c, in, len - m, high);
+    size_t ln = base58_split_convert(c, in + len - m, m, low);
+    size_t n = ln;
+
+    if (hn == 0) {
+        memcpy(limbs, low, ln * sizeof(unsigned int));
+    } else {
+        // LOW is below POWER, so it has no more limbs than the product
+        unsigned int *tmp = bignum_alloc(BIGNUM_MUL_TEMP(hn + pn));
+        bignum_mul(limbs, high, hn, power, pn, c->radix, tmp);
+        n = hn + pn;
+        bignum_add_to(limbs, n, low, ln, c->radix);
+        free(tmp);
+    }
+    free(high);
+    free(low);
+    return bignum_trim(limbs, n);
+}
+
+/* Limbs of the number written by the LEN bytes, or base58 digits, at IN */
+static size_t base58_to_limbs(const unsigned char *in, size_t len, unsigned int *limbs, int decode) {
+    base58_split_t c;
+    size_t n;
+
+    memset(&c, 0, sizeof(c));
+    c.decode = decode;
+    c.radix = decode ? BASE58_BINARY : BASE58_LIMB;
+    n = base58_split_convert(&c, in, len, limbs);
+    for (int k = 0; k < BASE58_POWERS; k++) {
+        free(c.power[k]);
+    }
+    return n;
+}
+
+static size_t base58_encode(const unsigned char *in, size_t len, char *out, unsigned int *limbs) {
+    size_t zeros = 0;
+    size_t nlimbs;
+    size_t o;
+
+    while (zeros < len && in[zeros] == 0) {
+        zeros++;
+    }
+    nlimbs = base58_to_limbs(in + zeros, len - zeros, limbs, 0);
+
+    memset(out, '1', zeros);
+    o = zeros;
+    if (nlimbs > 0) {
+        char top[5];
+        size_t d = 0;
+        for (unsigned int v = limbs[nlimbs - 1]; v; v /= 58) {
+            top[d++] = base58_chars[v % 58];
+        }
+        while (d > 0) {
+            out[o++] = top[--d];
+        }
+        for (size_t l = nlimbs - 1; l-- > 0; o += 5) {
+            unsigned int v = limbs[l];
+            for (int j = 4; j >= 0; j--) {
+                out[o + j] = base58_chars[v % 58];
+                v /= 58;
+            }
+        }
+    }
+    return o;
+}
+
+/* Returns the decoded length, or -1 if IN holds a character outside the alphabet */
+static long long base58_decode(const unsigned char *in, size_t len, unsigned char *out, unsigned int *limbs) {
+    size_t zeros = 0;
+    size_t nlimbs;
+    size_t o;
+
+    for (size_t i = 0; i < len; i++) {
+        if (base58_decode_table[in[i]] == DEC_INVALID) {
+            return -1;
+        }
+    }
+    while (zeros < len && in[zeros] == '1') {
+        zeros++;
+    }
+    nlimbs = base58_to_limbs(in + zeros, len - zeros, limbs, 1);
+
+    memset(out, 0, zeros);
+    o = zeros;
+
+    // Bytes least significant first, then turned around
+    unsigned long long bits = 0;
+    int have = 0;
+    for (size_t l = 0; l < nlimbs; l++) {
+        bits |= (unsigned long long)limbs[l] << have;
+        for (have += 28; have >= 8; have -= 8) {
+            out[o++] = (unsigned char)bits;
+            bits >>= 8;
+        }
+    }
+    if (have > 0) {
+        out[o++] = (unsigned char)bits;
+    }
+    while (o > zeros && out[o - 1] == 0) {
+        o--;
+    }
+    for (size_t i = zeros, j = o; i + 1 < j; i++) {
+        unsigned char c = out[i];
+        out[i] = out[--j];
+        out[j] = c;
+    }
+    return (long long)o;
+}
+
+/*
+ * Ascii85 (Adobe/btoa).  Each 4-byte word is five base-85 digits from
+ * '!', except that an all-zero word is the single character 'z'; a final
+ * word of N < 4 bytes is padded with zeros and cut to N + 1 digits.
+ * Encoded text is framed as "<~...~>".  Output length depends on the
+ * data, so Ascii85 runs on its own codec rather than the block stream.
+ *
+ * The decoder accepts an optional "<~" before the data, skips whitespace
+ * anywhere, and stops at "~>" (or end of input); whatever follows "~>" is
+ * ignored, as it is in PDF and PostScript streams.
+ */
+enum { A85_START, A85_LT, A85_BODY, A85_TILDE, A85_END };
+
+typedef struct {
+    int ignore_garbage;
+    int state;                  /* decoding position in the framing, A85_* */
+    unsigned char group[5];     /* bytes (encoding) or digits (decoding) of an unfinished word */
+    size_t group_len;
+    zero_words_fn zero_words;
+    const char *kernel;
+    const char *error;
+} ascii85_t;
+
+/* Upper bounds of the output for LEN bytes or characters */
+#define ASCII85_ENCODED_MAX(len) ((len) / 4 * 5 + 5)
+#define ASCII85_DECODED_MAX(len) ((len) * 4 + 4)
+
+static void ascii85_init(ascii85_t *a, int ignore_garbage) {
+    isa_t used;
+
+    a->ignore_garbage = ignore_garbage;
+    a->state = A85_START;
+    a->group_len = 0;
+    a->zero_words = select_zero_words(detect_isa(), &used);
+    a->kernel = isa_name(used);
+    a->error = NULL;
+}
+
+static void ascii85_reset(ascii85_t *a) {
+    a->state = A85_START;
+    a->group_len = 0;
+    a->error = NULL;
+}
+
+static char *ascii85_put_word(char *out, unsigned int value) {
+    if (value == 0) {
+        *out = 'z';
+        return out + 1;
+    }
+    base85_encode_word(value, out, ascii85_chars);
+    return out + 5;
+}
+
+/* Encode LEN bytes, carrying a partial word unless FINISH; returns the characters written */
+static size_t ascii85_encode(ascii85_t *a, const unsigned char *in, size_t len, char *out, int finish) {
+    char *o = out;
+
+    if (a->group_len > 0) {
+        while (a->group_len < 4 && len > 0) {
+            a->group[a->group_len++] = *in++;
+            len--;
+        }
+        if (a->group_len == 4) {
+            o = ascii85_put_word(o, base85_load_word(a->group));
+            a->group_len = 0;
+        }
+    }
+
+    // Zero words are found eight at a time; runs of them are common in PDF and PostScript data
+    for (; len >= 32; in += 32, len -= 32) {
+        unsigned int zero = a->zero_words(in);
+        if (zero == 0xFF) {
+            memcpy(o, "zzzzzzzz", 8);
+            o += 8;
+            continue;
+        }
+        for (int k = 0; k < 8; k++) {
+            if (zero & (1u << k)) {
+                *o++ = 'z';
+            } else {
+                base85_encode_word(base85_load_word(in + 4 * k), o, ascii85_chars);
+                o += 5;
+            }
+        }
+    }
+    for (; len >= 4; in += 4, len -= 4) {
+        o = ascii85_put_word(o, base85_load_word(in));
+    }
+    if (len > 0) {
+        memcpy(a->group + a->group_len, in, len);
+        a->group_len += len;
+    }
+
+    if (finish && a->group_len > 0) {
+        char digits[5];
+        memset(a->group + a->group_len, 0, 4 - a->group_len);
+        base85_encode_word(base85_load_word(a->group), digits, ascii85_chars);
+        memcpy(o, digits, a->group_len + 1);
+        o += a->group_len + 1;
+        a->group_len = 0;
+    }
+    return (size_t)(o - out);
+}
+
+/* Decode the digits of an unfinished word at the end of the data; 0 or -1 */
+static int ascii85_flush(ascii85_t *a, unsigned char **out) {
+    size_t n = a->group_len;
+    unsigned int bad = 0;
+    unsigned char word[4];
+    unsigned long long value;
+
+    if (n == 0) {
+        return 0;
+    }
+    if (n == 1) {
+        a->error = "invalid input";
+        return -1;
+    }
+    memset(a->group + n, 'u', 5 - n);
+    value = base85_decode_word(a->group, ascii85_decode_table, &bad);
+    if (value >> 32) {
+        a->error = "invalid input";
+        return -1;
+    }
+    base85_store_word(word, (unsigned int)value);
+    memcpy(*out, word, n - 1);
+    *out += n - 1;
+    a->group_len = 0;
+    return 0;
+}
+
+/* Add one digit or 'z' in the body; 0 or -1 */
+static int ascii85_digit(ascii85_t *a, unsigned char c, unsigned char **out) {
+    if (c == 'z') {
+        if (a->group_len != 0) {
+            a->error = "invalid input";
+            return -1;
+        }
+        memset(*out, 0, 4);
+        *out += 4;
+        return 0;
+    }
+    a->group[a->group_len++] = c;
+    if (a->group_len == 5) {
+        unsigned int bad = 0;
+        unsigned long long value = base85_decode_word(a->group, ascii85_decode_table, &bad);
+        if (value >> 32) {
+            a->error = "invalid input";
+            return -1;
+        }
+        base85_store_word(*out, (unsigned int)value);
+        *out += 4;
+        a->group_len = 0;
+    }
+    return 0;
+}
+
+#define ASCII85_SPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t' || (c) == '\f' || (c) == '\v')
+
+/*
+ * Decode LEN characters; returns the bytes written.  On invalid input
+ * a->error is set and the bytes before it are returned.
+ */
+static size_t ascii85_decode(ascii85_t *a, const unsigned char *in, size_t len, unsigned char *out, int finish) {
+    unsigned char *o = out;
+
+    for (size_t i = 0; i < len && !a->error && a->state != A85_END; ) {
+        unsigned char c = in[i];
+
+        // Whole words between separators, the bulk of the input
+        if (a->state == A85_BODY && a->group_len == 0) {
+            if (c == 'z') {
+                memset(o, 0, 4);
+                o += 4;
+                i++;
+                continue;
+            }
+            if (i + 5 <= len) {
+                unsigned int bad = 0;
+                unsigned long long value = base85_decode_word(in + i, ascii85_decode_table, &bad);
+                if (!(bad & 0x80) && value >> 32 == 0) {
+                    base85_store_word(o, (unsigned int)value);
+                    o += 4;
+                    i += 5;
+                    continue;
+                }
+            }
+        }
+
+        i++;
+        switch (a->state) {
+            case A85_TILDE:
+                if (c != '>') {
+                    a->error = "invalid input";
+                } else if (ascii85_flush(a, &o) == 0) {
+                    a->state = A85_END;
+                }
+                continue;
+            case A85_START:
+                if (ASCII85_SPACE(c)) {
+                    continue;
+                }
+                if (c == '<') {
+                    a->state = A85_LT;
+                    continue;
+                }
+                a->state = A85_BODY;
+                break;
+            case A85_LT:
+                a->state = A85_BODY;
+                if (c == '~') {
+                    continue;
+                }
+                // The '<' was a digit after all
+                if (ascii85_digit(a, '<', &o) != 0) {
+                    continue;
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (ascii85_decode_table[c] != DEC_INVALID || c == 'z') {
+            ascii85_digit(a, c, &o);
+        } else if (c == '~') {
+            a->state = A85_TILDE;
+        } else if (!ASCII85_SPACE(c) && !a->ignore_garbage) {
+            a->error = "invalid input";
+        }
+    }
+
+    if (finish && !a->error && a->state != A85_END) {
+        if (a->state == A85_TILDE) {
+            a->error = "invalid input";
+        } else if (a->state == A85_LT) {
+            ascii85_digit(a, '<', &o);
+        }
+        if (!a->error) {
+            ascii85_flush(a, &o);
+        }
+        a->state = A85_END;
+    }
+    return (size_t)(o - out);
+}
+
+/* Specializations of one encoding indexed by isa_t; NULL where a level has none */
+typedef struct {
+    encode_fn encode[4];
+    decode_fn decode[4];
+} kernel_set_t;
+
+#define KERNEL_SET(name) { \
+    { name##_encode_scalar, VECTOR_KERNEL(name##_encode_ssse3), VECTOR_KERNEL(name##_encode_avx2), \
+      AVX512_KERNEL(name##_encode_avx512) }, \
+    { name##_decode_scalar, VECTOR_KERNEL(name##_decode_ssse3), VECTOR_KERNEL(name##_decode_avx2), \
+      AVX512_KERNEL(name##_decode_avx512) } }
+#define SCALAR_KERNEL_SET(name) { \
+    { name##_encode_scalar, NULL, NULL, NULL }, \
+    { name##_decode_scalar, NULL, NULL, NULL } }
+#define VECTOR_KERNEL_SET(name) { \
+    { name##_encode_scalar, VECTOR_KERNEL(name##_encode_ssse3), VECTOR_KERNEL(name##_encode_avx2), NULL }, \
+    { name##_decode_scalar, VECTOR_KERNEL(name##_decode_ssse3), VECTOR_KERNEL(name##_decode_avx2), NULL } }
+
+static const kernel_set_t *kernel_set(encoding_type_t encoding_type) {
+    static const kernel_set_t base64_kernels = KERNEL_SET(base64);
+    static const kernel_set_t base64url_kernels = KERNEL_SET(base64url);
+    static const kernel_set_t base32_kernels = SCALAR_KERNEL_SET(base32);
+    static const kernel_set_t base32hex_kernels = SCALAR_KERNEL_SET(base32hex);
+    static const kernel_set_t base16_kernels = VECTOR_KERNEL_SET(base16);
+    static const kernel_set_t base2msbf_kernels = SCALAR_KERNEL_SET(base2msbf);
+    static const kernel_set_t base2lsbf_kernels = SCALAR_KERNEL_SET(base2lsbf);
+    static const kernel_set_t z85_kernels = SCALAR_KERNEL_SET(z85);
+    static const kernel_set_t uu_kernels = KERNEL_SET(uu);
+    static const kernel_set_t base45_kernels = VECTOR_KERNEL_SET(base45);
+    static const kernel_set_t custom64_kernels = KERNEL_SET(custom64);
+    static const kernel_set_t custom32_kernels = SCALAR_KERNEL_SET(custom32);
+    static const kernel_set_t custom16_kernels = VECTOR_KERNEL_SET(custom16);
+
+    if (encoding_type == custom_encoding) {
+        switch (encoding_type) {
+            case ENC_BASE64:
+            case ENC_BASE64URL: return &custom64_kernels;
+            case ENC_BASE32:
+            case ENC_BASE32HEX: return &custom32_kernels;
+            default:            return &custom16_kernels;
+        }
+    }
+
+    switch (encoding_type) {
+        case ENC_BASE64:    return &base64_kernels;
+        case ENC_BASE64URL: return &base64url_kernels;
+        case ENC_BASE32:    return &base32_kernels;
+        case ENC_BASE32HEX: return &base32hex_kernels;
+        case ENC_BASE16:    return &base16_kernels;
+        case ENC_BASE2MSBF: return &base2msbf_kernels;
+        case ENC_BASE2LSBF: return &base2lsbf_kernels;
+        case ENC_Z85:       return &z85_kernels;
+        case ENC_UUENCODE:  return &uu_kernels;
+        case ENC_BASE45:    return &base45_kernels;
+        default:            return NULL;
+    }
+}
+
+/* Kernel under custom_pad_encode() */
+static encode_fn custom_pad_kernel;
+
+/* The kernels pad a final partial quantum with '='; rewrite that to custom_pad, or drop it */
+static size_t custom_pad_encode(const unsigned char *in, size_t len, char *out) {
+    int base64 = custom_encoding == ENC_BASE64 || custom_encoding == ENC_BASE64URL;
+    size_t quantum_bytes = base64 ? 3 : 5;
+    size_t quantum_chars = base64 ? 4 : 8;
+    size_t bits = base64 ? 6 : 5;
+    size_t n = custom_pad_kernel(in, len, out);
+    size_t rest = len % quantum_bytes;
+
+    if (rest > 0) {
+        size_t pad = quantum_chars - (rest * 8 + bits - 1) / bits;
+        if (custom_pad < 0) {
+            n -= pad;
+        } else {
+            memset(out + n - pad, custom_pad, pad);
+        }
+    }
+    return n;
+}
+
+/* Best encoder of ENCODING_TYPE at or below ISA; *USED gets its level */
+static encode_fn select_encoder(encoding_type_t encoding_type, isa_t isa, isa_t *used) {
+    const kernel_set_t *set = kernel_set(encoding_type);
+    int level = (int)isa;
+
+    while (level > ISA_SCALAR && set->encode[level] == NULL) {
+        level--;
+    }
+    *used = (isa_t)level;
+    if (encoding_type == custom_encoding && custom_pad != '=') {
+        custom_pad_kernel = set->encode[level];
+        return custom_pad_encode;
+    }
+    return set->encode[level];
+}
+
+static decode_fn select_decoder(encoding_type_t encoding_type, isa_t isa, isa_t *used) {
+    const kernel_set_t *set = kernel_set(encoding_type);
+    int level = (int)isa;
+
+    while (level > ISA_SCALAR && set->decode[level] == NULL) {
+        level--;
+    }
+    *used = (isa_t)level;
+    return set->decode[level];
+}
+
+/* Per-encoding decoder description */
+typedef struct {
+    size_t quantum_chars;       /* characters per complete quantum */
+    size_t quantum_bytes;       /* bytes decoded from a complete quantum */
+    int bits_per_char;          /* nonzero if padded partial quanta are allowed */
+    unsigned char zero_char;    /* alphabet character with value 0 */
+    const unsigned char *table;
+    const char *length_error;   /* message when input ends inside a quantum */
+    int pad_char;               /* padding of a partial quantum, -1 if it is left unpadded */
+    /* Decodes the unpadded final group of a code that is not bit-based, NULL for none */
+    int (*partial)(const unsigned char *in, size_t len, unsigned char *out);
+} decoder_ops_t;
+
+static const decoder_ops_t *builtin_decoder_ops(encoding_type_t encoding_type) {
+    static const decoder_ops_t base64_ops = {
+        4, 3, 6, 'A', base64_decode_table, "invalid input", '=', NULL };
+    static const decoder_ops_t base64url_ops = {
+        4, 3, 6, 'A', base64url_decode_table, "invalid input", '=', NULL };
+    static const decoder_ops_t base32_ops = {
+        8, 5, 5, 'A', base32_decode_table, "invalid input", '=', NULL };
+    static const decoder_ops_t base32hex_ops = {
+        8, 5, 5, '0', base32hex_decode_table, "invalid input", '=', NULL };
+    static const decoder_ops_t base16_ops = {
+        2, 1, 0, '0', base16_decode_table, "invalid input", '=', NULL };
+    static const decoder_ops_t base2msbf_ops = {
+        8, 1, 0, '0', base2_decode_table, "invalid input: number of bits not a multiple of 8", '=', NULL };
+    static const decoder_ops_t base2lsbf_ops = {
+        8, 1, 0, '0', base2_decode_table, "invalid input: number of bits not a multiple of 8", '=', NULL };
+    static const decoder_ops_t z85_ops = {
+        5, 4, 0, '0', z85_decode_table, "invalid input: Z85 decoding input length must be a multiple of 5", '=', NULL };
+    static const decoder_ops_t base45_ops = {
+        3, 2, 0, '0', base45_decode_table, "invalid input", -1, base45_decode_partial };
+
+    switch (encoding_type) {
+        case ENC_BASE64:    return &base64_ops;
+        case ENC_BASE64URL: return &base64url_ops;
+        case ENC_BASE32:    return &base32_ops;
+        case ENC_BASE32HEX: return &base32hex_ops;
+        case ENC_BASE16:    return &base16_ops;
+        case ENC_BASE2MSBF: return &base2msbf_ops;
+        case ENC_BASE2LSBF: return &base2lsbf_ops;
+        case ENC_Z85:       return &z85_ops;
+        case ENC_BASE45:    return &base45_ops;
+        default:            return NULL;
+    }
+}
+
+/* Decoder description of ENCODING_TYPE with any run-time alphabet applied */
+static const decoder_ops_t *decoder_ops(encoding_type_t encoding_type) {
+    static decoder_ops_t custom_ops;
+
+    if (encoding_type == custom_encoding) {
+        custom_ops = *builtin_decoder_ops(encoding_type);
+        custom_ops.zero_char = (unsigned char)custom_chars[0];
+        custom_ops.table = custom_decode_table;
+        custom_ops.pad_char = custom_pad;
+        return &custom_ops;
+    }
+    return builtin_decoder_ops(encoding_type);
+}
+
+/*
+ * Streaming decoder.  Input arrives in arbitrary blocks, so an incomplete
+ * quantum and any pending '=' padding are carried over to the next block.
+ *
+ * Most encoded input is cleanly wrapped: lines of a fixed width ending in
+ * "\n" or "\r\n".  The width is taken from the first line; after that each
+ * line is checked only at the position where its newline should be, and
+ * the body goes straight to the bulk kernel.  A line that breaks the
+ * pattern (different length, padding, garbage, invalid input) goes through
+ * the vector compaction pre-pass and then the bulk kernel; only '=' padding
+ * and invalid bytes reach the per-character general path.
+ */
+typedef struct {
+    const decoder_ops_t *ops;
+    decode_fn bulk;             /* bulk kernel chosen for this run */
+    decode_fn quantum;          /* scalar kernel for single quanta */
+    int ignore_garbage;
+    unsigned char pending[8];   /* characters of an incomplete quantum */
+    size_t pending_len;
+    size_t padding;             /* '=' still expected to finish a quantum */
+    size_t line_width;          /* body width of clean lines, 0 if unknown */
+    int line_crlf;              /* clean lines end in "\r\n" */
+    size_t column;              /* characters since the last newline */
+    int fast;                   /* fast path still enabled */
+    int fast_misses;            /* consecutive lines the fast path rejected */
+    compact_fn compact;
+    compact_class_t cls;
+    const char *kernel;
+    const char *error;
+    unsigned char dense[DEC_DENSE_SIZE + COMPACT_SLACK];
+} decoder_t;
+
+#define DEC_MAX_FAST_MISSES 8
+
+/* "bulk/compaction" when the two differ, e.g. scalar base32 kernels with AVX2 compaction */
+static const char *const decoder_kernel_names[4][4] = {
+    { "scalar", "scalar/ssse3", "scalar/avx2", "scalar/avx512" },
+    { "ssse3/scalar", "ssse3", "ssse3/avx2", "ssse3/avx512" },
+    { "avx2/scalar", "avx2/ssse3", "avx2", "avx2/avx512" },
+    { "avx512/scalar", "avx512/ssse3", "avx512/avx2", "avx512" }
+};
+
+static void decoder_init(decoder_t *dec, encoding_type_t encoding_type, int ignore_garbage) {
+    isa_t isa = detect_isa();
+    isa_t bulk_isa;
+
+    build_compact_tables();
+
+    memset(dec, 0, sizeof(*dec));
+    dec->ops = decoder_ops(encoding_type);
+    dec->bulk = select_decoder(encoding_type, isa, &bulk_isa);
+    dec->quantum = kernel_set(encoding_type)->decode[ISA_SCALAR];
+    dec->ignore_garbage = ignore_garbage;
+    dec->fast = 1;
+    dec->compact = select_compactor(isa);
+    dec->kernel = decoder_kernel_names[bulk_isa][isa];
+    build_compact_class(&dec->cls, dec->ops->table, dec->ops->bits_per_char ? dec->ops->pad_char : -1, ignore_garbage);
+}
+
+/* Forget the input seen so far, keeping the kernels and tables */
+static void decoder_reset(decoder_t *dec) {
+    dec->pending_len = 0;
+    dec->padding = 0;
+    dec->line_width = 0;
+    dec->line_crlf = 0;
+    dec->column = 0;
+    dec->fast = 1;
+    dec->fast_misses = 0;
+    dec->error = NULL;
+}
+
+/* Upper bound of the bytes decoder_run() and decoder_finish() produce for INLEN input characters */
+static unsigned long long decoder_max_output(encoding_type_t encoding_type, unsigned long long inlen) {
+    const decoder_ops_t *ops = decoder_ops(encoding_type);
+    return (inlen / ops->quantum_chars + 2) * ops->quantum_bytes;
+}
+
+/* Emit the bytes of a padded partial quantum */
+static int decoder_flush_partial(decoder_t *dec, unsigned char *out, size_t *outlen) {
+    const decoder_ops_t *ops = dec->ops;
+    size_t bits = dec->pending_len * ops->bits_per_char;
+    unsigned char quantum[8];
+    unsigned char bytes[8];
+
+    if (dec->pending_len == 0 || bits % 8 >= (size_t)ops->bits_per_char) {
+        dec->error = "invalid input";
+        return -1;
+    }
+
+    memcpy(quantum, dec->pending, dec->pending_len);
+    memset(quantum + dec->pending_len, ops->zero_char, ops->quantum_chars - dec->pending_len);
+    dec->quantum(quantum, 1, bytes);
+    memcpy(out + *outlen, bytes, bits / 8);
+    *outlen += bits / 8;
+
+    dec->padding = ops->quantum_chars - dec->pending_len;
+    dec->pending_len = 0;
+    return 0;
+}
+
+/* General path: one character at a time, handles newlines, padding and garbage */
+static int decoder_general(decoder_t *dec, const unsigned char *in, size_t len, unsigned char *out, size_t *outlen) {
+    const decoder_ops_t *ops = dec->ops;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = in[i];
+
+        if (c == '\n' || c == '\r') {
+            continue;
+        }
+
+        if (c == ops->pad_char && ops->bits_per_char) {
+            if (dec->padding == 0 && decoder_flush_partial(dec, out, outlen) != 0) {
+                return -1;
+            }
+            dec->padding--;
+            continue;
+        }
+
+        if (ops->table[c] == DEC_INVALID) {
+            if (dec->ignore_garbage) {
+                continue;
+            }
+            dec->error = "invalid input";
+            return -1;
+        }
+
+        if (dec->padding) {
+            dec->error = "invalid input";
+            return -1;
+        }
+
+        dec->pending[dec->pending_len++] = c;
+        if (dec->pending_len == ops->quantum_chars) {
+            if (dec->quantum(dec->pending, 1, out + *outlen) != 0) {
+                dec->error = "invalid input";
+                return -1;
+            }
+            *outlen += ops->quantum_bytes;
+            dec->pending_len = 0;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Fast path for a run of N characters that should all be in the alphabet.
+ * Nothing is committed unless the whole run is valid, so on failure the
+ * caller can hand the same run to decoder_general().
+ */
+static int decoder_dense(decoder_t *dec, const unsigned char *in, size_t n, unsigned char *out, size_t *outlen) {
+    const decoder_ops_t *ops = dec->ops;
+    size_t q = ops->quantum_chars;
+    size_t o = *outlen;
+    size_t head = 0;
+    int bad = 0;
+    unsigned char quantum[8];
+
+    if (dec->padding) {
+        return -1;
+    }
+
+    if (dec->pending_len) {
+        head = q - dec->pending_len;
+        if (head > n) {
+            head = n;
+        }
+        memcpy(quantum, dec->pending, dec->pending_len);
+        memcpy(quantum + dec->pending_len, in, head);
+        if (dec->pending_len + head == q) {
+            bad |= dec->quantum(quantum, 1, out + o);
+            o += ops->quantum_bytes;
+        } else {
+            for (size_t i = 0; i < head; i++) {
+                bad |= ops->table[in[i]] == DEC_INVALID;
+            }
+        }
+    }
+
+    size_t nquanta = (n - head) / q;
+    bad |= dec->bulk(in + head, nquanta, out + o);
+    o += nquanta * ops->quantum_bytes;
+
+    size_t tail = head + nquanta * q;
+    for (size_t i = tail; i < n; i++) {
+        bad |= ops->table[in[i]] == DEC_INVALID;
+    }
+
+    if (bad) {
+        return -1;
+    }
+
+    if (dec->pending_len + head == q) {
+        dec->pending_len = 0;
+    } else {
+        memcpy(dec->pending + dec->pending_len, in, head);
+        dec->pending_len += head;
+    }
+    memcpy(dec->pending + dec->pending_len, in + tail, n - tail);
+    dec->pending_len += n - tail;
+
+    *outlen = o;
+    return 0;
+}
+
+/*
+ * Irregular input: compact to dense alphabet characters a chunk at a time
+ * and decode those in bulk.  Bytes the compactor stops at go one at a time
+ * through the general path.
+ */
+static int decoder_compact(decoder_t *dec, const unsigned char *in, size_t len, unsigned char *out, size_t *outlen) {
+    size_t p = 0;
+
+    while (p < len) {
+        size_t chunk = len - p;
+        size_t n = 0;
+
+        if (chunk > DEC_DENSE_SIZE) {
+            chunk = DEC_DENSE_SIZE;
+        }
+
+        size_t used = dec->compact(in + p, chunk, dec->dense, &n, &dec->cls);
+        if (n > 0 && decoder_dense(dec, dec->dense, n, out, outlen) != 0 &&
+            decoder_general(dec, in + p, used, out, outlen) != 0) {
+            return -1;
+        }
+        p += used;
+
+        if (used < chunk) {
+            if (decoder_general(dec, in + p, 1, out, outlen) != 0) {
+                return -1;
+            }
+            p++;
+        }
+    }
+
+    return 0;
+}
+
+/* Decode one block of input, appending to OUT; returns -1 with dec->error set on invalid input */
+static int decoder_run(decoder_t *dec, const char *input, size_t len, unsigned char *out, size_t *outlen) {
+    const unsigned char *in = (const unsigned char *)input;
+    size_t p = 0;
+
+    while (p < len) {
+        if (!dec->fast) {
+            return decoder_compact(dec, in + p, len - p, out, outlen);
+        }
+
+        size_t left = len - p;
+        size_t width = dec->line_width;
+        size_t nl = dec->line_crlf ? 2 : 1;
+        size_t body, end;
+        int ends_line;
+
+        if (width && dec->column == 0 && left >= width + nl && in[p + width + nl - 1] == '\n' &&
+            (!dec->line_crlf || in[p + width] == '\r')) {
+            /* Clean line: the newline is exactly where the first line put it */
+            body = width;
+            end = p + width + nl;
+            ends_line = 1;
+        } else {
+            const unsigned char *newline = (const unsigned char *)memchr(in + p, '\n', left);
+            if (newline) {
+                end = (size_t)(newline - in) + 1;
+                body = end - 1 - p;
+                ends_line = 1;
+                int crlf = body > 0 && in[p + body - 1] == '\r';
+                if (crlf) {
+                    body--;
+                }
+                if (dec->line_width == 0 && dec->column == 0 && body > 0) {
+                    dec->line_width = body;
+                    dec->line_crlf = crlf;
+                }
+            } else {
+                end = len;
+                body = left;
+                ends_line = 0;
+            }
+        }
+
+        if (body > 0 && decoder_dense(dec, in + p, body, out, outlen) == 0) {
+            dec->fast_misses = 0;
+        } else {
+            if (body > 0 && dec->ignore_garbage && ++dec->fast_misses >= DEC_MAX_FAST_MISSES) {
+                dec->fast = 0;
+            }
+            if (decoder_compact(dec, in + p, end - p, out, outlen) != 0) {
+                return -1;
+            }
+        }
+
+        dec->column = ends_line ? 0 : dec->column + (end - p);
+        p = end;
+    }
+
+    return 0;
+}
+
+/* Finish decoding at end of input: flush or reject an incomplete quantum */
+static int decoder_finish(decoder_t *dec, unsigned char *out, size_t *outlen) {
+    const decoder_ops_t *ops = dec->ops;
+
+    if (dec->padding) {
+        dec->error = "invalid input";
+        return -1;
+    }
+
+    if (dec->pending_len && ops->partial) {
+        int n = ops->partial(dec->pending, dec->pending_len, out + *outlen);
+        if (n < 0) {
+            dec->error = ops->length_error;
+            return -1;
+        }
+        *outlen += (size_t)n;
+        dec->pending_len = 0;
+        return 0;
+    }
+
+    if (dec->pending_len) {
+        if (ops->bits_per_char && ops->pad_char < 0 && decoder_flush_partial(dec, out, outlen) == 0) {
+            /* Unpadded alphabet: the partial quantum simply ends the input */
+            dec->padding = 0;
+            return 0;
+        }
+        if (ops->bits_per_char && decoder_flush_partial(dec, out, outlen) == 0) {
+            /* Unpadded partial quantum: keep its bytes but report the input as invalid */
+            dec->error = "invalid input";
+        } else {
+            dec->error = ops->length_error;
+        }
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Push/pull stream API.  The caller owns all I/O: basenc_stream_run() takes
+ * a slice of input and a slice of output space, advances both past what it
+ * used, and reports what it needs next.  It never blocks and allocates
+ * nothing; output that does not fit is staged in the stream and handed out
+ * by the following calls, so after EAGAIN on either side the caller simply
+ * calls again with whatever it has.
+ *
+ *   BASENC_NEED_INPUT   the input slice is used up; pass more, or FINISH
+ *                       once the input has ended
+ *   BASENC_NEED_OUTPUT  the output space is full
+ *   BASENC_DONE         FINISH was given and everything has been produced
+ *   BASENC_ERROR        invalid input; output before it is still valid, and
+ *                       basenc_stream_error() tells what went wrong
+ *
+ * The command line tool is built on it.  Compile with -DBASENC_NO_MAIN to
+ * embed the stream in another program.
+ */
+#define STREAM_STAGE_SIZE 4096
+#define STREAM_RAW_SIZE (16 * 1024)
+#define STREAM_CHUNK ENC_BLOCKSIZE      /* input bytes encoded per step */
+
+typedef enum {
+    BASENC_NEED_INPUT,
+    BASENC_NEED_OUTPUT,
+    BASENC_DONE,
+    BASENC_ERROR
+} basenc_status_t;
+
+typedef struct {
+    int decode;
+    encoding_type_t encoding_type;
+    const decoder_ops_t *ops;
+    encode_fn encode;
+    size_t wrap_column;
+    size_t column;              /* characters on the current output line */
+    unsigned char carry[8];     /* input short of a whole quantum */
+    size_t carry_len;
+    int finished;               /* the end of the input has been processed */
+    const char *error;
+    const char *kernel;
+    zero_words_fn zero_words;
+    size_t staged_pos;
+    size_t staged_len;
+    unsigned char staged[STREAM_STAGE_SIZE];
+    char raw[STREAM_RAW_SIZE];  /* encoded characters waiting for line breaks */
+    decoder_t dec;
+} basenc_stream_t;
+
+/* Returns -1 for an unknown encoding */
+int basenc_stream_init(basenc_stream_t *s, encoding_type_t encoding_type, int decode, size_t wrap_column,
+                       int ignore_garbage) {
+    isa_t kernel_isa;
+
+    s->ops = decoder_ops(encoding_type);
+    if (!s->ops) {
+        return -1;
+    }
+    s->decode = decode;
+    s->encoding_type = encoding_type;
+    s->wrap_column = decode ? 0 : wrap_column;
+    s->column = 0;
+    s->carry_len = 0;
+    s->finished = 0;
+    s->error = NULL;
+    s->staged_pos = 0;
+    s->staged_len = 0;
+    if (decode) {
+        decoder_init(&s->dec, encoding_type, ignore_garbage);
+        s->encode = NULL;
+        s->kernel = s->dec.kernel;
+    } else {
+        s->encode = select_encoder(encoding_type, detect_isa(), &kernel_isa);
+        s->kernel = isa_name(kernel_isa);
+        s->zero_words = select_zero_words(detect_isa(), &kernel_isa);
+    }
+    return 0;
+}
+
+/* Start over on a new, independent input with the same settings */
+void basenc_stream_reset(basenc_stream_t *s) {
+    s->column = 0;
+    s->carry_len = 0;
+    s->finished = 0;
+    s->error = NULL;
+    s->staged_pos = 0;
+    s->staged_len = 0;
+    if (s->decode) {
+        decoder_reset(&s->dec);
+    }
+}
+
+const char *basenc_stream_error(const basenc_stream_t *s) {
+    return s->error;
+}
+
+/* Output bytes for encoding N input bytes from the current column */
+static size_t stream_encoded_size(const basenc_stream_t *s, size_t n) {
+    size_t chars = (n + s->ops->quantum_bytes - 1) / s->ops->quantum_bytes * s->ops->quantum_chars;
+
+    return s->wrap_column && chars ? chars + (s->column + chars - 1) / s->wrap_column : chars;
+}
+
+/*
+ * Encode N bytes, whole quanta unless they end the input, into DST with
+ * line breaks.  As in GNU basenc a full line's newline is written before
+ * the next character, so output cut short by an error ends mid-line.
+ */
+static size_t stream_emit_data(basenc_stream_t *s, const unsigned char *in, size_t n, char *dst) {
+    const decoder_ops_t *ops = s->ops;
+    size_t wrap_column = s->wrap_column;
+    size_t pos = 0;
+
+    if (wrap_column == 0) {
+        pos = s->encode(in, n, dst);
+        s->column += pos;
+        return pos;
+    }
+
+    // Lines of whole quanta are encoded in place
+    if (wrap_column % ops->quantum_chars == 0) {
+        while (n > 0) {
+            if (s->column == wrap_column) {
+                dst[pos++] = '\n';
+                s->column = 0;
+            }
+            size_t m = (wrap_column - s->column) / ops->quantum_chars * ops->quantum_bytes;
+            if (m > n) {
+                m = n;
+            }
+            size_t chars = s->encode(in, m, dst + pos);
+            in += m;
+            n -= m;
+            pos += chars;
+            s->column += chars;
+        }
+        return pos;
+    }
+
+    while (n > 0) {
+        size_t m = STREAM_RAW_SIZE / ops->quantum_chars * ops->quantum_bytes;
+        if (m > n) {
+            m = n;
+        }
+        size_t chars = s->encode(in, m, s->raw);
+        in += m;
+        n -= m;
+        for (size_t p = 0; p < chars; ) {
+            if (s->column == wrap_column) {
+                dst[pos++] = '\n';
+                s->column = 0;
+            }
+            size_t k = wrap_column - s->column;
+            if (k > chars - p) {
+                k = chars - p;
+            }
+            memcpy(dst + pos, s->raw + p, k);
+            p += k;
+            pos += k;
+            s->column += k;
+        }
+    }
+    return pos;
+}
+
+/*
+ * Zero runs.  Disk images are mostly zero pages, and a whole quantum of
+ * zero bytes encodes to the alphabet's first character repeated, so input
+ * is tested a segment at a time and zero segments are written with
+ * memset() instead of going through the encoder.
+ */
+#define STREAM_ZERO_SEGMENT 4096
+
+static int stream_all_zero(const basenc_stream_t *s, const unsigned char *in, size_t n) {
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        if (s->zero_words(in + i) != 0xFF) {
+            return 0;
+        }
+    }
+    for (; i < n; i++) {
+        if (in[i] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Write the encoding of N zero bytes, whole quanta, into DST */
+static size_t stream_emit_zeros(basenc_stream_t *s, size_t n, char *dst) {
+    size_t chars = n / s->ops->quantum_bytes * s->ops->quantum_chars;
+    char zero = (char)s->ops->zero_char;
+    size_t wrap_column = s->wrap_column;
+    size_t pos = 0;
+
+    if (wrap_column == 0) {
+        memset(dst, zero, chars);
+        s->column += chars;
+        return chars;
+    }
+
+    // Finish the current line
+    if (s->column < wrap_column) {
+        size_t k = wrap_column - s->column < chars ? wrap_column - s->column : chars;
+        memset(dst, zero, k);
+        pos = k;
+        chars -= k;
+        s->column += k;
+    }
+
+    // Every whole line after it is the same; write one and copy it, doubling the run each time
+    size_t line = wrap_column + 1;
+    size_t total = chars / wrap_column * line;
+    if (total > 0) {
+        char *start = dst + pos;
+        start[0] = '\n';
+        memset(start + 1, zero, wrap_column);
+        for (size_t done = line; done < total; ) {
+            size_t k = done < total - done ? done : total - done;
+            memcpy(start + done, start, k);
+            done += k;
+        }
+        pos += total;
+        chars %= wrap_column;
+    }
+
+    if (chars > 0) {
+        dst[pos++] = '\n';
+        memset(dst + pos, zero, chars);
+        pos += chars;
+        s->column = chars;
+    }
+    return pos;
+}
+
+static size_t stream_emit(basenc_stream_t *s, const unsigned char *in, size_t n, char *dst) {
+    size_t qb = s->ops->quantum_bytes;
+    size_t segment = STREAM_ZERO_SEGMENT / qb * qb;
+    size_t whole = n - n % qb;
+    size_t run = 0;
+    int run_zero = 0;
+    size_t pos = 0;
+
+    // Consecutive segments of the same kind are emitted together
+    for (size_t p = 0; p < whole; ) {
+        size_t m = whole - p < segment ? whole - p : segment;
+        int zero = stream_all_zero(s, in + p, m);
+        if (run > 0 && zero != run_zero) {
+            pos += run_zero ? stream_emit_zeros(s, run, dst + pos) : stream_emit_data(s, in + p - run, run, dst + pos);
+            run = 0;
+        }
+        run_zero = zero;
+        run += m;
+        p += m;
+    }
+    if (run > 0) {
+        pos += run_zero ? stream_emit_zeros(s, run, dst + pos) : stream_emit_data(s, in + whole - run, run, dst + pos);
+    }
+
+    // A partial quantum at the end of the input is padded by the encoder
+    if (n > whole) {
+        pos += stream_emit_data(s, in + whole, n - whole, dst + pos);
+    }
+    return pos;
+}
+
+/* One encoding step; returns 1 if more input is needed */
+static int stream_encode_step(basenc_stream_t *s, const unsigned char **in, size_t *in_len, unsigned char **out,
+                              size_t *out_len, int finish) {
+    size_t qb = s->ops->quantum_bytes;
+
+    if (finish && s->encoding_type == ENC_Z85 && (s->carry_len + *in_len) % qb != 0) {
+        s->error = "invalid input: Z85 encoding input length must be a multiple of 4";
+        return 0;
+    }
+
+    // A quantum split across input slices, or the end of the input
+    if (s->carry_len > 0 || *in_len < qb) {
+        size_t take = qb - s->carry_len < *in_len ? qb - s->carry_len : *in_len;
+        memcpy(s->carry + s->carry_len, *in, take);
+        *in += take;
+        *in_len -= take;
+        s->carry_len += take;
+        if (s->carry_len < qb && !finish) {
+            return 1;
+        }
+        s->staged_pos = 0;
+        if (s->carry_len > 0) {
+            s->staged_len = stream_emit(s, s->carry, s->carry_len, (char *)s->staged);
+            s->carry_len = 0;
+        } else {
+            s->staged_len = 0;
+            if (s->wrap_column > 0 && s->column > 0) {
+                s->staged[s->staged_len++] = '\n';
+                s->column = 0;
+            }
+            s->finished = 1;
+        }
+        return 0;
+    }
+
+    size_t n = *in_len < STREAM_CHUNK ? *in_len : STREAM_CHUNK;
+    if (!finish || n < *in_len) {
+        n -= n % qb;
+    }
+
+    // Every character takes at most two bytes with its line break
+    if (stream_encoded_size(s, n) > *out_len) {
+        size_t fit = *out_len / (2 * s->ops->quantum_chars) * qb;
+        if (fit == 0) {
+            size_t stage = STREAM_STAGE_SIZE / (2 * s->ops->quantum_chars) * qb;
+            if (n > stage) {
+                n = stage;
+            }
+            s->staged_len = stream_emit(s, *in, n, (char *)s->staged);
+            s->staged_pos = 0;
+            *in += n;
+            *in_len -= n;
+            return 0;
+        }
+        n = fit;
+    }
+
+    size_t written = stream_emit(s, *in, n, (char *)*out);
+    *in += n;
+    *in_len -= n;
+    *out += written;
+    *out_len -= written;
+    return 0;
+}
+
+/* One decoding step; returns 1 if more input is needed */
+static int stream_decode_step(basenc_stream_t *s, const unsigned char **in, size_t *in_len, unsigned char **out,
+                              size_t *out_len, int finish) {
+    size_t qb = s->ops->quantum_bytes;
+    size_t room = *out_len / qb;
+    unsigned char *dst = *out;
+    size_t len = 0;
+    int status;
+
+    // decoder_run() needs two quanta of room beyond its input; short of that, decode into the stage
+    if (room < 3) {
+        dst = s->staged;
+        room = STREAM_STAGE_SIZE / qb;
+    }
+
+    if (*in_len == 0) {
+        if (!finish) {
+            return 1;
+        }
+        status = decoder_finish(&s->dec, dst, &len);
+        s->finished = 1;
+    } else {
+        size_t n = (room - 2) * s->ops->quantum_chars;
+        if (n > *in_len) {
+            n = *in_len;
+        }
+        status = decoder_run(&s->dec, (const char *)*in, n, dst, &len);
+        *in += n;
+        *in_len -= n;
+    }
+
+    if (dst == s->staged) {
+        s->staged_pos = 0;
+        s->staged_len = len;
+    } else {
+        *out += len;
+        *out_len -= len;
+    }
+    if (status != 0) {
+        s->error = s->dec.error;
+    }
+    return 0;
+}
+
+basenc_status_t basenc_stream_run(basenc_stream_t *s, const unsigned char **in, size_t *in_len, unsigned char **out,
+                                  size_t *out_len, int finish) {
+    for (;;) {
+        if (s->staged_pos < s->staged_len) {
+            size_t m = s->staged_len - s->staged_pos;
+            if (m > *out_len) {
+                m = *out_len;
+            }
+            memcpy(*out, s->staged + s->staged_pos, m);
+            *out += m;
+            *out_len -= m;
+            s->staged_pos += m;
+            if (s->staged_pos < s->staged_len) {
+                return BASENC_NEED_OUTPUT;
+            }
+        }
+        if (s->error) {
+            return BASENC_ERROR;
+        }
+        if (s->finished) {
+            return BASENC_DONE;
+        }
+        int need_input = s->decode ? stream_decode_step(s, in, in_len, out, out_len, finish)
+                                   : stream_encode_step(s, in, in_len, out, out_len, finish);
+        if (need_input) {
+            return BASENC_NEED_INPUT;
+        }
+    }
+}
+
+/*
+ * Random access for --skip-bytes.  Every quantum decodes to a fixed number
+ * of bytes, so in a cleanly wrapped file the quantum holding byte SKIP is
+ * at a computable character offset.  The line width comes from the first
+ * line; the file size, the last line and the line around the target are
+ * checked against it before seeking, and anything that does not fit
+ * (irregular lines, garbage, a pipe) makes the caller scan from the start
+ * instead.
+ */
+#define DEC_SEEK_WINDOW (64 * 1024)
+
+static int is_alphabet_run(const decoder_ops_t *ops, const unsigned char *p, size_t n) {
+    unsigned int bad = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        bad |= ops->table[p[i]];
+    }
+    return (bad & 0x80) == 0;
+}
+
+/*
+ * Check that SIZE bytes of input starting at START could be whole lines of
+ * WIDTH characters ending in NL bytes of newline, with one shorter or
+ * unterminated last line, and that the last line really is one.  Lines in
+ * the middle of the file are not read; a different width anywhere would
+ * change the total and is caught here.
+ */
+static int decoder_uniform(const decoder_ops_t *ops, FILE *in, long long start, unsigned long long size, size_t width,
+                           size_t nl, unsigned char *buf) {
+    unsigned long long period = width + nl;
+    unsigned long long lines = size / period;
+    size_t rem = (size_t)(size % period);
+    unsigned long long last = rem == 0 ? lines - 1 : lines;
+    size_t lead = last > 0 ? nl : 0;
+    size_t m, body;
+
+    if (lines == 0) {
+        return -1;
+    }
+    if (FSEEK64(in, start + (long long)(last * period - lead), SEEK_SET) != 0) {
+        return -1;
+    }
+    m = fread(buf, 1, lead + (rem == 0 ? (size_t)period : rem), in);
+    if (m != lead + (rem == 0 ? (size_t)period : rem) || (lead && buf[lead - 1] != '\n') ||
+        (lead == 2 && buf[0] != '\r')) {
+        return -1;
+    }
+    m -= lead;
+    if (buf[lead + m - 1] == '\n') {
+        if (m < nl + 1 || (nl == 2 && buf[lead + m - 2] != '\r')) {
+            return -1;
+        }
+        body = m - nl;
+    } else {
+        body = m;
+    }
+    if (body == 0 || body > width) {
+        return -1;
+    }
+    for (size_t k = 0; k < body; k++) {
+        int c = buf[lead + k];
+        if (ops->table[c] == DEC_INVALID && c != ops->pad_char) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Find the file offset of character CHARS of the encoded data starting at
+ * offset START, and the line layout there.  Returns -1 if the layout cannot
+ * be trusted.  Leaves the file position anywhere.
+ */
+static int decoder_locate(const decoder_t *dec, FILE *in, long long start, unsigned long long size, unsigned long long chars,
+                          unsigned char *buf, unsigned long long *target, size_t *width, size_t *nl, size_t *col) {
+    const decoder_ops_t *ops = dec->ops;
+    size_t n = fread(buf, 1, DEC_SEEK_WINDOW, in);
+    const unsigned char *newline = (const unsigned char *)memchr(buf, '\n', n);
+
+    *nl = 1;
+    *col = 0;
+
+    if (!newline) {
+        // One long line: nothing within a window of the target may be a newline
+        size_t back = chars < DEC_SEEK_WINDOW / 2 ? (size_t)chars : DEC_SEEK_WINDOW / 2;
+        *width = 0;
+        *target = chars;
+        if (FSEEK64(in, start + (long long)(chars - back), SEEK_SET) != 0) {
+            return -1;
+        }
+        size_t m = fread(buf, 1, back + ops->quantum_chars, in);
+        if (m <= back || !is_alphabet_run(ops, buf, back + 1) || memchr(buf, '\n', m)) {
+            return -1;
+        }
+        return 0;
+    }
+
+    *width = (size_t)(newline - buf);
+    if (*width > 0 && buf[*width - 1] == '\r') {
+        (*width)--;
+        *nl = 2;
+    }
+    if (*width == 0 || *width + 2 * *nl > DEC_SEEK_WINDOW || !is_alphabet_run(ops, buf, *width) ||
+        decoder_uniform(ops, in, start, size, *width, *nl, buf) != 0) {
+        return -1;
+    }
+
+    unsigned long long line = chars / *width;
+    unsigned long long line_start = line * (*width + *nl);
+    size_t lead = line > 0 ? *nl : 0;
+    *col = (size_t)(chars % *width);
+    *target = line_start + *col;
+    if (*target >= size) {
+        return -1;
+    }
+
+    // The target line must follow a newline and be a full line, or the last one
+    if (FSEEK64(in, start + (long long)(line_start - lead), SEEK_SET) != 0) {
+        return -1;
+    }
+    size_t m = fread(buf, 1, lead + *width + *nl, in);
+    if (m < lead + *col + 1 || (lead && buf[lead - 1] != '\n') || (lead == 2 && buf[0] != '\r')) {
+        return -1;
+    }
+    size_t body = m - lead < *width ? m - lead : *width;
+    size_t k = 0;
+    while (k < body && ops->table[buf[lead + k]] != DEC_INVALID) {
+        k++;
+    }
+    if (k <= *col || (k == *width && m > lead + k && buf[lead + k] != (*nl == 2 ? '\r' : '\n'))) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Seek IN to the quantum holding decoded byte SKIP; returns the bytes skipped, 0 if IN was left alone */
+static unsigned long long decoder_seek(decoder_t *dec, FILE *in, unsigned long long skip, unsigned char *buf) {
+    const decoder_ops_t *ops = dec->ops;
+    unsigned long long quanta = skip / ops->quantum_bytes;
+    unsigned long long chars = quanta * ops->quantum_chars;
+    unsigned long long size, target;
+    size_t width, nl, col;
+    long long start = FTELL64(in);
+
+    if (quanta == 0 || dec->ignore_garbage || start < 0 || input_regular_size(in, &size) != 0 || chars >= size) {
+        return 0;
+    }
+
+    if (decoder_locate(dec, in, start, size, chars, buf, &target, &width, &nl, &col) != 0 ||
+        FSEEK64(in, start + (long long)target, SEEK_SET) != 0) {
+        if (FSEEK64(in, start, SEEK_SET) != 0) {
+            exit_with_error("read error", NULL);
+        }
+        return 0;
+    }
+
+    dec->line_width = width;
+    dec->line_crlf = nl == 2;
+    dec->column = col;
+    return quanta * ops->quantum_bytes;
+}
+
+/*
+ * Seekable index sidecar (--write-index, --index).  One entry every
+ * interval of decoded output maps a decoded offset to the encoded offset
+ * where decoding can resume, together with the decoder state carried
+ * across that point: the characters of an incomplete quantum, pending
+ * '=' padding and the line layout.  Entries are taken at block boundaries,
+ * so they work for any layout, including mixed line lengths, CRLF and
+ * garbage.
+ *
+ * The header identifies the encoded file by its size, its modification
+ * time (0 when it was a pipe) and an FNV-1a hash of its first and last
+ * INDEX_PRINT_SIZE bytes; an index that does not match the input, or
+ * whose entries are out of order or out of range, is rejected.
+ *
+ * File layout, all integers little-endian:
+ *   header  "BASENCIX", u32 version, u32 encoding, u64 interval,
+ *           u64 encoded size, u64 decoded size  (sizes all ones until complete),
+ *           u64 mtime, u64 head hash, u64 tail hash
+ *   entry   u64 encoded offset, u64 decoded offset, u32 line width,
+ *           u32 column, u8 pending length, u8 padding, u8 crlf, u8 0,
+ *           u8 pending[8], u32 0
+ */
+#define INDEX_MAGIC "BASENCIX"
+#define INDEX_VERSION 2
+#define INDEX_HEADER_SIZE 64
+#define INDEX_ENTRY_SIZE 40
+#define INDEX_DEFAULT_INTERVAL (1024 * 1024)
+#define INDEX_INCOMPLETE ((unsigned long long)-1)
+#define INDEX_PRINT_SIZE 4096
+
+typedef struct {
+    unsigned long long encoded;
+    unsigned long long decoded;
+    size_t line_width;
+    size_t column;
+    int line_crlf;
+    size_t pending_len;
+    size_t padding;
+    unsigned char pending[8];
+} index_entry_t;
+
+typedef struct {
+    FILE *file;
+    const char *path;
+    encoding_type_t encoding_type;
+    unsigned long long interval;
+    unsigned long long next;    /* decoded offset due for the next entry */
+    unsigned long long mtime;   /* of the encoded file, 0 if it is not a regular file */
+    unsigned char head[INDEX_PRINT_SIZE];
+    unsigned char tail[INDEX_PRINT_SIZE];
+    size_t head_len;
+    size_t tail_len;
+} index_writer_t;
+
+static void put_le(unsigned char *p, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static unsigned long long get_le(const unsigned char *p, int bytes) {
+    unsigned long long value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static unsigned long long index_hash(const unsigned char *p, size_t n) {
+    unsigned long long h = 0xCBF29CE484222325ULL;
+
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ p[i]) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+/* Modification time of the regular file at PATH, or of FILE when PATH is NULL; 0 for anything else */
+static unsigned long long index_mtime(FILE *file, const char *path) {
+#ifdef _WIN32
+    struct _stat64 st;
+
+    if ((path ? _stat64(path, &st) : _fstat64(_fileno(file), &st)) != 0 || !(st.st_mode & _S_IFREG)) {
+        return 0;
+    }
+#else
+    struct stat st;
+
+    if ((path ? stat(path, &st) : fstat(fileno(file), &st)) != 0 || !S_ISREG(st.st_mode)) {
+        return 0;
+    }
+#endif
+    return (unsigned long long)st.st_mtime;
+}
+
+static void index_write_header(index_writer_t *ix, unsigned long long encoded_size, unsigned long long decoded_size) {
+    unsigned char header[INDEX_HEADER_SIZE];
+
+    memcpy(header, INDEX_MAGIC, 8);
+    put_le(header + 8, INDEX_VERSION, 4);
+    put_le(header + 12, (unsigned long long)ix->encoding_type, 4);
+    put_le(header + 16, ix->interval, 8);
+    put_le(header + 24, encoded_size, 8);
+    put_le(header + 32, decoded_size, 8);
+    put_le(header + 40, ix->mtime, 8);
+    put_le(header + 48, index_hash(ix->head, ix->head_len), 8);
+    put_le(header + 56, index_hash(ix->tail, ix->tail_len), 8);
+    if (fwrite(header, 1, sizeof(header), ix->file) != sizeof(header)) {
+        exit_with_error(ix->path, strerror(errno));
+    }
+}
+
+static void index_open(index_writer_t *ix, const char *path, encoding_type_t encoding_type, unsigned long long interval) {
+    ix->path = path;
+    ix->encoding_type = encoding_type;
+    ix->interval = interval ? interval : INDEX_DEFAULT_INTERVAL;
+    ix->next = 0;
+    ix->mtime = 0;
+    ix->head_len = 0;
+    ix->tail_len = 0;
+    ix->file = fopen(path, "wb");
+    if (!ix->file) {
+        exit_with_error(path, strerror(errno));
+    }
+    index_write_header(ix, INDEX_INCOMPLETE, INDEX_INCOMPLETE);
+}
+
+static void index_pack(unsigned char *record, const index_entry_t *entry) {
+    memset(record, 0, INDEX_ENTRY_SIZE);
+    put_le(record, entry->encoded, 8);
+    put_le(record + 8, entry->decoded, 8);
+    put_le(record + 16, entry->line_width, 4);
+    put_le(record + 20, entry->column < 0xffffffffu ? entry->column : 0xffffffffu, 4);
+    record[24] = (unsigned char)entry->pending_len;
+    record[25] = (unsigned char)entry->padding;
+    record[26] = (unsigned char)entry->line_crlf;
+    memcpy(record + 28, entry->pending, sizeof(entry->pending));
+}
+
+/* Returns -1 if RECORD is malformed */
+static int index_unpack(const unsigned char *record, index_entry_t *entry) {
+    entry->encoded = get_le(record, 8);
+    entry->decoded = get_le(record + 8, 8);
+    entry->line_width = (size_t)get_le(record + 16, 4);
+    entry->column = (size_t)get_le(record + 20, 4);
+    entry->pending_len = record[24];
+    entry->padding = record[25];
+    entry->line_crlf = record[26] != 0;
+    memcpy(entry->pending, record + 28, sizeof(entry->pending));
+    return entry->pending_len > sizeof(entry->pending) ? -1 : 0;
+}
+
+/* Pass N more bytes of the encoded file through the writer's fingerprint */
+static void index_feed(index_writer_t *ix, const unsigned char *p, size_t n) {
+    if (!ix) {
+        return;
+    }
+    if (ix->head_len < INDEX_PRINT_SIZE) {
+        size_t m = INDEX_PRINT_SIZE - ix->head_len < n ? INDEX_PRINT_SIZE - ix->head_len : n;
+        memcpy(ix->head + ix->head_len, p, m);
+        ix->head_len += m;
+    }
+    if (n >= INDEX_PRINT_SIZE) {
+        memcpy(ix->tail, p + n - INDEX_PRINT_SIZE, INDEX_PRINT_SIZE);
+        ix->tail_len = INDEX_PRINT_SIZE;
+        return;
+    }
+    if (ix->tail_len + n > INDEX_PRINT_SIZE) {
+        size_t drop = ix->tail_len + n - INDEX_PRINT_SIZE;
+        memmove(ix->tail, ix->tail + drop, ix->tail_len - drop);
+        ix->tail_len -= drop;
+    }
+    memcpy(ix->tail + ix->tail_len, p, n);
+    ix->tail_len += n;
+}
+
+/* Record ENTRY if its decoded offset has reached the next interval */
+static void index_add(index_writer_t *ix, const index_entry_t *entry) {
+    unsigned char record[INDEX_ENTRY_SIZE];
+
+    if (!ix || entry->decoded < ix->next) {
+        return;
+    }
+
+    index_pack(record, entry);
+    if (fwrite(record, 1, sizeof(record), ix->file) != sizeof(record)) {
+        exit_with_error(ix->path, strerror(errno));
+    }
+    ix->next = (entry->decoded / ix->interval + 1) * ix->interval;
+}
+
+/* Stamp the final sizes into the header, which marks the index complete */
+static void index_close(index_writer_t *ix, unsigned long long encoded_size, unsigned long long decoded_size) {
+    if (!ix) {
+        return;
+    }
+    if (fseek(ix->file, 0, SEEK_SET) != 0) {
+        exit_with_error(ix->path, strerror(errno));
+    }
+    index_write_header(ix, encoded_size, decoded_size);
+    if (fclose(ix->file) != 0) {
+        exit_with_error(ix->path, strerror(errno));
+    }
+    ix->file = NULL;
+}
+
+/* Whether the header fingerprint matches the ENCODED_SIZE bytes of IN from START; leaves the position anywhere */
+static int index_matches(const unsigned char *header, FILE *in, long long start, unsigned long long encoded_size) {
+    unsigned char block[INDEX_PRINT_SIZE];
+    size_t n = encoded_size < INDEX_PRINT_SIZE ? (size_t)encoded_size : INDEX_PRINT_SIZE;
+    unsigned long long mtime = get_le(header + 40, 8);
+
+    if (get_le(header + 24, 8) != encoded_size || (mtime != 0 && mtime != index_mtime(in, NULL))) {
+        return 0;
+    }
+    if (FSEEK64(in, start, SEEK_SET) != 0 || fread(block, 1, n, in) != n ||
+        index_hash(block, n) != get_le(header + 48, 8)) {
+        return 0;
+    }
+    if (FSEEK64(in, start + (long long)(encoded_size - n), SEEK_SET) != 0 || fread(block, 1, n, in) != n ||
+        index_hash(block, n) != get_le(header + 56, 8)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Last entry of the index at PATH at or before decoded offset TARGET, for the ENCODED_SIZE bytes of IN from START */
+static void index_lookup(const char *path, encoding_type_t encoding_type, FILE *in, long long start,
+                         unsigned long long encoded_size, unsigned long long target, index_entry_t *entry) {
+    unsigned char header[INDEX_HEADER_SIZE];
+    unsigned char record[INDEX_ENTRY_SIZE];
+    index_entry_t next;
+    index_entry_t prev;
+    unsigned long long decoded_size;
+    size_t quantum = decoder_ops(encoding_type)->quantum_chars;
+    int first = 1;
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        exit_with_error(path, strerror(errno));
+    }
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, INDEX_MAGIC, 8) != 0 ||
+        get_le(header + 8, 4) != INDEX_VERSION || get_le(header + 12, 4) != (unsigned long long)encoding_type) {
+        fclose(file);
+        exit_with_error("invalid index file", path);
+    }
+    if (get_le(header + 24, 8) == INDEX_INCOMPLETE) {
+        fclose(file);
+        exit_with_error("incomplete index file", path);
+    }
+    if (!index_matches(header, in, start, encoded_size)) {
+        fclose(file);
+        exit_with_error("index does not match the input", path);
+    }
+    decoded_size = get_le(header + 32, 8);
+
+    // Every entry must climb through the file in step and hold state a decoder can be in
+    memset(entry, 0, sizeof(*entry));
+    memset(&prev, 0, sizeof(prev));
+    while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+        if (index_unpack(record, &next) != 0 || next.encoded > encoded_size || next.decoded > decoded_size ||
+            next.pending_len >= quantum || next.padding >= quantum ||
+            (!first && (next.encoded < prev.encoded || next.decoded <= prev.decoded))) {
+            fclose(file);
+            exit_with_error("invalid index file", path);
+        }
+        if (next.decoded <= target) {
+            *entry = next;
+        }
+        prev = next;
+        first = 0;
+    }
+    fclose(file);
+}
+
+/* Record an encoder position; encoder blocks end on quantum boundaries, so nothing is pending */
+static void index_add_position(index_writer_t *ix, unsigned long long encoded, unsigned long long decoded,
+                               size_t line_width, size_t column) {
+    index_entry_t entry;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.encoded = encoded;
+    entry.decoded = decoded;
+    entry.line_width = line_width;
+    entry.column = column;
+    index_add(ix, &entry);
+}
+
+static void decoder_save(const decoder_t *dec, index_entry_t *entry) {
+    entry->line_width = dec->line_width;
+    entry->column = dec->column;
+    entry->line_crlf = dec->line_crlf;
+    entry->pending_len = dec->pending_len;
+    entry->padding = dec->padding;
+    memset(entry->pending, 0, sizeof(entry->pending));
+    memcpy(entry->pending, dec->pending, dec->pending_len);
+}
+
+static void decoder_restore(decoder_t *dec, const index_entry_t *entry) {
+    dec->line_width = entry->line_width;
+    dec->column = entry->column;
+    dec->line_crlf = entry->line_crlf;
+    dec->pending_len = entry->pending_len;
+    dec->padding = entry->padding;
+    memcpy(dec->pending, entry->pending, sizeof(dec->pending));
+}
+
+/* decoder_seek through the index at PATH; works for any layout of the input */
+static unsigned long long decoder_seek_index(decoder_t *dec, FILE *in, const char *path, encoding_type_t encoding_type,
+                                             unsigned long long skip) {
+    index_entry_t entry;
+    unsigned long long size;
+    long long start = FTELL64(in);
+
+    if (start < 0 || input_regular_size(in, &size) != 0) {
+        exit_with_error("--index needs a regular input file", path);
+    }
+    index_lookup(path, encoding_type, in, start, size, skip, &entry);
+    if (FSEEK64(in, start + (long long)entry.encoded, SEEK_SET) != 0) {
+        exit_with_error("read error", NULL);
+    }
+    if (entry.encoded == 0) {
+        return 0;
+    }
+    decoder_restore(dec, &entry);
+    return entry.decoded;
+}
+
+/*
+ * Encoding detection (--auto).  The first block is read into a byte
+ * histogram, and each candidate alphabet is checked against the histogram
+ * through its decode table, smallest alphabet first.  Each '=' run must
+ * be a padding length the alphabet can produce and end a quantum, as in
+ * concatenated padded input, and the whole input, when the sample holds
+ * it, must be whole quanta; with -i the candidate with the fewest foreign
+ * bytes wins.  Base32 and base16 decode either case but are written in
+ * one, so mixed case rules them out.  Line layout is not used: every
+ * alphabet wraps at any width.
+ *
+ * A sample using few characters fits several alphabets: base64 or base32
+ * of a zero run is all 'A', which base16 accepts too.  While the first
+ * candidate that fits has seen less than half of its alphabet, the sample
+ * doubles, up to AUTO_MAXSIZE; a regular file then has blocks spread over
+ * the rest of it added to the histogram.  If it is still unclear, a
+ * candidate whose zero digit makes up most of the sample is taken, as the
+ * run most likely encodes zeros, and otherwise the first that fits; a pipe
+ * holding more than AUTO_MAXSIZE of one character can still be taken for
+ * the wrong alphabet this way.  A seekable input is rewound afterwards;
+ * what was read from a pipe is handed to the decoder first.
+ */
+#define AUTO_BLOCKSIZE 4096
+#define AUTO_MAXSIZE (1024 * 1024)
+#define AUTO_SPREAD 16
+
+static unsigned char *auto_block = NULL;
+static size_t auto_len = 0;
+static size_t auto_pos = 0;
+
+/* fread for the decoder, returning what --auto read from a pipe first */
+static size_t read_input(void *buf, size_t n, FILE *in) {
+    if (auto_pos < auto_len) {
+        size_t m = auto_len - auto_pos < n ? auto_len - auto_pos : n;
+        memcpy(buf, auto_block + auto_pos, m);
+        auto_pos += m;
+        if (auto_pos == auto_len) {
+            free(auto_block);
+            auto_block = NULL;
+            auto_len = auto_pos = 0;
+        }
+        return m;
+    }
+    return fread(buf, 1, n, in);
+}
+
+/* feof for the decoder, false while read_input() still has bytes to hand back */
+static int input_eof(FILE *in) {
+    return auto_pos >= auto_len && feof(in);
+}
+
+// Only the command line detects; an embedder names the encoding
+#ifndef BASENC_NO_MAIN
+static const encoding_type_t auto_candidates[] = {
+    ENC_BASE16, ENC_BASE32, ENC_BASE32HEX, ENC_BASE64, ENC_BASE64URL
+};
+
+/* Whether TAIL trailing '=' can end the input in OPS's alphabet */
+static int auto_padding_fits(const decoder_ops_t *ops, size_t tail) {
+    size_t r = ops->quantum_chars - tail;
+
+    if (tail == 0) {
+        return 1;
+    }
+    if (ops->pad_char != '=' || ops->bits_per_char == 0 || tail >= ops->quantum_chars) {
+        return 0;
+    }
+    // The last data character must complete a byte of its own
+    return r * ops->bits_per_char / 8 > (r - 1) * ops->bits_per_char / 8;
+}
+
+/* Whether every '=' run in the N bytes at P ends a quantum of OPS with a padding it can produce */
+static int auto_padding_runs_fit(const decoder_ops_t *ops, const unsigned char *p, size_t n, int whole) {
+    size_t data = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        if (p[i] != '=') {
+            data += ops->table[p[i]] != DEC_INVALID;
+            i++;
+            continue;
+        }
+        size_t run = 0;
+        for (; i < n && (p[i] == '=' || p[i] == '\n' || p[i] == '\r'); i++) {
+            run += p[i] == '=';
+        }
+        // A run at the end of a partial block may go on past it
+        if (i == n && !whole) {
+            break;
+        }
+        if ((data + run) % ops->quantum_chars != 0 || !auto_padding_fits(ops, run)) {
+            return 0;
+        }
+        data = 0;
+    }
+    return 1;
+}
+
+/* Add the N bytes at P to COUNT */
+static void auto_histogram(size_t count[256], const unsigned char *p, size_t n) {
+    size_t hist[4][256];
+    size_t i, c;
+
+    // Four interleaved tables, so runs of one byte do not serialise on a single counter
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i + 4 <= n; i += 4) {
+        hist[0][p[i]]++;
+        hist[1][p[i + 1]]++;
+        hist[2][p[i + 2]]++;
+        hist[3][p[i + 3]]++;
+    }
+    for (; i < n; i++) {
+        hist[0][p[i]]++;
+    }
+    for (c = 0; c < 256; c++) {
+        count[c] += hist[0][c] + hist[1][c] + hist[2][c] + hist[3][c];
+    }
+}
+
+/*
+ * Pick a candidate for the histogram COUNT of a sample whose head is the
+ * N bytes at P.  *CLEAR is set when the pick has seen at least half of its
+ * alphabet.
+ */
+static encoding_type_t auto_pick(const size_t count[256], const unsigned char *p, size_t n, int whole,
+                                 int ignore_garbage, int *clear) {
+    size_t upper = 0;
+    size_t lower = 0;
+    size_t top = 0;
+    size_t c, i;
+
+    // Alphabets read case-insensitively are written in one case
+    for (c = 0; c < 26; c++) {
+        upper += count['A' + c];
+        lower += count['a' + c];
+    }
+    for (c = 1; c < 256; c++) {
+        if (c != '\n' && c != '\r' && count[c] > count[top]) {
+            top = c;
+        }
+    }
+
+    encoding_type_t best = ENC_NONE;
+    encoding_type_t zero_run = ENC_NONE;
+    size_t best_foreign = 0;
+    *clear = 0;
+    for (i = 0; i < sizeof(auto_candidates) / sizeof(auto_candidates[0]); i++) {
+        const decoder_ops_t *ops = decoder_ops(auto_candidates[i]);
+        unsigned char seen[64];
+        size_t values = 0;
+        size_t alphabet = 0;
+        size_t chars = 0;
+        size_t foreign = 0;
+
+        memset(seen, 0, sizeof(seen));
+        for (c = 0; c < 256; c++) {
+            if (ops->table[c] != DEC_INVALID) {
+                chars += count[c];
+                if (ops->table[c] >= alphabet) {
+                    alphabet = ops->table[c] + 1;
+                }
+                if (count[c] > 0 && !seen[ops->table[c]]) {
+                    seen[ops->table[c]] = 1;
+                    values++;
+                }
+            } else if (c != '\n' && c != '\r' && c != '=') {
+                foreign += count[c];
+            }
+        }
+        if ((foreign > 0 && !ignore_garbage) ||
+            (count['='] > 0 && !auto_padding_runs_fit(ops, p, n, whole)) ||
+            (whole && (chars + count['=']) % ops->quantum_chars != 0) ||
+            (ops->table['a'] == ops->table['A'] && upper > 0 && lower > 0)) {
+            continue;
+        }
+        if (zero_run == ENC_NONE && ops->table[top] == 0 && count[top] * 2 > chars) {
+            zero_run = auto_candidates[i];
+        }
+        if (best == ENC_NONE || foreign < best_foreign) {
+            best = auto_candidates[i];
+            best_foreign = foreign;
+            *clear = values * 2 >= alphabet;
+        }
+    }
+    if (!*clear && zero_run != ENC_NONE) {
+        return zero_run;
+    }
+    return best;
+}
+
+static encoding_type_t detect_encoding(FILE *in, int ignore_garbage) {
+    size_t count[256];
+    long long start = FTELL64(in);
+    unsigned long long size;
+    size_t want = AUTO_BLOCKSIZE;
+    size_t n = 0;
+    size_t counted = 0;
+    int whole = 0;
+    int clear = 0;
+    encoding_type_t best = ENC_NONE;
+
+    auto_block = (unsigned char *)malloc(AUTO_MAXSIZE);
+    if (!auto_block) {
+        exit_with_error("memory allocation failed", NULL);
+    }
+    memset(count, 0, sizeof(count));
+
+    // Double the sample while the pick is unclear
+    for (;;) {
+        while (n < want) {
+            size_t m = fread(auto_block + n, 1, want - n, in);
+            if (m == 0) {
+                break;
+            }
+            n += m;
+        }
+        if (ferror(in)) {
+            exit_with_error("read error", NULL);
+        }
+        whole = feof(in) != 0;
+        auto_histogram(count, auto_block + counted, n - counted);
+        counted = n;
+        best = auto_pick(count, auto_block, n, whole, ignore_garbage, &clear);
+        if (best == ENC_NONE || clear || whole || want == AUTO_MAXSIZE) {
+            break;
+        }
+        want *= 2;
+    }
+
+    // Then look over the rest of a regular file
+    if (best != ENC_NONE && !clear && !whole && start >= 0 && input_regular_size(in, &size) == 0 &&
+        size > AUTO_BLOCKSIZE) {
+        unsigned char spread[AUTO_BLOCKSIZE];
+        long long here = FTELL64(in);
+        for (int k = 1; k <= AUTO_SPREAD; k++) {
+            if (FSEEK64(in, here + (long long)((size - AUTO_BLOCKSIZE) / AUTO_SPREAD * k), SEEK_SET) != 0) {
+                break;
+            }
+            auto_histogram(count, spread, fread(spread, 1, AUTO_BLOCKSIZE, in));
+        }
+        best = auto_pick(count, auto_block, n, whole, ignore_garbage, &clear);
+    }
+    if (best == ENC_NONE) {
+        exit_with_error("input does not match any encoding --auto detects", NULL);
+    }
+
+    if (start >= 0 && FSEEK64(in, start, SEEK_SET) == 0) {
+        free(auto_block);
+        auto_block = NULL;
+        auto_len = 0;
+    } else {
+        auto_len = n;
+        auto_pos = 0;
+    }
+    return best;
+}
+#endif
+
+/*
+ * Digest of the raw bytes (--checksum): the input of an encode, the
+ * output of a decode.  It is updated on each block inside the block loop,
+ * right after the block is read or decoded, so no second pass is made.
+ * CRC32C uses the SSE4.2 crc32 instruction when the CPU has it, and a
+ * byte table otherwise; XXH64 is the reference algorithm with seed 0.
+ */
+typedef struct {
+    checksum_type_t type;
+    int hardware;               /* CRC32C through SSE4.2 */
+    unsigned int crc;
+    unsigned long long acc[4];  /* XXH64 lanes */
+    unsigned long long total;
+    unsigned char buf[32];      /* XXH64 input short of a stripe */
+    size_t buf_len;
+} checksum_t;
+
+static checksum_t checksum = { CHECKSUM_NONE, 0, 0, { 0, 0, 0, 0 }, 0, { 0 }, 0 };
+
+#define CRC32C_POLY 0x82F63B78u
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static unsigned int crc32c_table[256];
+
+static unsigned int crc32c_scalar(unsigned int crc, const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        crc = crc32c_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/*
+ * The crc32 instruction has a latency of three cycles, so one dependent
+ * chain runs at a third of its throughput.  Runs of three lanes are taken
+ * in parallel, each lane after the first starting from zero, and joined
+ * by shifting the earlier CRC over the length of a lane with a table: the
+ * CRC register is linear, so its shift is the XOR of the shifts of its
+ * bytes.
+ */
+#define CRC32C_LONG 1024
+#define CRC32C_SHORT 128
+
+static unsigned int crc32c_long[4][256];
+static unsigned int crc32c_short[4][256];
+
+/* Tables that shift a CRC register over LEN zero bytes */
+static void crc32c_shift_table(unsigned int table[4][256], size_t len) {
+    unsigned int basis[32];
+
+    for (int bit = 0; bit < 32; bit++) {
+        unsigned int c = 1u << bit;
+        for (size_t i = 0; i < len; i++) {
+            c = crc32c_table[c & 0xFF] ^ (c >> 8);
+        }
+        basis[bit] = c;
+    }
+    for (int k = 0; k < 4; k++) {
+        for (unsigned int b = 0; b < 256; b++) {
+            unsigned int c = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                if (b & (1u << bit)) {
+                    c ^= basis[8 * k + bit];
+                }
+            }
+            table[k][b] = c;
+        }
+    }
+}
+
+static unsigned int crc32c_shift(unsigned int table[4][256], unsigned int crc) {
+    return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^ table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+}
+
+#ifdef BASENC_X86
+#ifdef BASENC_X86_64
+/* CRC of three lanes of LANE bytes at P, joined with TABLE */
+TARGET("sse4.2")
+static unsigned int crc32c_lanes(unsigned int crc, const unsigned char *p, size_t lane, unsigned int table[4][256]) {
+    unsigned long long c0 = crc, c1 = 0, c2 = 0;
+
+    for (size_t i = 0; i < lane; i += 8) {
+        unsigned long long w0, w1, w2;
+        memcpy(&w0, p + i, 8);
+        memcpy(&w1, p + lane + i, 8);
+        memcpy(&w2, p + 2 * lane + i, 8);
+        c0 = _mm_crc32_u64(c0, w0);
+        c1 = _mm_crc32_u64(c1, w1);
+        c2 = _mm_crc32_u64(c2, w2);
+    }
+    crc = crc32c_shift(table, (unsigned int)c0) ^ (unsigned int)c1;
+    return crc32c_shift(table, crc) ^ (unsigned int)c2;
+}
+#endif
+
+TARGET("sse4.2")
+static unsigned int crc32c_sse42(unsigned int crc, const unsigned char *p, size_t n) {
+    size_t i = 0;
+#ifdef BASENC_X86_64
+    for (; n - i >= 3 * CRC32C_LONG; i += 3 * CRC32C_LONG) {
+        crc = crc32c_lanes(crc, p + i, CRC32C_LONG, crc32c_long);
+    }
+    for (; n - i >= 3 * CRC32C_SHORT; i += 3 * CRC32C_SHORT) {
+        crc = crc32c_lanes(crc, p + i, CRC32C_SHORT, crc32c_short);
+    }
+    unsigned long long c = crc;
+    for (; i + 8 <= n; i += 8) {
+        unsigned long long word;
+        memcpy(&word, p + i, 8);
+        c = _mm_crc32_u64(c, word);
+    }
+    crc = (unsigned int)c;
+#endif
+    for (; i + 4 <= n; i += 4) {
+        unsigned int word;
+        memcpy(&word, p + i, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; i < n; i++) {
+        crc = _mm_crc32_u8(crc, p[i]);
+    }
+    return crc;
+}
+#endif
+
+static unsigned long long load_le64(const unsigned char *p) {
+    return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 | (unsigned long long)p[2] << 16 |
+           (unsigned long long)p[3] << 24 | (unsigned long long)p[4] << 32 | (unsigned long long)p[5] << 40 |
+           (unsigned long long)p[6] << 48 | (unsigned long long)p[7] << 56;
+}
+
+static unsigned long long rotl64(unsigned long long x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static unsigned long long xxh64_round(unsigned long long acc, unsigned long long input) {
+    acc += input * XXH_PRIME64_2;
+    return rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static unsigned long long xxh64_merge(unsigned long long h, unsigned long long acc) {
+    h ^= xxh64_round(0, acc);
+    return h * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* Run whole 32-byte stripes of P through the lanes; returns the bytes used */
+static size_t xxh64_stripes(unsigned long long acc[4], const unsigned char *p, size_t n) {
+    unsigned long long a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        a0 = xxh64_round(a0, load_le64(p + i));
+        a1 = xxh64_round(a1, load_le64(p + i + 8));
+        a2 = xxh64_round(a2, load_le64(p + i + 16));
+        a3 = xxh64_round(a3, load_le64(p + i + 24));
+    }
+    acc[0] = a0;
+    acc[1] = a1;
+    acc[2] = a2;
+    acc[3] = a3;
+    return i;
+}
+
+/* Start the digest --checksum asked for, if any */
+static void checksum_init(const params_t *params) {
+    checksum_type_t type = params->checksum;
+
+    if (type == CHECKSUM_NONE) {
+        return;
+    }
+    checksum.type = type;
+    checksum.total = 0;
+    checksum.buf_len = 0;
+    if (type == CHECKSUM_CRC32C) {
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+            }
+            crc32c_table[i] = c;
+        }
+        checksum.crc = 0xFFFFFFFFu;
+#ifdef BASENC_X86
+        unsigned int regs[4];
+        cpuid(1, 0, regs);
+        checksum.hardware = (regs[2] & (1u << 20)) != 0 && detect_isa() != ISA_SCALAR;
+        if (checksum.hardware) {
+            crc32c_shift_table(crc32c_long, CRC32C_LONG);
+            crc32c_shift_table(crc32c_short, CRC32C_SHORT);
+        }
+#endif
+    } else {
+        checksum.acc[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+        checksum.acc[1] = XXH_PRIME64_2;
+        checksum.acc[2] = 0;
+        checksum.acc[3] = 0 - XXH_PRIME64_1;
+    }
+}
+
+static void checksum_update(const unsigned char *p, size_t n) {
+    if (checksum.type == CHECKSUM_NONE || n == 0) {
+        return;
+    }
+    checksum.total += n;
+    if (checksum.type == CHECKSUM_CRC32C) {
+#ifdef BASENC_X86
+        if (checksum.hardware) {
+            checksum.crc = crc32c_sse42(checksum.crc, p, n);
+            return;
+        }
+#endif
+        checksum.crc = crc32c_scalar(checksum.crc, p, n);
+        return;
+    }
+
+    if (checksum.buf_len > 0) {
+        size_t m = 32 - checksum.buf_len < n ? 32 - checksum.buf_len : n;
+        memcpy(checksum.buf + checksum.buf_len, p, m);
+        checksum.buf_len += m;
+        p += m;
+        n -= m;
+        if (checksum.buf_len < 32) {
+            return;
+        }
+        xxh64_stripes(checksum.acc, checksum.buf, 32);
+        checksum.buf_len = 0;
+    }
+    size_t used = xxh64_stripes(checksum.acc, p, n);
+    memcpy(checksum.buf, p + used, n - used);
+    checksum.buf_len = n - used;
+}
+
+/* The digest as lowercase hex into HEX, at least 17 bytes */
+static void checksum_final(char *hex) {
+    if (checksum.type == CHECKSUM_CRC32C) {
+        snprintf(hex, 17, "%08x", checksum.crc ^ 0xFFFFFFFFu);
+        return;
+    }
+
+    unsigned long long h;
+    const unsigned char *p = checksum.buf;
+    size_t n = checksum.buf_len;
+    if (checksum.total >= 32) {
+        h = rotl64(checksum.acc[0], 1) + rotl64(checksum.acc[1], 7) + rotl64(checksum.acc[2], 12) +
+            rotl64(checksum.acc[3], 18);
+        for (int k = 0; k < 4; k++) {
+            h = xxh64_merge(h, checksum.acc[k]);
+        }
+    } else {
+        h = XXH_PRIME64_5;
+    }
+    h += checksum.total;
+    for (; n >= 8; p += 8, n -= 8) {
+        h ^= xxh64_round(0, load_le64(p));
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (n >= 4) {
+        h ^= ((unsigned long long)p[0] | (unsigned long long)p[1] << 8 | (unsigned long long)p[2] << 16 |
+              (unsigned long long)p[3] << 24) * XXH_PRIME64_1;
+        h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        n -= 4;
+    }
+    for (; n > 0; p++, n--) {
+        h ^= *p * XXH_PRIME64_5;
+        h = rotl64(h, 11) * XXH_PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    snprintf(hex, 17, "%016llx", h);
+}
+
+/* Report the digest, and fail if it is not the --expect value */
+static void checksum_report(const params_t *params) {
+    const char *name = checksum.type == CHECKSUM_CRC32C ? "crc32c" : "xxh64";
+    char hex[17];
+
+    if (checksum.type == CHECKSUM_NONE) {
+        return;
+    }
+    checksum_final(hex);
+    if (params->checksum_file) {
+        FILE *file = fopen(params->checksum_file, "w");
+        if (!file) {
+            exit_with_error(params->checksum_file, strerror(errno));
+        }
+        fprintf(file, "%s %s\n", name, hex);
+        if (fclose(file) != 0) {
+            exit_with_error(params->checksum_file, strerror(errno));
+        }
+    } else {
+        fprintf(stderr, "%s: %s %s\n", PROGRAM_NAME, name, hex);
+    }
+    if (params->expect) {
+        size_t k = 0;
+        while (params->expect[k] != '\0' && tolower((unsigned char)params->expect[k]) == hex[k]) {
+            k++;
+        }
+        if (params->expect[k] != '\0' || hex[k] != '\0') {
+            exit_with_error("checksum mismatch", name);
+        }
+    }
+}
+
+/*
+ * Verification against an original (--verify).  A regular original is
+ * mapped read-only and each decoded slice is compared with the same bytes
+ * of it while the slice is still in cache; a pipe or other stream is read
+ * alongside in VERIFY_BLOCKSIZE pieces instead.  Nothing decoded is
+ * written.  The first differing byte is found with vector compares, 32 or
+ * 16 bytes at a time.
+ */
+#define VERIFY_BLOCKSIZE (64 * 1024)
+
+typedef struct {
+    const char *path;
+    output_map_t map;
+    FILE *file;                 /* a non-regular original, NULL when it is mapped */
+    unsigned char *buf;         /* bytes read from FILE, [pos, len) not compared yet */
+    size_t pos;
+    size_t len;
+    int ended;                  /* the original ran out before the decoded data */
+    unsigned long long offset;  /* decoded bytes compared so far */
+} verify_t;
+
+/* Index of the first byte where A and B differ, N if they are equal */
+static size_t first_difference_scalar(const unsigned char *a, const unsigned char *b, size_t n) {
+    size_t i = 0;
+
+    while (i < n && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef BASENC_X86
+TARGET("sse2")
+static size_t first_difference_sse2(const unsigned char *a, const unsigned char *b, size_t n) {
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned int differ = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFFu;
+        if (differ) {
+            return i + ctz32(differ);
+        }
+    }
+    return i + first_difference_scalar(a + i, b + i, n - i);
+}
+
+TARGET("avx2")
+static size_t first_difference_avx2(const unsigned char *a, const unsigned char *b, size_t n) {
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        unsigned int differ = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (differ) {
+            return i + ctz32(differ);
+        }
+    }
+    return i + first_difference_sse2(a + i, b + i, n - i);
+}
+#endif
+
+static size_t first_difference(const unsigned char *a, const unsigned char *b, size_t n) {
+#ifdef BASENC_X86
+    if (detect_isa() >= ISA_AVX2) {
+        return first_difference_avx2(a, b, n);
+    }
+    if (detect_isa() >= ISA_SSSE3) {
+        return first_difference_sse2(a, b, n);
+    }
+#endif
+    return first_difference_scalar(a, b, n);
+}
+
+static void verify_open(verify_t *v, const char *path) {
+    unsigned long long size;
+
+    memset(v, 0, sizeof(*v));
+    v->path = path;
+    // Opened as a stream first, so a named pipe is not opened and dropped under its writer
+    v->file = fopen(path, "rb");
+    if (!v->file) {
+        exit_with_error(strerror(errno), path);
+    }
+    if (input_regular_size(v->file, &size) == 0 && input_map_open(&v->map, path) == 0) {
+        fclose(v->file);
+        v->file = NULL;
+        return;
+    }
+    v->buf = (unsigned char *)malloc(VERIFY_BLOCKSIZE);
+    if (!v->buf) {
+        exit_with_error("memory allocation failed", NULL);
+    }
+}
+
+/* Refill the buffer of a streamed original; returns the bytes available */
+static size_t verify_fill(verify_t *v) {
+    if (v->pos == v->len) {
+        v->pos = 0;
+        v->len = fread(v->buf, 1, VERIFY_BLOCKSIZE, v->file);
+        if (ferror(v->file)) {
+            exit_with_error("read error", v->path);
+        }
+    }
+    return v->len - v->pos;
+}
+
+/* Compare the next N decoded bytes; returns -1 at the first difference, reported through verify_fail() */
+static int verify_compare(verify_t *v, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        const unsigned char *orig;
+        size_t room;
+
+        if (v->file) {
+            room = verify_fill(v);
+            orig = v->buf + v->pos;
+        } else {
+            room = v->map.size - (size_t)v->offset;
+            orig = v->map.base + v->offset;
+        }
+        if (room == 0) {
+            v->ended = 1;
+            return -1;
+        }
+
+        size_t m = n < room ? n : room;
+        size_t same = first_difference(p, orig, m);
+        v->offset += same;
+        v->pos += v->file ? same : 0;
+        if (same < m) {
+            return -1;
+        }
+        p += m;
+        n -= m;
+    }
+    return 0;
+}
+
+static void verify_release(verify_t *v) {
+    if (v->file) {
+        fclose(v->file);
+        free(v->buf);
+    } else {
+        input_map_close(&v->map);
+    }
+}
+
+static void verify_fail(verify_t *v) {
+    char message[96];
+
+    if (v->ended) {
+        snprintf(message, sizeof(message), "decoded data is longer, past byte %llu", v->offset);
+    } else {
+        snprintf(message, sizeof(message), "differs at decoded byte %llu", v->offset);
+    }
+    verify_release(v);
+    exit_with_error(message, v->path);
+}
+
+/* At the end of the decoded data: the original must end too */
+static void verify_close(verify_t *v, int verbose) {
+    char message[96];
+
+    if (v->file ? verify_fill(v) > 0 : v->offset < v->map.size) {
+        snprintf(message, sizeof(message), "decoded data is shorter, ending at byte %llu", v->offset);
+        verify_release(v);
+        exit_with_error(message, v->path);
+    }
+    verify_release(v);
+    if (verbose) {
+        fprintf(stderr, "%s: %s: %llu bytes match\n", PROGRAM_NAME, v->path, (unsigned long long)v->offset);
+    }
+}
+
+/*
+ * Validation without decoding (--check, --size with -d).  Follows the
+ * decoder's rules for newlines, '=' padding, garbage and the final
+ * quantum, but runs of alphabet characters only go through the
+ * classification scan and are counted, never packed or decoded.  Z85
+ * and base45 quanta can hold values out of range, so those two keep the
+ * characters of each quantum and test it with the scalar kernel.  The
+ * decoded size is counted along the way.
+ */
+typedef struct {
+    const decoder_ops_t *ops;
+    decode_fn quantum;          /* set when quanta need a value check */
+    scan_fn scan;
+    compact_class_t cls;
+    int ignore_garbage;
+    unsigned char pending[8];   /* characters of an incomplete quantum, kept only with QUANTUM */
+    size_t pending_len;
+    size_t padding;             /* '=' still expected to finish a quantum */
+    unsigned long long offset;  /* input bytes before the current block */
+    unsigned long long decoded;
+    unsigned long long error_at;
+    const char *error;
+} checker_t;
+
+static void checker_init(checker_t *ck, encoding_type_t encoding_type, int ignore_garbage) {
+    memset(ck, 0, sizeof(*ck));
+    build_compact_tables();
+    ck->ops = decoder_ops(encoding_type);
+    if (encoding_type == ENC_Z85 || encoding_type == ENC_BASE45) {
+        ck->quantum = kernel_set(encoding_type)->decode[ISA_SCALAR];
+    }
+    ck->scan = ck->quantum ? scan_scalar : select_scanner(detect_isa());
+    ck->ignore_garbage = ignore_garbage;
+    build_compact_class(&ck->cls, ck->ops->table, ck->ops->bits_per_char ? ck->ops->pad_char : -1, ignore_garbage);
+}
+
+/* One byte through the decoder's general rules; returns -1 if it is invalid */
+static int checker_byte(checker_t *ck, unsigned char c) {
+    const decoder_ops_t *ops = ck->ops;
+
+    if (c == '\n' || c == '\r') {
+        return 0;
+    }
+    if (c == ops->pad_char && ops->bits_per_char) {
+        if (ck->padding == 0) {
+            size_t bits = ck->pending_len * ops->bits_per_char;
+            if (ck->pending_len == 0 || bits % 8 >= (size_t)ops->bits_per_char) {
+                return -1;
+            }
+            ck->decoded += bits / 8;
+            ck->padding = ops->quantum_chars - ck->pending_len;
+            ck->pending_len = 0;
+        }
+        ck->padding--;
+        return 0;
+    }
+    if (ops->table[c] == DEC_INVALID) {
+        return ck->ignore_garbage ? 0 : -1;
+    }
+    if (ck->padding) {
+        return -1;
+    }
+    ck->pending[ck->pending_len++] = c;
+    if (ck->pending_len == ops->quantum_chars) {
+        unsigned char bytes[8];
+        if (ck->quantum && ck->quantum(ck->pending, 1, bytes) != 0) {
+            return -1;
+        }
+        ck->decoded += ops->quantum_bytes;
+        ck->pending_len = 0;
+    }
+    return 0;
+}
+
+/* Check the next LEN input bytes; returns -1 at the first invalid one */
+static int checker_run(checker_t *ck, const unsigned char *in, size_t len) {
+    size_t q = ck->ops->quantum_chars;
+    size_t p = 0;
+
+    while (p < len) {
+        if (ck->padding == 0 && !ck->quantum) {
+            size_t chars = 0;
+            p += ck->scan(in + p, len - p, &chars, &ck->cls);
+            chars += ck->pending_len;
+            ck->decoded += chars / q * ck->ops->quantum_bytes;
+            ck->pending_len = chars % q;
+            if (p == len) {
+                break;
+            }
+        }
+        if (checker_byte(ck, in[p]) != 0) {
+            ck->error = "invalid input";
+            ck->error_at = ck->offset + p;
+            return -1;
+        }
+        p++;
+    }
+    ck->offset += len;
+    return 0;
+}
+
+/* At the end of the input: the last quantum must be complete, padded or allowed short */
+static int checker_finish(checker_t *ck) {
+    const decoder_ops_t *ops = ck->ops;
+    size_t bits = ck->pending_len * ops->bits_per_char;
+
+    ck->error_at = ck->offset;
+    if (ck->padding) {
+        ck->error = "invalid input";
+        return -1;
+    }
+    if (ck->pending_len == 0) {
+        return 0;
+    }
+    if (ops->partial) {
+        unsigned char bytes[8];
+        int n = ops->partial(ck->pending, ck->pending_len, bytes);
+        if (n < 0) {
+            ck->error = ops->length_error;
+            return -1;
+        }
+        ck->decoded += (unsigned long long)n;
+        return 0;
+    }
+    if (ops->bits_per_char && ops->pad_char < 0 && bits % 8 < (size_t)ops->bits_per_char) {
+        ck->decoded += bits / 8;
+        return 0;
+    }
+    ck->error = ops->bits_per_char && bits % 8 < (size_t)ops->bits_per_char ? "invalid input" : ops->length_error;
+    return -1;
+}
+
+/* Main encoding/decoding functions */
+/* Exact size of the encoding of LEN bytes, newlines included */
+static unsigned long long encoded_size(encoding_type_t encoding_type, unsigned long long len, size_t wrap_column) {
+    const decoder_ops_t *ops = decoder_ops(encoding_type);
+    unsigned long long chars = (len + ops->quantum_bytes - 1) / ops->quantum_bytes * ops->quantum_chars;
+
+    // A final odd byte of base45 is two characters, not a whole group
+    if (encoding_type == ENC_BASE45 && len % 2 != 0) {
+        chars--;
+    }
+    if (wrap_column > 0) {
+        chars += (chars + wrap_column - 1) / wrap_column;
+    }
+    return chars;
+}
+
+/*
+ * Encode the LEN bytes left in IN straight into MAP and return the bytes
+ * written; the stream lays the lines out in the mapping itself.
+ */
+static size_t encode_mapped(FILE *in, output_map_t *map, unsigned long long len, basenc_stream_t *stream,
+                            unsigned char *inbuf, index_writer_t *ix, int sparse) {
+    unsigned char *dst = map->base;
+    size_t room = map->size;
+    unsigned long long consumed = 0;
+    unsigned long long t;
+    basenc_status_t status;
+
+    index_add_position(ix, 0, 0, stream->wrap_column, 0);
+    do {
+        size_t want = len < ENC_BLOCKSIZE ? (size_t)len : ENC_BLOCKSIZE;
+        size_t sum;
+
+        STATS_START(t);
+        sum = read_block(in, inbuf, want, sparse);
+        STATS_STOP(read_ns, t);
+        stats.bytes_in += sum;
+        checksum_update(inbuf, sum);
+
+        // The file may have shrunk since it was sized; what was read is all there is
+        len = sum < want ? 0 : len - sum;
+
+        const unsigned char *next = inbuf;
+        size_t left = sum;
+        STATS_START(t);
+        status = basenc_stream_run(stream, &next, &left, &dst, &room, len == 0);
+        STATS_STOP(transform_ns, t);
+
+        consumed += sum;
+        index_add_position(ix, (unsigned long long)(dst - map->base), consumed, stream->wrap_column, stream->column);
+    } while (status == BASENC_NEED_INPUT);
+
+    stats.bytes_out += (size_t)(dst - map->base);
+    return (size_t)(dst - map->base);
+}
+
+/* Write N bytes of OUTBUF to OUT */
+static void write_block(FILE *out, const void *outbuf, size_t n) {
+    unsigned long long t;
+
+    if (n == 0) {
+        return;
+    }
+    STATS_START(t);
+    if (fwrite(outbuf, 1, n, out) < n) {
+        write_error();
+    }
+    STATS_STOP(write_ns, t);
+    stats.bytes_out += n;
+    stats.write_calls++;
+}
+
+/* Flush standard output, or close the -o file */
+static void close_output(FILE *out) {
+    if (out == stdout ? fflush(out) != 0 : fclose(out) != 0) {
+        write_error();
+    }
+}
+
+void do_encode(FILE *in, const params_t *params) {
+    const char *infile = params->input_file;
+    const char *outfile = params->output_file;
+    size_t wrap_column = (size_t)params->wrap_column;
+    encoding_type_t encoding_type = params->encoding_type;
+    FILE *out = stdout;
+    output_map_t map;
+    int mapped = 0;
+    unsigned long long insize = 0;
+    index_writer_t index;
+    index_writer_t *ix = NULL;
+    arena_t arena;
+    unsigned char *inbuf;
+    unsigned char *outbuf;
+    basenc_stream_t *stream;
+    basenc_status_t status;
+    size_t sum;
+    int at_end;
+    int sparse;
+    unsigned long long t;
+
+    size_t outbuf_size;
+    switch (encoding_type) {
+        case ENC_BASE64:
+        case ENC_BASE64URL:
+            outbuf_size = ((ENC_BLOCKSIZE + 2) / 3) * 4 + 1;
+            break;
+        case ENC_BASE32:
+        case ENC_BASE32HEX:
+            outbuf_size = ((ENC_BLOCKSIZE + 4) / 5) * 8 + 1;
+            break;
+        case ENC_BASE16:
+            outbuf_size = ENC_BLOCKSIZE * 2 + 1;
+            break;
+        case ENC_BASE2MSBF:
+        case ENC_BASE2LSBF:
+            outbuf_size = ENC_BLOCKSIZE * 8 + 1;
+            break;
+        case ENC_Z85:
+            outbuf_size = ((ENC_BLOCKSIZE + 3) / 4) * 5 + 1;
+            break;
+        case ENC_BASE45:
+            outbuf_size = ((ENC_BLOCKSIZE + 1) / 2) * 3 + 1;
+            break;
+        default:
+            exit_with_error("unknown encoding type", NULL);
+    }
+    if (wrap_column > 0) {
+        outbuf_size += outbuf_size / wrap_column + 1;
+    }
+
+    arena_init(&arena, ARENA_ROUND(ENC_BLOCKSIZE) + ARENA_ROUND(outbuf_size) + ARENA_ROUND(sizeof(basenc_stream_t)));
+    inbuf = (unsigned char *)arena_alloc(&arena, ENC_BLOCKSIZE);
+    outbuf = (unsigned char *)arena_alloc(&arena, outbuf_size);
+    stream = (basenc_stream_t *)arena_alloc(&arena, sizeof(basenc_stream_t));
+
+    basenc_stream_init(stream, encoding_type, 0, wrap_column, 0);
+    stats.kernel = stream->kernel;
+    sparse = input_sparse(in);
+    checksum_init(params);
+
+    if (outfile) {
+        int mappable = input_regular_size(in, &insize) == 0 && (encoding_type != ENC_Z85 || insize % 4 == 0);
+        mapped = output_open(&map, outfile, in, mappable ? encoded_size(encoding_type, insize, wrap_column) : 0,
+                             mappable, &out) == 0;
+        stats.output = mapped ? "mmap" : "file";
+    }
+
+    if (params->write_index) {
+        ix = &index;
+        index_open(ix, params->write_index, encoding_type, params->index_interval);
+    }
+
+    if (mapped) {
+        size_t written = encode_mapped(in, &map, insize, stream, inbuf, ix, sparse);
+        index_feed(ix, map.base, written);
+        STATS_START(t);
+        output_map_close(&map, written);
+        STATS_STOP(write_ns, t);
+        status = stream->error ? BASENC_ERROR : BASENC_DONE;
+    } else {
+        index_add_position(ix, 0, 0, wrap_column, 0);
+        do {
+            STATS_START(t);
+            sum = read_block(in, inbuf, ENC_BLOCKSIZE, sparse);
+            STATS_STOP(read_ns, t);
+            stats.bytes_in += sum;
+            checksum_update(inbuf, sum);
+            at_end = feof(in) || ferror(in);
+
+            const unsigned char *next = inbuf;
+            size_t left = sum;
+            do {
+                unsigned char *dst = outbuf;
+                size_t room = outbuf_size;
+
+                STATS_START(t);
+                status = basenc_stream_run(stream, &next, &left, &dst, &room, at_end);
+                STATS_STOP(transform_ns, t);
+                write_block(out, outbuf, outbuf_size - room);
+                index_feed(ix, outbuf, outbuf_size - room);
+            } while (status == BASENC_NEED_OUTPUT);
+
+            index_add_position(ix, stats.bytes_out, stats.bytes_in, wrap_column, stream->column);
+        } while (status == BASENC_NEED_INPUT);
+    }
+
+    if (status == BASENC_ERROR) {
+        const char *error = stream->error;
+        arena_release(&arena);
+        exit_with_error(error, NULL);
+    }
+
+    if (ferror(in)) {
+        arena_release(&arena);
+        exit_with_error("read error", NULL);
+    }
+
+    arena_release(&arena);
+
+    if (fclose(in) != 0) {
+        if (strcmp(infile, "-") == 0) {
+            exit_with_error("closing standard input", NULL);
+        } else {
+            exit_with_error(infile, strerror(errno));
+        }
+    }
+
+    close_output(out);
+    if (ix) {
+        ix->mtime = index_mtime(stdout, outfile);
+    }
+    index_close(ix, stats.bytes_out, stats.bytes_in);
+    checksum_report(params);
+
+    if (stats_enabled) {
+        print_stats("encode", encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+void do_decode(FILE *in, const params_t *params) {
+    const char *infile = params->input_file;
+    const char *outfile = params->output_file;
+    int ignore_garbage = params->ignore_garbage;
+    encoding_type_t encoding_type = params->encoding_type;
+    unsigned long long skip_bytes = params->skip_bytes;
+    unsigned long long count_bytes = params->count_bytes;
+    FILE *out = stdout;
+    output_map_t map;
+    int mapped = 0;
+    unsigned long long insize = 0;
+    size_t pos = 0;
+    arena_t arena;
+    char *inbuf;
+    unsigned char *outbuf;
+    size_t sum;
+    unsigned long long t;
+    basenc_stream_t *stream;
+    basenc_status_t status;
+    decoder_t *dec;
+    index_writer_t index;
+    index_writer_t *ix = NULL;
+    index_entry_t entry;
+    verify_t verify;
+
+    size_t inbuf_size;
+    switch (encoding_type) {
         case ENC_BASE64:
         case ENC_BASE64URL:
-            outbuf_size = ((ENC_BLOCKSIZE + 2) / 3) * 4 + 1;
+            inbuf_size = DEC_BLOCKSIZE * 4 / 3 + 4;
+            break;
+        case ENC_BASE32:
+        case ENC_BASE32HEX:
+            inbuf_size = DEC_BLOCKSIZE * 8 / 5 + 8;
+            break;
+        case ENC_BASE16:
+            inbuf_size = DEC_BLOCKSIZE * 2 + 2;
+            break;
+        case ENC_BASE2MSBF:
+        case ENC_BASE2LSBF:
+            inbuf_size = DEC_BLOCKSIZE * 8 + 8;
+            break;
+        case ENC_Z85:
+            inbuf_size = DEC_BLOCKSIZE * 5 / 4 + 5;
+            break;
+        case ENC_BASE45:
+            inbuf_size = DEC_BLOCKSIZE * 3 / 2 + 3;
+            break;
+        default:
+            exit_with_error("unknown encoding type", NULL);
+    }
+
+    // One spare quantum lets the stream take a whole block in one step
+    size_t outbuf_size = (size_t)decoder_max_output(encoding_type, inbuf_size) + decoder_ops(encoding_type)->quantum_bytes;
+    size_t seek_size = skip_bytes > 0 && !params->index_file ? DEC_SEEK_WINDOW : 0;
+    arena_init(&arena, ARENA_ROUND(inbuf_size) + ARENA_ROUND(outbuf_size) + ARENA_ROUND(sizeof(basenc_stream_t)) +
+                       ARENA_ROUND(seek_size));
+    inbuf = (char *)arena_alloc(&arena, inbuf_size);
+    outbuf = (unsigned char *)arena_alloc(&arena, outbuf_size);
+    stream = (basenc_stream_t *)arena_alloc(&arena, sizeof(basenc_stream_t));
+
+    basenc_stream_init(stream, encoding_type, 1, 0, ignore_garbage);
+    dec = &stream->dec;
+    stats.kernel = stream->kernel;
+    checksum_init(params);
+
+    // Decoded bytes still to drop and to keep
+    unsigned long long skip_left = skip_bytes;
+    unsigned long long count_left = count_bytes;
+    if (skip_bytes > 0 && params->index_file) {
+        skip_left -= decoder_seek_index(dec, in, params->index_file, encoding_type, skip_bytes);
+    } else if (skip_bytes > 0) {
+        skip_left -= decoder_seek(dec, in, skip_bytes, (unsigned char *)arena_alloc(&arena, seek_size));
+    }
+
+    // Indexing an existing file: entries are taken at block boundaries with the decoder state there
+    if (params->write_index) {
+        ix = &index;
+        index_open(ix, params->write_index, encoding_type, params->index_interval);
+        ix->mtime = index_mtime(in, NULL);
+        entry.encoded = 0;
+        entry.decoded = 0;
+        decoder_save(dec, &entry);
+        index_add(ix, &entry);
+    }
+
+    if (params->verify) {
+        verify_open(&verify, params->verify);
+        stats.output = "verify";
+    }
+
+    // Decode straight into a mapped file sized for the worst case, cut to length at the end.
+    // A bounded range is small, so it goes through stdio rather than a file sized for the rest of the input.
+    if (outfile) {
+        int mappable = count_bytes == DEC_COUNT_ALL && input_regular_size(in, &insize) == 0;
+        mapped = output_open(&map, outfile, in, mappable ? decoder_max_output(encoding_type, insize) : 0, mappable,
+                             &out) == 0;
+        stats.output = mapped ? "mmap" : "file";
+    }
+
+    int at_end;
+    do {
+        // A mapped output only has room for the input size it was sized from
+        size_t want = mapped && insize < inbuf_size ? (size_t)insize : inbuf_size;
+
+        sum = 0;
+        STATS_START(t);
+        do {
+            size_t n = read_input(inbuf + sum, want - sum, in);
+            sum += n;
+            stats.read_calls++;
+        } while (!input_eof(in) && !ferror(in) && sum < want);
+        STATS_STOP(read_ns, t);
+        stats.bytes_in += sum;
+        index_feed(ix, (const unsigned char *)inbuf, sum);
+        if (mapped) {
+            insize -= sum;
+        }
+        at_end = input_eof(in) || ferror(in) || (mapped && insize == 0);
+
+        const unsigned char *next = (const unsigned char *)inbuf;
+        size_t left = sum;
+        do {
+            unsigned char *dst = mapped ? map.base + pos : outbuf;
+            unsigned char *end = dst;
+            size_t room = mapped ? map.size - pos : outbuf_size;
+
+            STATS_START(t);
+            status = basenc_stream_run(stream, &next, &left, &end, &room, at_end);
+            STATS_STOP(transform_ns, t);
+
+            size_t decoded_len = (size_t)(end - dst);
+            size_t drop = skip_left < decoded_len ? (size_t)skip_left : decoded_len;
+            size_t keep = decoded_len - drop;
+            if (keep > count_left) {
+                keep = (size_t)count_left;
+            }
+            skip_left -= drop;
+            count_left -= keep;
+
+            // Bytes decoded before invalid input are still written, as GNU basenc does
+            if (mapped) {
+                if (drop > 0) {
+                    memmove(dst, dst + drop, keep);
+                }
+                checksum_update(dst, keep);
+                pos += keep;
+                stats.bytes_out += keep;
+            } else if (params->verify) {
+                checksum_update(outbuf + drop, keep);
+                if (verify_compare(&verify, outbuf + drop, keep) != 0) {
+                    arena_release(&arena);
+                    verify_fail(&verify);
+                }
+            } else {
+                checksum_update(outbuf + drop, keep);
+                write_block(out, outbuf + drop, keep);
+            }
+        } while (status == BASENC_NEED_OUTPUT && count_left > 0);
+
+        // The range is complete; whatever follows is not read
+        if (count_left == 0) {
+            break;
+        }
+
+        if (ix && status != BASENC_ERROR) {
+            entry.encoded = stats.bytes_in;
+            entry.decoded = stats.bytes_out;
+            decoder_save(dec, &entry);
+            index_add(ix, &entry);
+        }
+
+        if (status == BASENC_ERROR) {
+            const char *error = stream->error;
+            arena_release(&arena);
+            if (mapped) {
+                output_map_close(&map, pos);
+            } else {
+                close_output(out);
+            }
+            exit_with_error(error, NULL);
+        }
+    } while (status == BASENC_NEED_INPUT);
+
+    if (ferror(in)) {
+        arena_release(&arena);
+        exit_with_error("read error", NULL);
+    }
+
+    arena_release(&arena);
+
+    if (fclose(in) != 0) {
+        if (strcmp(infile, "-") == 0) {
+            exit_with_error("closing standard input", NULL);
+        } else {
+            exit_with_error(infile, strerror(errno));
+        }
+    }
+
+    STATS_START(t);
+    if (mapped) {
+        output_map_close(&map, pos);
+    } else {
+        close_output(out);
+    }
+    STATS_STOP(write_ns, t);
+    index_close(ix, stats.bytes_in, stats.bytes_out);
+    if (params->verify) {
+        verify_close(&verify, params->verbose);
+    }
+    checksum_report(params);
+
+    if (stats_enabled) {
+        print_stats("decode", encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * Transcoding (--from, --to).  The input is decoded a block at a time into
+ * an intermediate buffer small enough to stay in cache, and each decoded
+ * slice goes straight into the encoding stream, so no binary stage leaves
+ * the process.  As with a decode piped into an encode, the bytes decoded
+ * before invalid input are still encoded and written.
+ */
+#define TRANSCODE_BLOCKSIZE (64 * 1024)
+
+void do_transcode(FILE *in, const params_t *params) {
+    const char *infile = params->input_file;
+    const char *outfile = params->output_file;
+    encoding_type_t from = params->encoding_type;
+    encoding_type_t to = params->to_encoding;
+    size_t wrap_column = (size_t)params->wrap_column;
+    FILE *out = stdout;
+    arena_t arena;
+    unsigned char *inbuf;
+    unsigned char *midbuf;
+    unsigned char *outbuf;
+    basenc_stream_t *decoder;
+    basenc_stream_t *encoder;
+    basenc_status_t status;
+    basenc_status_t encoded;
+    static char kernel[64];
+    size_t sum;
+    int at_end;
+    unsigned long long t;
+
+    size_t mid_size = (size_t)decoder_max_output(from, TRANSCODE_BLOCKSIZE);
+    size_t outbuf_size = (size_t)encoded_size(to, mid_size, wrap_column) + 1;
+
+    arena_init(&arena, ARENA_ROUND(TRANSCODE_BLOCKSIZE) + ARENA_ROUND(mid_size) + ARENA_ROUND(outbuf_size) +
+                       2 * ARENA_ROUND(sizeof(basenc_stream_t)));
+    inbuf = (unsigned char *)arena_alloc(&arena, TRANSCODE_BLOCKSIZE);
+    midbuf = (unsigned char *)arena_alloc(&arena, mid_size);
+    outbuf = (unsigned char *)arena_alloc(&arena, outbuf_size);
+    decoder = (basenc_stream_t *)arena_alloc(&arena, sizeof(basenc_stream_t));
+    encoder = (basenc_stream_t *)arena_alloc(&arena, sizeof(basenc_stream_t));
+
+    basenc_stream_init(decoder, from, 1, 0, params->ignore_garbage);
+    basenc_stream_init(encoder, to, 0, wrap_column, 0);
+    snprintf(kernel, sizeof(kernel), "%s to %s", decoder->kernel, encoder->kernel);
+    stats.kernel = kernel;
+
+    if (outfile) {
+        output_map_t unmapped;
+        output_open(&unmapped, outfile, in, 0, 0, &out);
+        stats.output = "file";
+    }
+
+    do {
+        sum = 0;
+        STATS_START(t);
+        do {
+            size_t n = fread(inbuf + sum, 1, TRANSCODE_BLOCKSIZE - sum, in);
+            sum += n;
+            stats.read_calls++;
+        } while (!feof(in) && !ferror(in) && sum < TRANSCODE_BLOCKSIZE);
+        STATS_STOP(read_ns, t);
+        stats.bytes_in += sum;
+        at_end = feof(in) || ferror(in);
+
+        const unsigned char *next = inbuf;
+        size_t left = sum;
+        do {
+            unsigned char *mid = midbuf;
+            size_t mid_room = mid_size;
+
+            STATS_START(t);
+            status = basenc_stream_run(decoder, &next, &left, &mid, &mid_room, at_end);
+            STATS_STOP(transform_ns, t);
+
+            // The encoding ends with the decoded data, including when invalid input cut it short
+            int finish = status == BASENC_DONE || status == BASENC_ERROR;
+            const unsigned char *slice = midbuf;
+            size_t slice_len = mid_size - mid_room;
+            do {
+                unsigned char *dst = outbuf;
+                size_t room = outbuf_size;
+
+                STATS_START(t);
+                encoded = basenc_stream_run(encoder, &slice, &slice_len, &dst, &room, finish);
+                STATS_STOP(transform_ns, t);
+                write_block(out, outbuf, outbuf_size - room);
+            } while (encoded == BASENC_NEED_OUTPUT);
+
+            if (encoded == BASENC_ERROR) {
+                const char *error = encoder->error;
+                arena_release(&arena);
+                close_output(out);
+                exit_with_error(error, NULL);
+            }
+        } while (status == BASENC_NEED_OUTPUT);
+
+        if (status == BASENC_ERROR) {
+            const char *error = decoder->error;
+            arena_release(&arena);
+            close_output(out);
+            exit_with_error(error, NULL);
+        }
+    } while (status == BASENC_NEED_INPUT);
+
+    if (ferror(in)) {
+        arena_release(&arena);
+        exit_with_error("read error", NULL);
+    }
+
+    arena_release(&arena);
+
+    if (fclose(in) != 0) {
+        if (strcmp(infile, "-") == 0) {
+            exit_with_error("closing standard input", NULL);
+        } else {
+            exit_with_error(infile, strerror(errno));
+        }
+    }
+
+    STATS_START(t);
+    close_output(out);
+    STATS_STOP(write_ns, t);
+
+    if (stats_enabled) {
+        print_stats("transcode", from);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * Several encodings of one input (--emit).  Each block is read once and
+ * every output's stream encodes it in turn while it is still in cache.
+ * A file output is mapped and written in place when the input size is
+ * known, as with -o; the outputs share the block and one staging buffer
+ * for the rest.
+ */
+typedef struct {
+    FILE *file;
+    output_map_t map;
+    int mapped;
+    size_t pos;                 /* bytes written to the mapping */
+} emit_output_t;
+
+/* Outputs opened so far; any exit before they are closed cuts the mapped ones to what was written */
+static emit_output_t *emit_opened;
+static size_t emit_opened_count;
+
+static void emit_abandon(void) {
+    for (size_t k = 0; k < emit_opened_count; k++) {
+        if (emit_opened[k].mapped) {
+            output_map_abandon(&emit_opened[k].map, emit_opened[k].pos);
+        }
+    }
+    emit_opened_count = 0;
+}
+
+void do_emit(FILE *in, const params_t *params) {
+    const char *infile = params->input_file;
+    size_t count = (size_t)params->emit_count;
+    emit_output_t outs[EMIT_MAX];
+    unsigned long long insize = 0;
+    int sized;
+    arena_t arena;
+    unsigned char *inbuf;
+    unsigned char *outbuf;
+    basenc_stream_t *streams;
+    basenc_status_t status;
+    static char kernels[EMIT_MAX * 24];
+    size_t kernels_len = 0;
+    size_t outbuf_size = 0;
+    size_t sum;
+    size_t k;
+    int at_end;
+    int pending;
+    unsigned long long t;
+
+    for (k = 0; k < count; k++) {
+        size_t size = (size_t)encoded_size(params->emit[k].encoding_type, ENC_BLOCKSIZE, params->emit[k].wrap_column) + 1;
+        if (size > outbuf_size) {
+            outbuf_size = size;
+        }
+    }
+
+    arena_init(&arena, ARENA_ROUND(ENC_BLOCKSIZE) + ARENA_ROUND(outbuf_size) +
+                       ARENA_ROUND(count * sizeof(basenc_stream_t)));
+    inbuf = (unsigned char *)arena_alloc(&arena, ENC_BLOCKSIZE);
+    outbuf = (unsigned char *)arena_alloc(&arena, outbuf_size);
+    streams = (basenc_stream_t *)arena_alloc(&arena, count * sizeof(basenc_stream_t));
+
+    sized = input_regular_size(in, &insize) == 0;
+    for (k = 0; k < count && sized; k++) {
+        if (params->emit[k].encoding_type == ENC_Z85 && insize % 4 != 0) {
+            arena_release(&arena);
+            exit_with_error("invalid input: Z85 encoding input length must be a multiple of 4", NULL);
+        }
+    }
+
+    emit_opened = outs;
+    atexit(emit_abandon);
+    for (k = 0; k < count; k++) {
+        const emit_t *emit = &params->emit[k];
+        emit_output_t *out = &outs[k];
+
+        basenc_stream_init(&streams[k], emit->encoding_type, 0, emit->wrap_column, 0);
+        kernels_len += (size_t)snprintf(kernels + kernels_len, sizeof(kernels) - kernels_len, "%s%s",
+                                        k > 0 ? ", " : "", streams[k].kernel);
+        out->file = stdout;
+        out->mapped = 0;
+        out->pos = 0;
+        if (strcmp(emit->path, "-") == 0) {
+            continue;
+        }
+        out->mapped = output_open(&out->map, emit->path, in,
+                                  sized ? encoded_size(emit->encoding_type, insize, emit->wrap_column) : 0,
+                                  sized, &out->file) == 0;
+        emit_opened_count = k + 1;
+    }
+    stats.kernel = kernels;
+    stats.output = outs[0].mapped ? "mmap" : outs[0].file == stdout ? "stdout" : "file";
+
+    do {
+        // A mapped output only has room for the input size it was sized from
+        size_t want = sized && insize < ENC_BLOCKSIZE ? (size_t)insize : ENC_BLOCKSIZE;
+
+        sum = 0;
+        STATS_START(t);
+        do {
+            size_t n = fread(inbuf + sum, 1, want - sum, in);
+            sum += n;
+            stats.read_calls++;
+        } while (!feof(in) && !ferror(in) && sum < want);
+        STATS_STOP(read_ns, t);
+        stats.bytes_in += sum;
+        if (sized) {
+            insize -= sum;
+        }
+        at_end = feof(in) || ferror(in) || (sized && insize == 0);
+
+        pending = 0;
+        for (k = 0; k < count; k++) {
+            emit_output_t *out = &outs[k];
+            const unsigned char *next = inbuf;
+            size_t left = sum;
+            do {
+                unsigned char *start = out->mapped ? out->map.base + out->pos : outbuf;
+                unsigned char *dst = start;
+                size_t room = out->mapped ? out->map.size - out->pos : outbuf_size;
+
+                STATS_START(t);
+                status = basenc_stream_run(&streams[k], &next, &left, &dst, &room, at_end);
+                STATS_STOP(transform_ns, t);
+                if (out->mapped) {
+                    out->pos += (size_t)(dst - start);
+                    stats.bytes_out += (size_t)(dst - start);
+                } else {
+                    write_block(out->file, outbuf, (size_t)(dst - start));
+                }
+            } while (status == BASENC_NEED_OUTPUT && !out->mapped);
+
+            if (status == BASENC_ERROR || status == BASENC_NEED_OUTPUT) {
+                const char *error = status == BASENC_ERROR ? streams[k].error : "input changed size while encoding";
+                arena_release(&arena);
+                exit_with_error(error, params->emit[k].path);
+            }
+            pending |= status == BASENC_NEED_INPUT;
+        }
+    } while (pending);
+
+    if (ferror(in)) {
+        arena_release(&arena);
+        exit_with_error("read error", NULL);
+    }
+
+    arena_release(&arena);
+
+    if (fclose(in) != 0) {
+        if (strcmp(infile, "-") == 0) {
+            exit_with_error("closing standard input", NULL);
+        } else {
+            exit_with_error(infile, strerror(errno));
+        }
+    }
+
+    STATS_START(t);
+    for (k = 0; k < count; k++) {
+        if (outs[k].mapped) {
+            outs[k].mapped = 0;
+            output_map_close(&outs[k].map, outs[k].pos);
+        } else {
+            close_output(outs[k].file);
+        }
+    }
+    STATS_STOP(write_ns, t);
+
+    if (stats_enabled) {
+        print_stats("encode", params->emit[0].encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * --check and --size.  Decoding validates the input through the checker
+ * and reports the first invalid byte; encoding only needs the input
+ * size, taken from fstat when the input is a regular file.
+ */
+#define CHECK_BLOCKSIZE (64 * 1024)
+
+void do_check(FILE *in, const params_t *params) {
+    const char *infile = params->input_file;
+    encoding_type_t encoding_type = params->encoding_type;
+    unsigned long long size = 0;
+    unsigned long long t;
+    arena_t arena;
+    unsigned char *inbuf;
+    checker_t checker;
+    size_t sum;
+    int at_end;
+
+    arena_init(&arena, ARENA_ROUND(CHECK_BLOCKSIZE));
+    inbuf = (unsigned char *)arena_alloc(&arena, CHECK_BLOCKSIZE);
+    if (params->decode) {
+        checker_init(&checker, encoding_type, params->ignore_garbage);
+        stats.kernel = checker.quantum ? "scalar" : isa_name(detect_isa());
+    }
+    stats.output = "none";
+
+    if (!params->decode && input_regular_size(in, &size) == 0) {
+        stats.bytes_in = size;
+    } else {
+        do {
+            sum = 0;
+            STATS_START(t);
+            do {
+                size_t n = read_input(inbuf + sum, CHECK_BLOCKSIZE - sum, in);
+                sum += n;
+                stats.read_calls++;
+            } while (!input_eof(in) && !ferror(in) && sum < CHECK_BLOCKSIZE);
+            STATS_STOP(read_ns, t);
+            stats.bytes_in += sum;
+            at_end = input_eof(in) || ferror(in);
+
+            STATS_START(t);
+            if (params->decode && checker_run(&checker, inbuf, sum) != 0) {
+                arena_release(&arena);
+                fprintf(stderr, "%s: %s at byte %llu\n", PROGRAM_NAME, checker.error, checker.error_at);
+                exit(EXIT_FAILURE);
+            }
+            STATS_STOP(transform_ns, t);
+        } while (!at_end);
+        size = stats.bytes_in;
+    }
+
+    if (ferror(in)) {
+        arena_release(&arena);
+        exit_with_error("read error", NULL);
+    }
+
+    arena_release(&arena);
+
+    if (fclose(in) != 0) {
+        if (strcmp(infile, "-") == 0) {
+            exit_with_error("closing standard input", NULL);
+        } else {
+            exit_with_error(infile, strerror(errno));
+        }
+    }
+
+    if (params->decode) {
+        if (checker_finish(&checker) != 0) {
+            fprintf(stderr, "%s: %s at byte %llu\n", PROGRAM_NAME, checker.error, checker.error_at);
+            exit(EXIT_FAILURE);
+        }
+        size = checker.decoded;
+    } else {
+        if (encoding_type == ENC_Z85 && size % 4 != 0) {
+            exit_with_error("invalid input: Z85 encoding input length must be a multiple of 4", NULL);
+        }
+        size = encoded_size(encoding_type, size, (size_t)params->wrap_column);
+    }
+
+    if (params->size) {
+        printf("%llu\n", size);
+        close_output(stdout);
+    }
+
+    if (stats_enabled) {
+        print_stats(params->decode ? "check" : "size", encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+
+#define LINE_BLOCKSIZE (64 * 1024)
+
+/* Grow BUF to at least SIZE bytes, doubling */
+static unsigned char *grow_buffer(unsigned char *buf, size_t *capacity, size_t size) {
+    size_t n = *capacity ? *capacity : 4096;
+
+    if (size <= *capacity) {
+        return buf;
+    }
+    while (n < size) {
+        n *= 2;
+    }
+    buf = (unsigned char *)realloc(buf, n);
+    if (!buf) {
+        exit_with_error("memory allocation failed", NULL);
+    }
+    *capacity = n;
+    return buf;
+}
+
+/* Drop newlines, and other non-alphabet bytes with -i, from base58 text; returns -1 on an invalid byte */
+static long long base58_clean(unsigned char *p, size_t len, int ignore_garbage) {
+    size_t o = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (base58_decode_table[p[i]] != DEC_INVALID) {
+            p[o++] = p[i];
+        } else if (p[i] != '\n' && p[i] != '\r' && !ignore_garbage) {
+            return -1;
+        }
+    }
+    return (long long)o;
+}
+
+/*
+ * Convert one base58 item, using *SCRATCH (grown as needed) for the limbs
+ * and the result; sets *OUT to the result and returns its length, or -1
+ * for invalid input.  Decoding cleans IN in place.
+ */
+static long long base58_convert(unsigned char *in, size_t len, int decode, int ignore_garbage,
+                                unsigned char **scratch, size_t *capacity, unsigned char **out) {
+    long long n = decode ? base58_clean(in, len, ignore_garbage) : (long long)len;
+    size_t limbs_size;
+
+    if (n < 0) {
+        return -1;
+    }
+    len = (size_t)n;
+    limbs_size = BASE58_LIMBS_MAX(len) * sizeof(unsigned int);
+    *scratch = grow_buffer(*scratch, capacity, limbs_size + (decode ? BASE58_DECODED_MAX(len) : BASE58_ENCODED_MAX(len)));
+    *out = *scratch + limbs_size;
+    if (decode) {
+        return base58_decode(in, len, *out, (unsigned int *)*scratch);
+    }
+    return (long long)base58_encode(in, len, (char *)*out, (unsigned int *)*scratch);
+}
+
+static FILE *open_output(FILE *in, const char *outfile) {
+    output_map_t unmapped;
+    FILE *out;
+
+    if (!outfile) {
+        return stdout;
+    }
+    output_open(&unmapped, outfile, in, 0, 0, &out);
+    stats.output = "file";
+    return out;
+}
+
+static void close_input(FILE *in, const char *infile) {
+    if (ferror(in)) {
+        exit_with_error("read error", NULL);
+    }
+    if (fclose(in) != 0) {
+        if (strcmp(infile, "-") == 0) {
+            exit_with_error("closing standard input", NULL);
+        } else {
+            exit_with_error(infile, strerror(errno));
+        }
+    }
+}
+
+/* Base58 of the whole input: one number, so all of it is read first */
+void do_base58(FILE *in, const params_t *params) {
+    size_t wrap_column = (size_t)params->wrap_column;
+    FILE *out = open_output(in, params->output_file);
+    unsigned char *buf = NULL;
+    size_t capacity = 0;
+    size_t len = 0;
+    unsigned char *scratch = NULL;
+    size_t scratch_size = 0;
+    unsigned char *result;
+    long long n;
+    unsigned long long t;
+
+    stats.kernel = "scalar";
+    STATS_START(t);
+    do {
+        buf = grow_buffer(buf, &capacity, len + LINE_BLOCKSIZE);
+        len += fread(buf + len, 1, capacity - len, in);
+        stats.read_calls++;
+    } while (!feof(in) && !ferror(in));
+    STATS_STOP(read_ns, t);
+    stats.bytes_in = len;
+    close_input(in, params->input_file);
+
+    STATS_START(t);
+    n = base58_convert(buf, len, params->decode, params->ignore_garbage, &scratch, &scratch_size, &result);
+    STATS_STOP(transform_ns, t);
+    if (n < 0) {
+        exit_with_error("invalid input", NULL);
+    }
+
+    if (params->decode || wrap_column == 0) {
+        write_block(out, result, (size_t)n);
+    } else {
+        for (size_t p = 0; p < (size_t)n; p += wrap_column) {
+            write_block(out, result + p, (size_t)n - p < wrap_column ? (size_t)n - p : wrap_column);
+            write_block(out, "\n", 1);
+        }
+    }
+    free(buf);
+    free(scratch);
+    close_output(out);
+
+    if (stats_enabled) {
+        print_stats(params->decode ? "decode" : "encode", params->encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/* Copy N characters to DST, starting a new line before any character past WRAP columns */
+static size_t wrap_copy(char *dst, const char *src, size_t n, size_t wrap, size_t *column) {
+    char *o = dst;
+
+    if (wrap == 0) {
+        memcpy(dst, src, n);
+        return n;
+    }
+    while (n > 0) {
+        size_t k;
+        if (*column == wrap) {
+            *o++ = '\n';
+            *column = 0;
+        }
+        k = wrap - *column < n ? wrap - *column : n;
+        memcpy(o, src, k);
+        o += k;
+        src += k;
+        n -= k;
+        *column += k;
+    }
+    return (size_t)(o - dst);
+}
+
+/* Ascii85 of the whole input, streamed block by block */
+void do_ascii85(FILE *in, const params_t *params) {
+    // Lines of at least two columns keep "<~" together
+    size_t wrap_column = params->wrap_column == 1 ? 2 : (size_t)params->wrap_column;
+    FILE *out = open_output(in, params->output_file);
+    size_t inbuf_size = ENC_BLOCKSIZE;
+    size_t encoded_size = ASCII85_ENCODED_MAX(inbuf_size);
+    size_t outbuf_size = params->decode ? ASCII85_DECODED_MAX(inbuf_size) : encoded_size + encoded_size + 8;
+    arena_t arena;
+    unsigned char *inbuf;
+    char *encoded = NULL;
+    unsigned char *outbuf;
+    size_t column = 0;
+    size_t n;
+    ascii85_t a;
+    int at_end;
+    unsigned long long t;
+
+    arena_init(&arena, ARENA_ROUND(inbuf_size) + ARENA_ROUND(outbuf_size) +
+                       (params->decode ? 0 : ARENA_ROUND(encoded_size)));
+    inbuf = (unsigned char *)arena_alloc(&arena, inbuf_size);
+    outbuf = (unsigned char *)arena_alloc(&arena, outbuf_size);
+    if (!params->decode) {
+        encoded = (char *)arena_alloc(&arena, encoded_size);
+    }
+    ascii85_init(&a, params->ignore_garbage);
+    stats.kernel = a.kernel;
+
+    if (!params->decode) {
+        write_block(out, outbuf, wrap_copy((char *)outbuf, "<~", 2, wrap_column, &column));
+    }
+
+    do {
+        size_t sum = 0;
+
+        STATS_START(t);
+        do {
+            n = fread(inbuf + sum, 1, inbuf_size - sum, in);
+            sum += n;
+            stats.read_calls++;
+        } while (!feof(in) && !ferror(in) && sum < inbuf_size);
+        STATS_STOP(read_ns, t);
+        stats.bytes_in += sum;
+        at_end = feof(in) || ferror(in);
+
+        STATS_START(t);
+        if (params->decode) {
+            n = ascii85_decode(&a, inbuf, sum, outbuf, at_end);
+        } else {
+            n = ascii85_encode(&a, inbuf, sum, encoded, at_end);
+            n = wrap_copy((char *)outbuf, encoded, n, wrap_column, &column);
+        }
+        STATS_STOP(transform_ns, t);
+
+        // Bytes decoded before invalid input are still written, as for the other encodings
+        write_block(out, outbuf, n);
+        if (a.error) {
+            close_output(out);
+            arena_release(&arena);
+            exit_with_error(a.error, NULL);
+        }
+    } while (!at_end);
+    close_input(in, params->input_file);
+
+    if (!params->decode) {
+        // "~>" is not split across lines
+        n = 0;
+        if (wrap_column > 0 && column + 2 > wrap_column) {
+            outbuf[n++] = '\n';
+            column = 0;
+        }
+        memcpy(outbuf + n, "~>", 2);
+        n += 2;
+        if (wrap_column > 0) {
+            outbuf[n++] = '\n';
+        }
+        write_block(out, outbuf, n);
+    }
+    arena_release(&arena);
+    close_output(out);
+
+    if (stats_enabled) {
+        print_stats(params->decode ? "decode" : "encode", params->encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * uuencode: "begin MODE NAME", then lines of a length character and up to
+ * 45 bytes as sextets, each written as ' ' + value ('`' for zero), then a
+ * zero-length line and "end".  The sextet code is base64 with another
+ * alphabet, so the line bodies go through the base64 kernels: encoding
+ * converts many 45-byte lines per call and then inserts the length
+ * characters and newlines, and decoding gathers the bodies of full "M"
+ * lines into one dense buffer.
+ */
+#define UU_LINE_BYTES 45
+#define UU_LINE_CHARS 60
+#define UU_BLOCK_LINES 512
+
+/* "begin" header of the encoded file: the input's name and permissions */
+static int uu_header(char *buf, size_t size, const char *infile) {
+    const char *name = infile;
+    unsigned int mode = 0644;
+
+    for (const char *p = infile; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            name = p + 1;
+        }
+    }
+#ifndef _WIN32
+    struct stat st;
+    if (strcmp(infile, "-") != 0 && stat(infile, &st) == 0 && S_ISREG(st.st_mode)) {
+        mode = (unsigned int)st.st_mode & 0777;
+    }
+#endif
+    return snprintf(buf, size, "begin %03o %s\n", mode, name);
+}
+
+void do_uuencode(FILE *in, const params_t *params) {
+    FILE *out = open_output(in, params->output_file);
+    size_t inbuf_size = UU_BLOCK_LINES * UU_LINE_BYTES;
+    size_t outbuf_size = UU_BLOCK_LINES * (UU_LINE_CHARS + 2) + 4096;
+    arena_t arena;
+    unsigned char *inbuf;
+    char *raw;
+    char *outbuf;
+    isa_t isa;
+    encode_fn encode = select_encoder(ENC_UUENCODE, detect_isa(), &isa);
+    int at_end;
+    unsigned long long t;
+
+    arena_init(&arena, ARENA_ROUND(inbuf_size + 2) + ARENA_ROUND(inbuf_size / 3 * 4) + ARENA_ROUND(outbuf_size));
+    inbuf = (unsigned char *)arena_alloc(&arena, inbuf_size + 2);
+    raw = (char *)arena_alloc(&arena, inbuf_size / 3 * 4);
+    outbuf = (char *)arena_alloc(&arena, outbuf_size);
+    stats.kernel = isa_name(isa);
+
+    write_block(out, outbuf, (size_t)uu_header(outbuf, outbuf_size, params->input_file));
+
+    do {
+        size_t sum = 0;
+        size_t n;
+
+        STATS_START(t);
+        do {
+            n = fread(inbuf + sum, 1, inbuf_size - sum, in);
+            sum += n;
+            stats.read_calls++;
+        } while (!feof(in) && !ferror(in) && sum < inbuf_size);
+        STATS_STOP(read_ns, t);
+        stats.bytes_in += sum;
+        at_end = feof(in) || ferror(in);
+
+        STATS_START(t);
+        size_t lines = sum / UU_LINE_BYTES;
+        size_t rest = sum % UU_LINE_BYTES;
+        char *o = outbuf;
+
+        encode(inbuf, lines * UU_LINE_BYTES, raw);
+        for (size_t k = 0; k < lines; k++) {
+            *o++ = uu_chars[UU_LINE_BYTES];
+            memcpy(o, raw + k * UU_LINE_CHARS, UU_LINE_CHARS);
+            o += UU_LINE_CHARS;
+            *o++ = '\n';
+        }
+        // A short last line is zero-padded to whole quanta rather than '=' padded
+        if (rest > 0) {
+            unsigned char *tail = inbuf + lines * UU_LINE_BYTES;
+            memset(tail + rest, 0, 2);
+            *o++ = uu_chars[rest];
+            o += encode(tail, (rest + 2) / 3 * 3, o);
+            *o++ = '\n';
+        }
+        STATS_STOP(transform_ns, t);
+        write_block(out, outbuf, (size_t)(o - outbuf));
+    } while (!at_end);
+    close_input(in, params->input_file);
+
+    write_block(out, "`\nend\n", 6);
+    arena_release(&arena);
+    close_output(out);
+
+    if (stats_enabled) {
+        print_stats("encode", ENC_UUENCODE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+typedef struct {
+    FILE *out;
+    decode_fn bulk;
+    decode_fn quantum;
+    int state;                  /* UU_BEFORE_BEGIN, ... */
+    unsigned char *dense;       /* bodies of full lines waiting for the bulk kernel */
+    size_t dense_lines;
+    unsigned char *outbuf;
+    const char *error;
+} uudecoder_t;
+
+enum { UU_BEFORE_BEGIN, UU_DATA, UU_BEFORE_END, UU_DONE };
+
+/* Decode one line the slow way: any length, short bodies padded with zero sextets */
+static int uu_decode_line(uudecoder_t *u, const unsigned char *line, size_t len) {
+    unsigned char quanta[UU_LINE_CHARS * 2];
+    unsigned char bytes[UU_LINE_BYTES * 2];
+    size_t n, chars;
+
+    if (len > 0 && uu_decode_table[line[0]] == DEC_INVALID) {
+        u->error = "invalid input";
+        return -1;
+    }
+    n = len > 0 ? uu_decode_table[line[0]] : 0;
+    if (n == 0) {
+        u->state = UU_BEFORE_END;
+        return 0;
+    }
+
+    chars = (n + 2) / 3 * 4;
+    len--;
+    if (len > chars) {
+        len = chars;
+    }
+    memcpy(quanta, line + 1, len);
+    memset(quanta + len, '`', chars - len);
+    if (u->quantum(quanta, chars / 4, bytes) != 0) {
+        u->error = "invalid input";
+        return -1;
+    }
+    write_block(u->out, bytes, n);
+    return 0;
+}
+
+/* Decode the gathered full lines; on invalid input, the lines before the bad one are still written */
+static int uu_flush(uudecoder_t *u) {
+    size_t lines = u->dense_lines;
+    unsigned long long t;
+    int bad;
+
+    if (lines == 0) {
+        return 0;
+    }
+    u->dense_lines = 0;
+    STATS_START(t);
+    bad = u->bulk(u->dense, lines * UU_LINE_CHARS / 4, u->outbuf);
+    STATS_STOP(transform_ns, t);
+    if (!bad) {
+        write_block(u->out, u->outbuf, lines * UU_LINE_BYTES);
+        return 0;
+    }
+    for (size_t k = 0; k < lines; k++) {
+        if (u->quantum(u->dense + k * UU_LINE_CHARS, UU_LINE_CHARS / 4, u->outbuf) != 0) {
+            u->error = "invalid input";
+            return -1;
+        }
+        write_block(u->out, u->outbuf, UU_LINE_BYTES);
+    }
+    return 0;
+}
+
+static int uu_line(uudecoder_t *u, const unsigned char *line, size_t len) {
+    if (len > 0 && line[len - 1] == '\r') {
+        len--;
+    }
+    switch (u->state) {
+        case UU_BEFORE_BEGIN:
+            if (len > 6 && memcmp(line, "begin ", 6) == 0 && IN_RANGE(line[6], '0', '7')) {
+                u->state = UU_DATA;
+            }
+            return 0;
+        case UU_DATA:
+            if (len == UU_LINE_CHARS + 1 && line[0] == uu_chars[UU_LINE_BYTES]) {
+                memcpy(u->dense + u->dense_lines * UU_LINE_CHARS, line + 1, UU_LINE_CHARS);
+                if (++u->dense_lines == UU_BLOCK_LINES) {
+                    return uu_flush(u);
+                }
+                return 0;
+            }
+            if (uu_flush(u) != 0) {
+                return -1;
+            }
+            // Some encoders leave out the zero-length line
+            if (len == 3 && memcmp(line, "end", 3) == 0) {
+                u->state = UU_DONE;
+                return 0;
+            }
+            return uu_decode_line(u, line, len);
+        case UU_BEFORE_END:
+            if (len == 3 && memcmp(line, "end", 3) == 0) {
+                u->state = UU_DONE;
+                return 0;
+            }
+            u->error = "invalid input: missing end line";
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+void do_uudecode(FILE *in, const params_t *params) {
+    uudecoder_t u;
+    arena_t arena;
+    unsigned char *buf = NULL;
+    size_t capacity = 0;
+    size_t len = 0;
+    size_t start = 0;
+    isa_t isa;
+    int at_end;
+    unsigned long long t;
+
+    u.out = open_output(in, params->output_file);
+    u.bulk = select_decoder(ENC_UUENCODE, detect_isa(), &isa);
+    u.quantum = kernel_set(ENC_UUENCODE)->decode[ISA_SCALAR];
+    u.state = UU_BEFORE_BEGIN;
+    u.dense_lines = 0;
+    u.error = NULL;
+    arena_init(&arena, ARENA_ROUND(UU_BLOCK_LINES * UU_LINE_CHARS) + ARENA_ROUND(UU_BLOCK_LINES * UU_LINE_BYTES));
+    u.dense = (unsigned char *)arena_alloc(&arena, UU_BLOCK_LINES * UU_LINE_CHARS);
+    u.outbuf = (unsigned char *)arena_alloc(&arena, UU_BLOCK_LINES * UU_LINE_BYTES);
+    stats.kernel = isa_name(isa);
+
+    do {
+        if (start > 0) {
+            memmove(buf, buf + start, len - start);
+            len -= start;
+            start = 0;
+        }
+        buf = grow_buffer(buf, &capacity, len + LINE_BLOCKSIZE);
+
+        STATS_START(t);
+        size_t n = fread(buf + len, 1, capacity - len, in);
+        STATS_STOP(read_ns, t);
+        stats.read_calls++;
+        stats.bytes_in += n;
+        len += n;
+        at_end = n == 0;
+
+        while (u.state != UU_DONE) {
+            unsigned char *line = buf + start;
+            unsigned char *newline;
+            size_t line_len;
+
+            // A full data line is found without searching the rest of the buffer for its newline
+            if (u.state == UU_DATA && len - start > UU_LINE_CHARS + 1 && line[0] == 'M' &&
+                line[UU_LINE_CHARS + 1] == '\n' && !memchr(line, '\n', UU_LINE_CHARS + 1)) {
+                newline = line + UU_LINE_CHARS + 1;
+            } else {
+                newline = (unsigned char *)memchr(line, '\n', len - start);
+            }
+            if (newline) {
+                line_len = (size_t)(newline - line);
+                start += line_len + 1;
+            } else if (at_end && start < len) {
+                line_len = len - start;
+                start = len;
+            } else {
+                break;
+            }
+            if (uu_line(&u, line, line_len) != 0) {
+                close_output(u.out);
+                exit_with_error(u.error, NULL);
+            }
+        }
+    } while (!at_end && u.state != UU_DONE);
+
+    if (uu_flush(&u) != 0) {
+        close_output(u.out);
+        exit_with_error(u.error, NULL);
+    }
+    if (u.state != UU_DONE) {
+        close_output(u.out);
+        exit_with_error(u.state == UU_BEFORE_BEGIN ? "invalid input: no begin line" : "invalid input: missing end line", NULL);
+    }
+    close_input(in, params->input_file);
+    free(buf);
+    arena_release(&arena);
+    close_output(u.out);
+
+    if (stats_enabled) {
+        print_stats("decode", ENC_UUENCODE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * Quoted-printable (RFC 2045).  The encoder copies runs of literal bytes
+ * in bulk, as found by the vector scanner, and escapes the rest as "=XX";
+ * output lines are kept to 76 characters with "=" soft line breaks, the
+ * column tracked across calls as for the other encodings.  Line breaks
+ * ("\n" or "\r\n") are kept, and a space or tab ending a line is escaped.
+ *
+ * The decoder scans for '=' and '\n', copies the runs between them, and
+ * drops the whitespace that transports may add at line ends.  Both stop
+ * early when a decision needs bytes beyond the block, leaving them for
+ * the next call.
+ */
+#define QP_MAX_COLUMN 75        /* characters before a soft line break's '=' */
+
+typedef struct {
+    qp_scan_fn scan;
+    int ignore_garbage;
+    size_t column;
+    const char *kernel;
+    const char *error;
+} qp_t;
+
+/* Upper bounds of the output for LEN bytes or characters */
+#define QP_ENCODED_MAX(len) ((len) * 3 + (len) / 12 + 4)
+#define QP_DECODED_MAX(len) ((len) + 2)
+
+#define QP_SPACE(c) ((c) == ' ' || (c) == '\t')
+
+static void qp_init(qp_t *q, int decode, int ignore_garbage) {
+    isa_t used;
+
+    q->scan = select_qp_scanner(!decode, detect_isa(), &used);
+    q->kernel = isa_name(used);
+    q->ignore_garbage = ignore_garbage;
+    q->column = 0;
+    q->error = NULL;
+}
+
+/* Copy N literal bytes, breaking lines as needed */
+static char *qp_copy(qp_t *q, const unsigned char *in, size_t n, char *o) {
+    while (n > 0) {
+        size_t k;
+        if (q->column == QP_MAX_COLUMN) {
+            memcpy(o, "=\n", 2);
+            o += 2;
+            q->column = 0;
+        }
+        k = QP_MAX_COLUMN - q->column < n ? QP_MAX_COLUMN - q->column : n;
+        memcpy(o, in, k);
+        o += k;
+        in += k;
+        n -= k;
+        q->column += k;
+    }
+    return o;
+}
+
+static char *qp_escape(qp_t *q, unsigned char c, char *o) {
+    if (q->column + 3 > QP_MAX_COLUMN) {
+        memcpy(o, "=\n", 2);
+        o += 2;
+        q->column = 0;
+    }
+    o[0] = '=';
+    o[1] = base16_chars[c >> 4];
+    o[2] = base16_chars[c & 0x0F];
+    q->column += 3;
+    return o + 3;
+}
+
+/*
+ * Encode up to LEN bytes into OUT; returns the bytes consumed and adds the
+ * characters written to *OUTLEN.  Unless FINISH, input is left over when
+ * its encoding depends on what follows.
+ */
+static size_t qp_encode(qp_t *q, const unsigned char *in, size_t len, char *out, size_t *outlen, int finish) {
+    char *o = out + *outlen;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t r = q->scan(in + i, len - i);
+        size_t p = i + r;
+
+        if (r > 0) {
+            // Whether a space or tab ends a line depends on the bytes after the run
+            int line_end, known = 1;
+            if (p == len) {
+                line_end = finish;
+                known = finish;
+            } else if (in[p] == '\r') {
+                line_end = p + 1 < len && in[p + 1] == '\n';
+                known = p + 1 < len || finish;
+            } else {
+                line_end = in[p] == '\n';
+            }
+
+            size_t copy = r;
+            if (!known) {
+                while (copy > 0 && QP_SPACE(in[i + copy - 1])) {
+                    copy--;
+                }
+            } else if (line_end && QP_SPACE(in[p - 1])) {
+                copy--;
+            }
+            o = qp_copy(q, in + i, copy, o);
+            i += copy;
+            if (!known) {
+                break;
+            }
+            if (copy < r) {
+                o = qp_escape(q, in[i], o);
+                i++;
+            }
+            continue;
+        }
+
+        if (in[i] == '\n') {
+            *o++ = '\n';
+            q->column = 0;
+            i++;
+        } else if (in[i] == '\r' && i + 1 == len && !finish) {
             break;
-        case ENC_BASE32:
-        case ENC_BASE32HEX:
-            outbuf_size = ((ENC_BLOCKSIZE + 4) / 5) * 8 + 1;
+        } else if (in[i] == '\r' && i + 1 < len && in[i + 1] == '\n') {
+            memcpy(o, "\r\n", 2);
+            o += 2;
+            q->column = 0;
+            i += 2;
+        } else {
+            o = qp_escape(q, in[i], o);
+            i++;
+        }
+    }
+
+    *outlen = (size_t)(o - out);
+    return i;
+}
+
+#define HEX_VALUE(c) (base16_decode_table[(unsigned char)(c)])
+
+/*
+ * Decode up to LEN characters into OUT; returns the characters consumed
+ * and adds the bytes written to *OUTLEN, with q->error set on invalid
+ * input.  Unless FINISH, input is left over when its meaning depends on
+ * what follows.
+ */
+static size_t qp_decode(qp_t *q, const unsigned char *in, size_t len, unsigned char *out, size_t *outlen, int finish) {
+    unsigned char *o = out + *outlen;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t r = q->scan(in + i, len - i);
+        size_t p = i + r;
+
+        if (p == len || in[p] == '\n') {
+            // Whitespace before a line break is not part of the data
+            size_t keep = r;
+            int crlf = 0;
+            if (p < len || !finish) {
+                if (keep > 0 && in[i + keep - 1] == '\r' && p < len) {
+                    crlf = 1;
+                    keep--;
+                }
+                while (keep > 0 && (QP_SPACE(in[i + keep - 1]) || (p == len && in[i + keep - 1] == '\r'))) {
+                    keep--;
+                }
+            }
+            memcpy(o, in + i, keep);
+            o += keep;
+            if (p == len) {
+                i += keep;
+                if (finish) {
+                    i = len;
+                }
+                break;
+            }
+            if (crlf) {
+                *o++ = '\r';
+            }
+            *o++ = '\n';
+            i = p + 1;
+            continue;
+        }
+
+        // '=' starts an escape or a soft line break
+        memcpy(o, in + i, r);
+        o += r;
+        i = p;
+        if (p + 2 < len && HEX_VALUE(in[p + 1]) < 16 && HEX_VALUE(in[p + 2]) < 16) {
+            *o++ = (unsigned char)(HEX_VALUE(in[p + 1]) << 4 | HEX_VALUE(in[p + 2]));
+            i = p + 3;
+            continue;
+        }
+        size_t j = p + 1;
+        while (j < len && (QP_SPACE(in[j]) || in[j] == '\r')) {
+            j++;
+        }
+        if (j < len && in[j] == '\n') {
+            i = j + 1;
+        } else if (j == len && finish) {
+            i = len;
+        } else if (j == len || (p + 2 >= len && !finish)) {
             break;
-        case ENC_BASE16:
-            outbuf_size = ENC_BLOCKSIZE * 2 + 1;
+        } else if (q->ignore_garbage) {
+            *o++ = '=';
+            i = p + 1;
+        } else {
+            q->error = "invalid input";
+            break;
+        }
+    }
+
+    *outlen = (size_t)(o - out);
+    return i;
+}
+
+/* Quoted-printable of the whole input, streamed block by block */
+void do_qp(FILE *in, const params_t *params) {
+    FILE *out = open_output(in, params->output_file);
+    unsigned char *buf = NULL;
+    size_t capacity = 0;
+    size_t len = 0;
+    unsigned char *outbuf = NULL;
+    size_t outbuf_size = 0;
+    qp_t q;
+    int at_end;
+    unsigned long long t;
+
+    qp_init(&q, params->decode, params->ignore_garbage);
+    stats.kernel = q.kernel;
+
+    do {
+        buf = grow_buffer(buf, &capacity, len + LINE_BLOCKSIZE);
+
+        STATS_START(t);
+        size_t n = fread(buf + len, 1, capacity - len, in);
+        STATS_STOP(read_ns, t);
+        stats.read_calls++;
+        stats.bytes_in += n;
+        len += n;
+        at_end = n == 0;
+
+        size_t written = 0;
+        size_t used;
+        outbuf = grow_buffer(outbuf, &outbuf_size, params->decode ? QP_DECODED_MAX(len) : QP_ENCODED_MAX(len));
+        STATS_START(t);
+        if (params->decode) {
+            used = qp_decode(&q, buf, len, outbuf, &written, at_end);
+        } else {
+            used = qp_encode(&q, buf, len, (char *)outbuf, &written, at_end);
+        }
+        STATS_STOP(transform_ns, t);
+
+        // Bytes decoded before invalid input are still written, as for the other encodings
+        write_block(out, outbuf, written);
+        if (q.error) {
+            close_output(out);
+            exit_with_error(q.error, NULL);
+        }
+        memmove(buf, buf + used, len - used);
+        len -= used;
+    } while (!at_end);
+    close_input(in, params->input_file);
+
+    free(buf);
+    free(outbuf);
+    close_output(out);
+
+    if (stats_enabled) {
+        print_stats(params->decode ? "decode" : "encode", ENC_QP);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * Percent-encoding (RFC 3986, --percent).  The encoder copies runs of
+ * unreserved characters as they are and writes every other byte as %XX.
+ * Long runs of bytes to escape, as in binary data, take their hex digits
+ * from the base16 kernel; where short runs of both kinds alternate, a
+ * table-driven pass over the next few bytes replaces a scanner call per
+ * run.  The decoder copies the runs between '%' signs and drops newlines;
+ * the hex digits of consecutive %XX triplets are gathered so that one
+ * base16 kernel call decodes and validates them all.  Invalid escapes are
+ * errors, or kept as they are with -i.
+ */
+#define PERCENT_RUN 256         /* escapes handed to the base16 kernel at a time */
+#define PERCENT_MIN_RUN 16      /* shorter runs of escapes go through the table */
+#define PERCENT_MIXED 64        /* bytes per table-driven pass */
+
+typedef struct {
+    qp_scan_fn scan;
+    encode_fn hex_encode;
+    decode_fn hex_decode;
+    int ignore_garbage;
+    const char *kernel;
+    const char *error;
+} percent_t;
+
+/* Upper bounds of the output for LEN bytes or characters; the table pass writes one byte ahead */
+#define PERCENT_ENCODED_MAX(len) ((len) * 3 + 1)
+#define PERCENT_DECODED_MAX(len) (len)
+
+/* Encoding of each byte: its characters, then their count */
+static unsigned char percent_codes[256][4];
+
+static void build_percent_codes(void) {
+    for (int c = 0; c < 256; c++) {
+        if (PERCENT_UNRESERVED(c)) {
+            percent_codes[c][0] = (unsigned char)c;
+            percent_codes[c][3] = 1;
+        } else {
+            percent_codes[c][0] = '%';
+            percent_codes[c][1] = (unsigned char)base16_chars[c >> 4];
+            percent_codes[c][2] = (unsigned char)base16_chars[c & 0x0F];
+            percent_codes[c][3] = 3;
+        }
+    }
+}
+
+static void percent_init(percent_t *p, int decode, int ignore_garbage) {
+    isa_t isa = detect_isa();
+    isa_t used;
+    isa_t hex_used;
+
+    build_percent_codes();
+    p->scan = select_percent_scanner(!decode, isa, &used);
+    p->hex_encode = select_encoder(ENC_BASE16, isa, &hex_used);
+    p->hex_decode = select_decoder(ENC_BASE16, isa, &hex_used);
+    p->kernel = isa_name(used);
+    p->ignore_garbage = ignore_garbage;
+    p->error = NULL;
+}
+
+static size_t percent_encode(percent_t *p, const unsigned char *in, size_t len, char *out) {
+    char hex[2 * PERCENT_RUN];
+    char *o = out;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t run = p->scan(in + i, len - i);
+        memcpy(o, in + i, run);
+        o += run;
+        i += run;
+
+        size_t n = 0;
+        while (n < PERCENT_RUN && i + n < len && percent_codes[in[i + n]][3] == 3) {
+            n++;
+        }
+        if (n >= PERCENT_MIN_RUN) {
+            p->hex_encode(in + i, n, hex);
+            for (size_t k = 0; k < n; k++, o += 3) {
+                o[0] = '%';
+                o[1] = hex[2 * k];
+                o[2] = hex[2 * k + 1];
+            }
+            i += n;
+            continue;
+        }
+
+        size_t end = len - i < PERCENT_MIXED ? len : i + PERCENT_MIXED;
+        for (; i < end; i++) {
+            memcpy(o, percent_codes[in[i]], 4);
+            o += percent_codes[in[i]][3];
+        }
+    }
+
+    return (size_t)(o - out);
+}
+
+/*
+ * Decode LEN characters, appending to OUT; returns the characters used.
+ * Unless FINISH, an escape cut off by the end of the block is left for
+ * the next call.
+ */
+static size_t percent_decode(percent_t *p, const unsigned char *in, size_t len, unsigned char *out, size_t *outlen,
+                             int finish) {
+    unsigned char hex[2 * PERCENT_RUN];
+    unsigned char *o = out + *outlen;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t run = p->scan(in + i, len - i);
+        memcpy(o, in + i, run);
+        o += run;
+        i += run;
+        if (i == len) {
             break;
-        case ENC_BASE2MSBF:
-        case ENC_BASE2LSBF:
-            outbuf_size = ENC_BLOCKSIZE * 8 + 1;
+        }
+        if (in[i] != '%') {
+            i++;
+            continue;
+        }
+
+        size_t n = 0;
+        while (n < PERCENT_RUN && i + 3 * n + 3 <= len && in[i + 3 * n] == '%') {
+            hex[2 * n] = in[i + 3 * n + 1];
+            hex[2 * n + 1] = in[i + 3 * n + 2];
+            n++;
+        }
+        if (n > 0 && p->hex_decode(hex, n, o) == 0) {
+            o += n;
+            i += 3 * n;
+            continue;
+        }
+
+        // Keep the triplets before the first bad one, then look at that one alone
+        size_t k = 0;
+        while (k < n && base16_decode_table[hex[2 * k]] != DEC_INVALID && base16_decode_table[hex[2 * k + 1]] != DEC_INVALID) {
+            o[k] = (unsigned char)((base16_decode_table[hex[2 * k]] << 4) | base16_decode_table[hex[2 * k + 1]]);
+            k++;
+        }
+        o += k;
+        i += 3 * k;
+
+        // Newlines are dropped even inside an escape
+        unsigned int digits[2];
+        size_t ndigits = 0;
+        size_t j = i + 1;
+        while (j < len && ndigits < 2) {
+            if (in[j] != '\n' && in[j] != '\r') {
+                digits[ndigits++] = base16_decode_table[in[j]];
+            }
+            j++;
+        }
+        if (ndigits < 2 && !finish) {
             break;
-        case ENC_Z85:
-            outbuf_size = ((ENC_BLOCKSIZE + 3) / 4) * 5 + 1;
+        }
+        if (ndigits == 2 && digits[0] != DEC_INVALID && digits[1] != DEC_INVALID) {
+            *o++ = (unsigned char)((digits[0] << 4) | digits[1]);
+            i = j;
+            continue;
+        }
+        if (!p->ignore_garbage) {
+            p->error = "invalid input";
             break;
-        default:
-            exit_with_error("unknown encoding type", NULL);
+        }
+        *o++ = '%';
+        i++;
     }
 
-    outbuf = (char *)malloc(outbuf_size);
-    if (!outbuf) {
-        free(inbuf);
-        exit_with_error("memory allocation failed", NULL);
+    *outlen = (size_t)(o - out);
+    return i;
+}
+
+/* Percent-encoding of the whole input, streamed block by block */
+void do_percent(FILE *in, const params_t *params) {
+    FILE *out = open_output(in, params->output_file);
+    unsigned char *buf = NULL;
+    size_t capacity = 0;
+    size_t len = 0;
+    unsigned char *outbuf = NULL;
+    size_t outbuf_size = 0;
+    percent_t p;
+    int at_end;
+    unsigned long long t;
+
+    percent_init(&p, params->decode, params->ignore_garbage);
+    stats.kernel = p.kernel;
+
+    do {
+        buf = grow_buffer(buf, &capacity, len + LINE_BLOCKSIZE);
+
+        STATS_START(t);
+        size_t n = fread(buf + len, 1, capacity - len, in);
+        STATS_STOP(read_ns, t);
+        stats.read_calls++;
+        stats.bytes_in += n;
+        len += n;
+        at_end = n == 0;
+
+        size_t written = 0;
+        size_t used = len;
+        outbuf = grow_buffer(outbuf, &outbuf_size, params->decode ? PERCENT_DECODED_MAX(len) : PERCENT_ENCODED_MAX(len));
+        STATS_START(t);
+        if (params->decode) {
+            used = percent_decode(&p, buf, len, outbuf, &written, at_end);
+        } else {
+            written = percent_encode(&p, buf, len, (char *)outbuf);
+        }
+        STATS_STOP(transform_ns, t);
+
+        write_block(out, outbuf, written);
+        if (p.error) {
+            close_output(out);
+            exit_with_error(p.error, NULL);
+        }
+        memmove(buf, buf + used, len - used);
+        len -= used;
+    } while (!at_end);
+    close_input(in, params->input_file);
+
+    free(buf);
+    free(outbuf);
+    close_output(out);
+
+    if (stats_enabled) {
+        print_stats(params->decode ? "decode" : "encode", ENC_PERCENT);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * Line mode (--lines): every input line is a separate item, encoded or
+ * decoded on its own and written as one output line.  Block encodings run
+ * each line through one reused stream, and Ascii85 and percent-encoding
+ * through one reused codec; nothing is allocated per line.
+ */
+void do_lines(FILE *in, const params_t *params) {
+    FILE *out = open_output(in, params->output_file);
+    int base58 = params->encoding_type == ENC_BASE58;
+    int ascii85 = params->encoding_type == ENC_ASCII85;
+    int percent = params->encoding_type == ENC_PERCENT;
+    unsigned char *buf = NULL;
+    size_t capacity = 0;
+    size_t len = 0;
+    size_t start = 0;
+    unsigned char *scratch = NULL;
+    size_t scratch_size = 0;
+    basenc_stream_t *stream = NULL;
+    ascii85_t a;
+    percent_t pc;
+    int at_end;
+    unsigned long long t;
+
+    if (base58) {
+        stats.kernel = "scalar";
+    } else if (ascii85) {
+        ascii85_init(&a, params->ignore_garbage);
+        stats.kernel = a.kernel;
+    } else if (percent) {
+        percent_init(&pc, params->decode, params->ignore_garbage);
+        scratch = grow_buffer(scratch, &scratch_size, LINE_BLOCKSIZE);
+        stats.kernel = pc.kernel;
+    } else {
+        scratch_size = LINE_BLOCKSIZE;
+        scratch = (unsigned char *)malloc(scratch_size);
+        stream = (basenc_stream_t *)malloc(sizeof(basenc_stream_t));
+        if (!scratch || !stream) {
+            exit_with_error("memory allocation failed", NULL);
+        }
+        basenc_stream_init(stream, params->encoding_type, params->decode, 0, params->ignore_garbage);
+        stats.kernel = stream->kernel;
     }
 
     do {
-        sum = 0;
-        do {
-            size_t n = fread(inbuf + sum, 1, ENC_BLOCKSIZE - sum, in);
-            sum += n;
-        } while (!feof(in) && !ferror(in) && sum < ENC_BLOCKSIZE);
-
-        if (sum > 0) {
-            size_t encoded_len = 0;
-
-            switch (encoding_type) {
-                case ENC_BASE64:
-                    encoded_len = base64_encode_block(inbuf, sum, outbuf, outbuf_size - 1, base64_chars);
-                    break;
-                case ENC_BASE64URL:
-                    encoded_len = base64_encode_block(inbuf, sum, outbuf, outbuf_size - 1, base64url_chars);
-                    break;
-                case ENC_BASE32:
-                    encoded_len = base32_encode_block(inbuf, sum, outbuf, outbuf_size - 1, base32_chars);
-                    break;
-                case ENC_BASE32HEX:
-                    encoded_len = base32_encode_block(inbuf, sum, outbuf, outbuf_size - 1, base32hex_chars);
-                    break;
-                case ENC_BASE16:
-                    encoded_len = base16_encode_block(inbuf, sum, outbuf, outbuf_size - 1);
-                    break;
-                case ENC_BASE2MSBF:
-                    encoded_len = base2_encode_block(inbuf, sum, outbuf, outbuf_size - 1, 1);
-                    break;
-                case ENC_BASE2LSBF:
-                    encoded_len = base2_encode_block(inbuf, sum, outbuf, outbuf_size - 1, 0);
-                    break;
-                case ENC_Z85:
-                    if (sum % 4 != 0) {
-                        free(inbuf);
-                        free(outbuf);
-                        exit_with_error("invalid input: Z85 encoding input length must be a multiple of 4", NULL);
-                    }
-                    encoded_len = z85_encode_block(inbuf, sum, outbuf, outbuf_size - 1);
-                    break;
-                default:
-                    free(inbuf);
-                    free(outbuf);
-                    exit_with_error("unknown encoding type", NULL);
+        // Keep the unfinished line, making room for a longer one
+        if (start > 0) {
+            memmove(buf, buf + start, len - start);
+            len -= start;
+            start = 0;
+        }
+        buf = grow_buffer(buf, &capacity, len + LINE_BLOCKSIZE);
+
+        STATS_START(t);
+        size_t n = fread(buf + len, 1, capacity - len, in);
+        STATS_STOP(read_ns, t);
+        stats.read_calls++;
+        stats.bytes_in += n;
+        len += n;
+        at_end = n == 0;
+
+        for (;;) {
+            unsigned char *line = buf + start;
+            unsigned char *newline = (unsigned char *)memchr(line, '\n', len - start);
+            size_t line_len;
+
+            if (newline) {
+                line_len = (size_t)(newline - line);
+                start += line_len + 1;
+            } else if (at_end && start < len) {
+                line_len = len - start;
+                start = len;
+            } else {
+                break;
             }
 
-            outbuf[encoded_len] = '\0';
-            wrap_write(outbuf, encoded_len, wrap_column, &current_column, out);
+            STATS_START(t);
+            if (base58) {
+                unsigned char *result;
+                long long r = base58_convert(line, line_len, params->decode, params->ignore_garbage, &scratch,
+                                             &scratch_size, &result);
+                STATS_STOP(transform_ns, t);
+                if (r < 0) {
+                    close_output(out);
+                    exit_with_error("invalid input", NULL);
+                }
+                write_block(out, result, (size_t)r);
+            } else if (ascii85) {
+                size_t r;
+
+                ascii85_reset(&a);
+                if (params->decode) {
+                    scratch = grow_buffer(scratch, &scratch_size, ASCII85_DECODED_MAX(line_len));
+                    r = ascii85_decode(&a, line, line_len, scratch, 1);
+                } else {
+                    scratch = grow_buffer(scratch, &scratch_size, ASCII85_ENCODED_MAX(line_len) + 4);
+                    memcpy(scratch, "<~", 2);
+                    r = 2 + ascii85_encode(&a, line, line_len, (char *)scratch + 2, 1);
+                    memcpy(scratch + r, "~>", 2);
+                    r += 2;
+                }
+                STATS_STOP(transform_ns, t);
+                write_block(out, scratch, r);
+                if (a.error) {
+                    close_output(out);
+                    exit_with_error(a.error, NULL);
+                }
+            } else if (percent) {
+                size_t r = 0;
+
+                if (params->decode) {
+                    scratch = grow_buffer(scratch, &scratch_size, PERCENT_DECODED_MAX(line_len));
+                    percent_decode(&pc, line, line_len, scratch, &r, 1);
+                } else {
+                    scratch = grow_buffer(scratch, &scratch_size, PERCENT_ENCODED_MAX(line_len));
+                    r = percent_encode(&pc, line, line_len, (char *)scratch);
+                }
+                STATS_STOP(transform_ns, t);
+                write_block(out, scratch, r);
+                if (pc.error) {
+                    close_output(out);
+                    exit_with_error(pc.error, NULL);
+                }
+            } else {
+                const unsigned char *next = line;
+                size_t left = line_len;
+                basenc_status_t status;
+
+                basenc_stream_reset(stream);
+                do {
+                    unsigned char *dst = scratch;
+                    size_t room = scratch_size;
+                    status = basenc_stream_run(stream, &next, &left, &dst, &room, 1);
+                    write_block(out, scratch, scratch_size - room);
+                } while (status == BASENC_NEED_OUTPUT);
+                STATS_STOP(transform_ns, t);
+                if (status == BASENC_ERROR) {
+                    close_output(out);
+                    exit_with_error(stream->error, NULL);
+                }
+            }
+            write_block(out, "\n", 1);
         }
-    } while (!feof(in) && !ferror(in) && sum == ENC_BLOCKSIZE);
+    } while (!at_end);
+
+    close_input(in, params->input_file);
+    free(buf);
+    free(scratch);
+    free(stream);
+    close_output(out);
+
+    if (stats_enabled) {
+        print_stats(params->decode ? "decode" : "encode", params->encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+/*
+ * In-place transform (--in-place FILE).  The file is mapped read-write and
+ * rewritten over itself.  Decoding runs forward, since the output never
+ * overtakes the input it came from; it checks the whole input first, so
+ * invalid data is reported before anything is overwritten.  Encoding grows
+ * the file to its encoded size and runs backward from the end, since the
+ * output of a block always lands at or after the block itself.
+ *
+ * Progress is kept in FILE.basenc-journal.  A checkpoint flushes the
+ * mapping, then records the offsets reached, the decoder state and a copy
+ * of the next input block, which its own output may overwrite.  Another
+ * checkpoint is taken only when the output is about to reach input the
+ * last one still relies on, so a run takes a logarithmic number of them.
+ * Running the same command again after a crash resumes from the journal.
+ *
+ * Journal layout, all integers little-endian:
+ *   "BASENCJL", u32 version, u32 mode (0 decode, 1 encode), u32 encoding,
+ *   u32 wrap column, u32 ignore garbage, u32 done, u64 original size,
+ *   u64 final size, u64 input offset, u64 output offset, u32 saved length,
+ *   u32 0, index entry holding the decoder state, saved bytes
+ */
+#define JOURNAL_MAGIC "BASENCJL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE (72 + INDEX_ENTRY_SIZE)
+#define JOURNAL_SUFFIX ".basenc-journal"
+#define IN_PLACE_BLOCKSIZE ENC_BLOCKSIZE
+
+typedef struct {
+    char *path;
+    char *temp;                 /* written, synced, then renamed over PATH */
+    int encode;
+    encoding_type_t encoding_type;
+    size_t wrap_column;
+    int ignore_garbage;
+    int done;
+    unsigned long long size;    /* file size before the transform */
+    unsigned long long final_size;
+    unsigned long long input;   /* offset of the saved block */
+    unsigned long long output;  /* decode: bytes of output in place */
+    index_entry_t state;
+    size_t saved_len;
+    unsigned char *saved;       /* IN_PLACE_BLOCKSIZE bytes */
+} journal_t;
+
+/* Make a rename or removal in the directory of PATH durable */
+static void sync_parent_dir(const char *path) {
+#ifndef _WIN32
+    char *dir = strdup(path);
+    char *slash;
+    int fd;
+
+    if (!dir) {
+        exit_with_error("memory allocation failed", NULL);
+    }
+    slash = strrchr(dir, '/');
+    if (slash) {
+        slash[slash == dir ? 1 : 0] = '\0';
+    }
+    fd = open(slash ? dir : ".", O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+#else
+    (void)path;
+#endif
+}
+
+static void journal_init(journal_t *j, const char *file, unsigned char *saved) {
+    size_t len = strlen(file);
+
+    memset(j, 0, sizeof(*j));
+    j->path = (char *)malloc(len + sizeof(JOURNAL_SUFFIX));
+    j->temp = (char *)malloc(len + sizeof(JOURNAL_SUFFIX) + 4);
+    if (!j->path || !j->temp) {
+        exit_with_error("memory allocation failed", NULL);
+    }
+    memcpy(j->path, file, len);
+    memcpy(j->path + len, JOURNAL_SUFFIX, sizeof(JOURNAL_SUFFIX));
+    memcpy(j->temp, j->path, len + sizeof(JOURNAL_SUFFIX) - 1);
+    memcpy(j->temp + len + sizeof(JOURNAL_SUFFIX) - 1, ".tmp", 5);
+    j->saved = saved;
+}
+
+static void journal_write(journal_t *j) {
+    unsigned char header[JOURNAL_HEADER_SIZE];
+    FILE *file = fopen(j->temp, "wb");
+
+    if (!file) {
+        exit_with_error(j->temp, strerror(errno));
+    }
+    memcpy(header, JOURNAL_MAGIC, 8);
+    put_le(header + 8, JOURNAL_VERSION, 4);
+    put_le(header + 12, (unsigned long long)j->encode, 4);
+    put_le(header + 16, (unsigned long long)j->encoding_type, 4);
+    put_le(header + 20, j->wrap_column, 4);
+    put_le(header + 24, (unsigned long long)j->ignore_garbage, 4);
+    put_le(header + 28, (unsigned long long)j->done, 4);
+    put_le(header + 32, j->size, 8);
+    put_le(header + 40, j->final_size, 8);
+    put_le(header + 48, j->input, 8);
+    put_le(header + 56, j->output, 8);
+    put_le(header + 64, j->saved_len, 4);
+    put_le(header + 68, 0, 4);
+    index_pack(header + 72, &j->state);
+
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(j->saved, 1, j->saved_len, file) != j->saved_len || fflush(file) != 0) {
+        exit_with_error(j->temp, strerror(errno));
+    }
+#ifdef _WIN32
+    if (_commit(_fileno(file)) != 0) {
+#else
+    if (fsync(fileno(file)) != 0) {
+#endif
+        exit_with_error(j->temp, strerror(errno));
+    }
+    if (fclose(file) != 0) {
+        exit_with_error(j->temp, strerror(errno));
+    }
+#ifdef _WIN32
+    if (!MoveFileExA(j->temp, j->path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        exit_with_error("cannot replace the journal", j->path);
+    }
+#else
+    if (rename(j->temp, j->path) != 0) {
+        exit_with_error(j->path, strerror(errno));
+    }
+#endif
+    sync_parent_dir(j->path);
+}
+
+/* Load the journal left by an interrupted run; returns -1 if there is none */
+static int journal_read(journal_t *j) {
+    unsigned char header[JOURNAL_HEADER_SIZE];
+    FILE *file = fopen(j->path, "rb");
 
-    if (wrap_column > 0 && current_column > 0) {
-        if (fputc('\n', out) == EOF) {
-            write_error();
+    if (!file) {
+        if (errno != ENOENT) {
+            exit_with_error(j->path, strerror(errno));
         }
+        return -1;
+    }
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, JOURNAL_MAGIC, 8) != 0 ||
+        get_le(header + 8, 4) != JOURNAL_VERSION || index_unpack(header + 72, &j->state) != 0 ||
+        get_le(header + 64, 4) > IN_PLACE_BLOCKSIZE) {
+        fclose(file);
+        exit_with_error("invalid journal file", j->path);
     }
+    j->encode = (int)get_le(header + 12, 4);
+    j->encoding_type = (encoding_type_t)get_le(header + 16, 4);
+    j->wrap_column = (size_t)get_le(header + 20, 4);
+    j->ignore_garbage = (int)get_le(header + 24, 4);
+    j->done = (int)get_le(header + 28, 4);
+    j->size = get_le(header + 32, 8);
+    j->final_size = get_le(header + 40, 8);
+    j->input = get_le(header + 48, 8);
+    j->output = get_le(header + 56, 8);
+    j->saved_len = (size_t)get_le(header + 64, 4);
+    if (fread(j->saved, 1, j->saved_len, file) != j->saved_len) {
+        fclose(file);
+        exit_with_error("invalid journal file", j->path);
+    }
+    fclose(file);
+    return 0;
+}
 
-    if (ferror(in)) {
-        free(inbuf);
-        free(outbuf);
-        exit_with_error("read error", NULL);
+/* The transform is complete and flushed: drop the journal */
+static void journal_remove(journal_t *j) {
+    if (remove(j->path) != 0) {
+        exit_with_error(j->path, strerror(errno));
     }
+    sync_parent_dir(j->path);
+    free(j->path);
+    free(j->temp);
+}
 
-    free(inbuf);
-    free(outbuf);
+/* Record the final length before cutting MAP down to it */
+static void in_place_finish(journal_t *j, output_map_t *map) {
+    unsigned long long t;
 
-    if (fclose(in) != 0) {
-        if (strcmp(infile, "-") == 0) {
-            exit_with_error("closing standard input", NULL);
+    STATS_START(t);
+    output_map_sync(map);
+    STATS_STOP(write_ns, t);
+    j->done = 1;
+    j->saved_len = 0;
+    journal_write(j);
+    output_map_close(map, (size_t)j->final_size);
+}
+
+/* Flush MAP, then record that the block of LEN bytes at INPUT is next */
+static void in_place_checkpoint(journal_t *j, output_map_t *map, unsigned long long input, unsigned long long output,
+                                const unsigned char *block, size_t len) {
+    unsigned long long t;
+
+    STATS_START(t);
+    output_map_sync(map);
+    j->input = input;
+    j->output = output;
+    j->saved_len = len;
+    if (block != j->saved) {
+        memcpy(j->saved, block, len);
+    }
+    journal_write(j);
+    STATS_STOP(write_ns, t);
+}
+
+/*
+ * Decode MAP, SIZE bytes, over itself; returns the decoded length.  With
+ * J NULL only validate the input.
+ */
+static unsigned long long decode_in_place(output_map_t *map, unsigned long long size, decoder_t *dec, journal_t *j,
+                                          int resume, char *inbuf, unsigned char *outbuf) {
+    unsigned long long consumed = resume ? j->input : 0;
+    unsigned long long pos = resume ? j->output : 0;
+    unsigned long long needed = resume ? j->input + j->saved_len : 0;    /* input still relied on starts here */
+    unsigned long long t;
+    index_entry_t before;
+
+    if (resume) {
+        decoder_restore(dec, &j->state);
+    }
+    while (consumed < size) {
+        size_t n = size - consumed < IN_PLACE_BLOCKSIZE ? (size_t)(size - consumed) : IN_PLACE_BLOCKSIZE;
+        size_t decoded_len = 0;
+        int status;
+
+        if (resume) {
+            n = j->saved_len;
+            memcpy(inbuf, j->saved, n);
+            resume = 0;
         } else {
-            exit_with_error(infile, strerror(errno));
+            memcpy(inbuf, map->base + consumed, n);
+        }
+        decoder_save(dec, &before);
+
+        STATS_START(t);
+        status = decoder_run(dec, inbuf, n, outbuf, &decoded_len);
+        if (status == 0 && consumed + n == size) {
+            status = decoder_finish(dec, outbuf, &decoded_len);
+        }
+        STATS_STOP(transform_ns, t);
+        if (status != 0) {
+            exit_with_error(dec->error, NULL);
+        }
+
+        if (j) {
+            if (pos + decoded_len > needed) {
+                j->state = before;
+                in_place_checkpoint(j, map, consumed, pos, (const unsigned char *)inbuf, n);
+                needed = consumed + n;
+            }
+            memcpy(map->base + pos, outbuf, decoded_len);
+            stats.bytes_in += n;
         }
+        pos += decoded_len;
+        consumed += n;
     }
+    return pos;
+}
 
-    exit(EXIT_SUCCESS);
+/* Encode MAP, whose first SIZE bytes are the input, backward into the whole of MAP */
+static void encode_in_place(output_map_t *map, unsigned long long size, encode_fn encode, journal_t *j, int resume,
+                            unsigned char *inbuf, char *outbuf) {
+    const decoder_ops_t *ops = decoder_ops(j->encoding_type);
+    size_t wrap_column = j->wrap_column;
+    unsigned long long a = size == 0 ? 0 : (size - 1) / IN_PLACE_BLOCKSIZE * IN_PLACE_BLOCKSIZE;
+    unsigned long long needed = size;   /* input still relied on ends here */
+    unsigned long long t;
+
+    // A journal written before the first checkpoint has no block saved
+    resume = resume && j->saved_len > 0;
+    if (resume) {
+        a = j->input;
+        needed = j->input;
+    }
+    while (size > 0) {
+        size_t n = size - a < IN_PLACE_BLOCKSIZE ? (size_t)(size - a) : IN_PLACE_BLOCKSIZE;
+        unsigned long long chars = a / ops->quantum_bytes * ops->quantum_chars;
+        unsigned long long off = wrap_column ? chars + chars / wrap_column : chars;
+        char *dst = (char *)map->base;
+
+        if (resume) {
+            memcpy(inbuf, j->saved, n);
+            resume = 0;
+        } else {
+            memcpy(inbuf, map->base + a, n);
+        }
+        if (off < needed) {
+            in_place_checkpoint(j, map, a, 0, inbuf, n);
+            needed = a;
+        }
+
+        STATS_START(t);
+        size_t len = encode(inbuf, n, outbuf);
+        if (wrap_column == 0) {
+            memcpy(dst + off, outbuf, len);
+        } else {
+            size_t column = (size_t)(chars % wrap_column);
+            for (size_t p = 0; p < len; ) {
+                size_t m = wrap_column - column;
+                if (m > len - p) {
+                    m = len - p;
+                }
+                memcpy(dst + off, outbuf + p, m);
+                p += m;
+                off += m;
+                column += m;
+                if (column == wrap_column) {
+                    dst[off++] = '\n';
+                    column = 0;
+                }
+            }
+            if (column > 0 && a + n == size) {
+                dst[off] = '\n';
+            }
+        }
+        STATS_STOP(transform_ns, t);
+        stats.bytes_in += n;
+
+        if (a == 0) {
+            break;
+        }
+        a -= IN_PLACE_BLOCKSIZE;
+    }
 }
 
-void do_decode(FILE *in, const char *infile, FILE *out, int ignore_garbage, encoding_type_t encoding_type) {
-    char *inbuf;
+void do_in_place(const params_t *params) {
+    const char *path = params->input_file;
+    encoding_type_t encoding_type = params->encoding_type;
+    size_t wrap_column = (size_t)params->wrap_column;
+    FILE *file = fopen(path, "rb");
+    unsigned long long size;
+    output_map_t map;
+    journal_t journal;
+    arena_t arena;
+    unsigned char *inbuf;
     unsigned char *outbuf;
-    size_t sum;
+    decoder_t *dec;
+    isa_t kernel_isa;
+    int resume;
 
-    size_t inbuf_size;
-    switch (encoding_type) {
-        case ENC_BASE64:
-        case ENC_BASE64URL:
-            inbuf_size = DEC_BLOCKSIZE * 4 / 3 + 4;
-            break;
-        case ENC_BASE32:
-        case ENC_BASE32HEX:
-            inbuf_size = DEC_BLOCKSIZE * 8 / 5 + 8;
-            break;
-        case ENC_BASE16:
-            inbuf_size = DEC_BLOCKSIZE * 2 + 2;
-            break;
-        case ENC_BASE2MSBF:
-        case ENC_BASE2LSBF:
-            inbuf_size = DEC_BLOCKSIZE * 8 + 8;
-            break;
-        case ENC_Z85:
-            inbuf_size = DEC_BLOCKSIZE * 5 / 4 + 5;
-            break;
-        default:
-            exit_with_error("unknown encoding type", NULL);
+    if (!file) {
+        exit_with_error(path, strerror(errno));
     }
+    if (input_regular_size(file, &size) != 0) {
+        fclose(file);
+        exit_with_error("--in-place needs a regular file", path);
+    }
+    fclose(file);
 
-    inbuf = (char *)malloc(inbuf_size);
-    outbuf = (unsigned char *)malloc(DEC_BLOCKSIZE);
-    if (!inbuf || !outbuf) {
-        free(inbuf);
-        free(outbuf);
-        exit_with_error("memory allocation failed", NULL);
+    size_t outbuf_size = (size_t)encoded_size(encoding_type, IN_PLACE_BLOCKSIZE, 0) + 1;
+    arena_init(&arena, 2 * ARENA_ROUND(IN_PLACE_BLOCKSIZE) + ARENA_ROUND(outbuf_size) + ARENA_ROUND(sizeof(decoder_t)));
+    inbuf = (unsigned char *)arena_alloc(&arena, IN_PLACE_BLOCKSIZE);
+    outbuf = (unsigned char *)arena_alloc(&arena, outbuf_size);
+    dec = (decoder_t *)arena_alloc(&arena, sizeof(decoder_t));
+    stats.output = "in-place";
+
+    journal_init(&journal, path, (unsigned char *)arena_alloc(&arena, IN_PLACE_BLOCKSIZE));
+    resume = journal_read(&journal) == 0;
+    if (resume) {
+        if (journal.encode == params->decode || journal.encoding_type != encoding_type ||
+            (journal.encode ? journal.wrap_column != wrap_column : journal.ignore_garbage != params->ignore_garbage)) {
+            exit_with_error("journal left by a different command; finish that first", journal.path);
+        }
+        // Decoding only changes the file size once it is done
+        if (size != journal.size && (size != journal.final_size || (!journal.encode && !journal.done))) {
+            exit_with_error("file changed since the journal was written", path);
+        }
+    } else {
+        journal.encode = !params->decode;
+        journal.encoding_type = encoding_type;
+        journal.wrap_column = journal.encode ? wrap_column : 0;
+        journal.ignore_garbage = params->ignore_garbage;
+        journal.size = size;
+        journal.input = journal.encode ? size : 0;
     }
 
-    do {
-        sum = 0;
-        do {
-            size_t n = fread(inbuf + sum, 1, inbuf_size - sum - 1, in);
-            sum += n;
-        } while (!feof(in) && !ferror(in) && sum < inbuf_size - 1);
-
-        inbuf[sum] = '\0';
-
-        if (sum > 0) {
-            size_t decoded_len = 0;
-
-            switch (encoding_type) {
-                case ENC_BASE64:
-                    decoded_len = base64_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, 0, ignore_garbage);
-                    break;
-                case ENC_BASE64URL:
-                    decoded_len = base64_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, 1, ignore_garbage);
-                    break;
-                case ENC_BASE32:
-                    decoded_len = base32_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, base32_chars, ignore_garbage);
-                    break;
-                case ENC_BASE32HEX:
-                    decoded_len = base32_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, base32hex_chars, ignore_garbage);
-                    break;
-                case ENC_BASE16:
-                    decoded_len = base16_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, ignore_garbage);
-                    break;
-                case ENC_BASE2MSBF:
-                    decoded_len = base2_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, 1, ignore_garbage);
-                    break;
-                case ENC_BASE2LSBF:
-                    decoded_len = base2_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, 0, ignore_garbage);
-                    break;
-                case ENC_Z85:
-                    decoded_len = z85_decode_block(inbuf, sum, outbuf, DEC_BLOCKSIZE, ignore_garbage);
-                    break;
-                default:
-                    free(inbuf);
-                    free(outbuf);
-                    exit_with_error("unknown encoding type", NULL);
-            }
-
-            if (fwrite(outbuf, 1, decoded_len, out) < decoded_len) {
-                write_error();
-            }
+    if (resume && journal.done) {
+        // Interrupted after the last flush: only the final length remains to be set
+        if (file_map_open(&map, path, size) != 0) {
+            exit_with_error("cannot map the file", path);
         }
-    } while (!feof(in) && !ferror(in));
+        output_map_close(&map, (size_t)journal.final_size);
+    } else if (journal.encode) {
+        if (encoding_type == ENC_Z85 && journal.size % 4 != 0) {
+            exit_with_error("invalid input: Z85 encoding input length must be a multiple of 4", NULL);
+        }
+        journal.final_size = encoded_size(encoding_type, journal.size, wrap_column);
+        if (!resume) {
+            journal_write(&journal);
+        }
+        encode_fn encode = select_encoder(encoding_type, detect_isa(), &kernel_isa);
+        stats.kernel = isa_name(kernel_isa);
+
+        if (file_map_open(&map, path, journal.final_size) != 0) {
+            exit_with_error("cannot map the file", path);
+        }
+        encode_in_place(&map, journal.size, encode, &journal, resume, inbuf, (char *)outbuf);
+        in_place_finish(&journal, &map);
+    } else {
+        if (file_map_open(&map, path, size) != 0) {
+            exit_with_error("cannot map the file", path);
+        }
+        decoder_init(dec, encoding_type, params->ignore_garbage);
+        stats.kernel = dec->kernel;
+        if (!resume) {
+            decode_in_place(&map, size, dec, NULL, 0, (char *)inbuf, outbuf);
+            decoder_init(dec, encoding_type, params->ignore_garbage);
+        }
+        journal.final_size = decode_in_place(&map, size, dec, &journal, resume, (char *)inbuf, outbuf);
+        in_place_finish(&journal, &map);
+    }
+
+    journal_remove(&journal);
+    arena_release(&arena);
+
+    stats.bytes_out = journal.final_size;
+    if (stats_enabled) {
+        print_stats(params->decode ? "decode" : "encode", encoding_type);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+static unsigned long long monotonic_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+static unsigned long long peak_rss_bytes(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return (unsigned long long)pmc.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (unsigned long long)usage.ru_maxrss;
+#else
+    return (unsigned long long)usage.ru_maxrss * 1024ULL;
+#endif
+#endif
+}
 
-    if (ferror(in)) {
-        free(inbuf);
-        free(outbuf);
-        exit_with_error("read error", NULL);
+static const char *encoding_name(encoding_type_t encoding_type) {
+    switch (encoding_type) {
+        case ENC_BASE64:    return "base64";
+        case ENC_BASE64URL: return "base64url";
+        case ENC_BASE32:    return "base32";
+        case ENC_BASE32HEX: return "base32hex";
+        case ENC_BASE16:    return "base16";
+        case ENC_BASE2MSBF: return "base2msbf";
+        case ENC_BASE2LSBF: return "base2lsbf";
+        case ENC_Z85:       return "z85";
+        case ENC_ASCII85:   return "ascii85";
+        case ENC_UUENCODE:  return "uuencode";
+        case ENC_QP:        return "qp";
+        case ENC_BASE58:    return "base58";
+        case ENC_BASE45:    return "base45";
+        case ENC_PERCENT:   return "percent";
+        default:            return "none";
     }
+}
 
-    free(inbuf);
-    free(outbuf);
+/* Encoding named NAME, ENC_NONE if there is none */
+static encoding_type_t encoding_by_name(const char *name) {
+    int e;
 
-    if (fclose(in) != 0) {
-        if (strcmp(infile, "-") == 0) {
-            exit_with_error("closing standard input", NULL);
-        } else {
-            exit_with_error(infile, strerror(errno));
+    for (e = ENC_BASE64; e <= ENC_PERCENT; e++) {
+        if (strcmp(name, encoding_name((encoding_type_t)e)) == 0) {
+            return (encoding_type_t)e;
         }
     }
-
-    exit(EXIT_SUCCESS);
+    return ENC_NONE;
 }
 
+/* Print the --stats report: a human readable block, then one JSON line */
+static void print_stats(const char *mode, encoding_type_t encoding_type) {
+    double wall = (monotonic_ns() - stats.start_ns) / 1e9;
+    double read_s = stats.read_ns / 1e9;
+    double transform_s = stats.transform_ns / 1e9;
+    double write_s = stats.write_ns / 1e9;
+    double mib_s = wall > 0 ? stats.bytes_in / wall / (1024.0 * 1024.0) : 0.0;
+    unsigned long long rss = peak_rss_bytes();
 
-void wrap_write(const char *buffer, size_t len, size_t wrap_column, size_t *current_column, FILE *out) {
-    if (wrap_column == 0) {
-        if (fwrite(buffer, 1, len, out) < len) {
-            write_error();
-        }
-        *current_column += len;
-    } else {
-        for (size_t i = 0; i < len; i++) {
-            if (*current_column >= wrap_column) {
-                if (fputc('\n', out) == EOF) {
-                    write_error();
-                }
-                *current_column = 0;
-            }
-            if (fputc(buffer[i], out) == EOF) {
-                write_error();
-            }
-            (*current_column)++;
-        }
-    }
+    fprintf(stderr, "%s: stats: %s %s, kernel %s, %d thread%s\n", PROGRAM_NAME, mode,
+            encoding_name(encoding_type), stats.kernel, stats.threads, stats.threads == 1 ? "" : "s");
+    fprintf(stderr, "%s: stats:   read      %llu bytes in %llu calls, %.6f s\n", PROGRAM_NAME,
+            stats.bytes_in, stats.read_calls, read_s);
+    fprintf(stderr, "%s: stats:   transform %.6f s\n", PROGRAM_NAME, transform_s);
+    fprintf(stderr, "%s: stats:   write     %llu bytes in %llu calls, %.6f s (%s)\n", PROGRAM_NAME,
+            stats.bytes_out, stats.write_calls, write_s, stats.output);
+    fprintf(stderr, "%s: stats:   arena     %llu KiB, %s pages\n", PROGRAM_NAME,
+            stats.arena_bytes / 1024, stats.arena_pages);
+    fprintf(stderr, "%s: stats:   total     %.6f s, %.1f MiB/s, peak RSS %llu KiB\n", PROGRAM_NAME,
+            wall, mib_s, rss / 1024);
+    fprintf(stderr, "{\"mode\":\"%s\",\"encoding\":\"%s\",\"kernel\":\"%s\",\"threads\":%d,"
+            "\"bytes_in\":%llu,\"bytes_out\":%llu,\"read_calls\":%llu,\"write_calls\":%llu,"
+            "\"read_s\":%.6f,\"transform_s\":%.6f,\"write_s\":%.6f,\"wall_s\":%.6f,"
+            "\"throughput_mib_s\":%.1f,\"peak_rss_bytes\":%llu,\"arena_bytes\":%llu,\"arena_pages\":\"%s\",\"output\":\"%s\"}\n",
+            mode, encoding_name(encoding_type), stats.kernel, stats.threads,
+            stats.bytes_in, stats.bytes_out, stats.read_calls, stats.write_calls,
+            read_s, transform_s, write_s, wall, mib_s, rss, stats.arena_bytes, stats.arena_pages, stats.output);
 }
 
 void write_error(void) {
@@ -881,16 +8000,79 @@ void usage(int status) {
         printf("      --base2lsbf       bit string with least significant bit (lsb) first\n");
         printf("  -d, --decode          decode data\n");
         printf("  -i, --ignore-garbage  when decoding, ignore non-alphabet characters\n");
+        printf("  -o, --output=FILE     write to FILE instead of standard output\n");
+        printf("      --in-place        replace FILE with its encoding or decoding\n");
+        printf("      --skip-bytes=N    when decoding, skip the first N decoded bytes\n");
+        printf("      --count-bytes=M   when decoding, output at most M decoded bytes\n");
+        printf("      --write-index=FILE  write a seekable index of the encoded data to FILE\n");
+        printf("      --index=FILE      when decoding, use the index in FILE to find --skip-bytes\n");
+        printf("      --index-interval=MIB  decoded MiB between index entries (default 1)\n");
         printf("  -w, --wrap=COLS       wrap encoded lines after COLS character (default 76).\n");
         printf("                          Use 0 to disable line wrapping\n");
         printf("      --z85             ascii85-like encoding (ZeroMQ spec:32/Z85);\n");
         printf("                        when encoding, input length must be a multiple of 4;\n");
         printf("                        when decoding, input length must be a multiple of 5\n");
+        printf("      --ascii85         Adobe/btoa Ascii85, framed as <~ ~>, with 'z' for zero\n");
+        printf("                        words; decoding stops at ~>\n");
+        printf("      --qp              quoted-printable (RFC 2045), lines of at most 76\n");
+        printf("                        characters; --wrap does not apply\n");
+        printf("      --percent         percent-encoding (RFC 3986): all but unreserved\n");
+        printf("                        characters become %%XX; --wrap does not apply\n");
+        printf("      --uuencode        uuencode, with begin and end lines; the header names\n");
+        printf("                        FILE, and decoding ignores it; --wrap does not apply\n");
+        printf("      --base58          base58 (Bitcoin alphabet); the input is one number, so\n");
+        printf("                        all of it is read before any output\n");
+        printf("      --base45          base45 (RFC 9285), as used in QR codes; space is part\n");
+        printf("                        of its alphabet, so -i does not skip it\n");
+        printf("      --lines           treat each input line as a separate item and write one\n");
+        printf("                        output line per input line; use with --base58 or\n");
+        printf("                        --base45 for many short identifiers or payloads\n");
+        printf("      --alphabet=STRING  use STRING as the alphabet of base64, base32 or\n");
+        printf("                        base16; without one of those, its length picks one\n");
+        printf("      --padding=CHAR    pad base64 and base32 with CHAR instead of '=', or\n");
+        printf("                        not at all with 'none'\n");
+        printf("      --emit=ENC[,COLS]:PATH  also write the ENC encoding, wrapped at COLS,\n");
+        printf("                        to PATH ('-' for standard output); may be repeated,\n");
+        printf("                        and the input is read once for all outputs\n");
+        printf("      --from=ENC --to=ENC  decode ENC and re-encode it as another, in one\n");
+        printf("                        pass; ENC is base64, base64url, base32, base32hex,\n");
+        printf("                        base16, base2msbf, base2lsbf, z85 or base45\n");
+        printf("      --checksum=ALG[:FILE]  digest the unencoded bytes with crc32c or xxh64\n");
+        printf("                        as they pass, and report it on standard error or in FILE\n");
+        printf("      --expect=HEX      when decoding, fail if the --checksum digest differs\n");
+        printf("      --verify=ORIGINAL  when decoding, compare the decoded data with ORIGINAL\n");
+        printf("                        instead of writing it, and report the first difference\n");
+        printf("      --check           when decoding, validate the input without writing\n");
+        printf("                        anything; report the offset of the first bad byte\n");
+        printf("      --size            print the size of the output instead of writing it;\n");
+        printf("                        when encoding, a regular FILE is not read\n");
+        printf("      --auto            when decoding, detect base16, base32, base32hex,\n");
+        printf("                        base64 or base64url from the first block of input\n");
+        printf("      --verbose         report the encoding --auto detected on standard error\n");
+        printf("      --stats           report byte counts, I/O and transform times, kernel\n");
+        printf("                          and peak memory on standard error at exit\n");
         printf("      --help     display this help and exit\n");
         printf("      --version  output version information and exit\n\n");
         printf("When decoding, the input may contain newlines in addition to the bytes of\n");
         printf("the formal alphabet.  Use --ignore-garbage to attempt to recover\n");
         printf("from any other non-alphabet bytes in the encoded stream.\n");
+        printf("\nWith --skip-bytes, a cleanly wrapped input file is read from the quantum\n");
+        printf("holding byte N onwards; other input is decoded from the start.  The\n");
+        printf("size of the input and its first, last and target lines must all fit one\n");
+        printf("line width; lines in between are not read.  Input after the last byte\n");
+        printf("of the range is not read or validated.  An index\n");
+        printf("written with --write-index, when encoding or by decoding an existing\n");
+        printf("file, lets --index find byte N in any input layout.  The index records\n");
+        printf("the size, time and first and last blocks of the encoded file, and is\n");
+        printf("refused for any other file.\n");
+        printf("\nWith --in-place, FILE is rewritten over itself, needing no space beyond\n");
+        printf("the larger of its two forms.  Progress is journaled in FILE.basenc-journal;\n");
+        printf("if a run is interrupted, repeat the command to finish it.\n");
+        printf("\nA custom alphabet must be printable ASCII without repeats, e.g. Crockford\n");
+        printf("base32 is --base32 --alphabet=0123456789ABCDEFGHJKMNPQRSTVWXYZ --padding=none.\n");
+        printf("\nSetting BASENC_STATS=1 in the environment is equivalent to --stats.\n");
+        printf("BASENC_PREFAULT=1 touches every page of the working buffers before the\n");
+        printf("first read.\n");
     }
     exit(status);
 }
@@ -910,9 +8092,159 @@ static void remove_suffix(char* name, const char* suffix) {
     if (np > name) *np = '\0';
 }
 
+/*
+ * Install the run-time alphabet of --alphabet and --padding.  Without an
+ * encoding option the alphabet's length picks base64, base32 or base16.
+ * Like the built-in base32 and base16 alphabets, an alphabet of those
+ * sizes with no lowercase letters also decodes their lowercase forms.
+ */
+static int setup_custom_alphabet(params_t *params) {
+    const char *alphabet = params->alphabet;
+    size_t len;
+    size_t size;
+
+    if (!alphabet && !params->padding) {
+        return 0;
+    }
+
+    switch (params->encoding_type) {
+        case ENC_NONE:
+            len = alphabet ? strlen(alphabet) : 0;
+            params->encoding_type = len == 64 ? ENC_BASE64 : len == 32 ? ENC_BASE32 : len == 16 ? ENC_BASE16 : ENC_NONE;
+            if (params->encoding_type == ENC_NONE) {
+                fprintf(stderr, "%s: invalid alphabet: needs 64, 32 or 16 characters\n", PROGRAM_NAME);
+                return -1;
+            }
+            break;
+        case ENC_BASE64:
+        case ENC_BASE64URL:
+        case ENC_BASE32:
+        case ENC_BASE32HEX:
+        case ENC_BASE16:
+            break;
+        default:
+            fprintf(stderr, "%s: --alphabet and --padding apply to base64, base32 and base16 only\n", PROGRAM_NAME);
+            return -1;
+    }
+
+    size = params->encoding_type == ENC_BASE16 ? 16 :
+           params->encoding_type == ENC_BASE32 || params->encoding_type == ENC_BASE32HEX ? 32 : 64;
+    if (!alphabet) {
+        switch (params->encoding_type) {
+            case ENC_BASE64:    alphabet = base64_chars; break;
+            case ENC_BASE64URL: alphabet = base64url_chars; break;
+            case ENC_BASE32:    alphabet = base32_chars; break;
+            case ENC_BASE32HEX: alphabet = base32hex_chars; break;
+            default:            alphabet = base16_chars; break;
+        }
+    }
+    if (strlen(alphabet) != size) {
+        fprintf(stderr, "%s: invalid alphabet: needs %u characters for %s\n", PROGRAM_NAME, (unsigned int)size,
+                encoding_name(params->encoding_type));
+        return -1;
+    }
+
+    // Printable ASCII only, which is what the vector lookups cover
+    memset(custom_decode_table, DEC_INVALID, sizeof(custom_decode_table));
+    int lowercase = 0;
+    for (size_t k = 0; k < size; k++) {
+        unsigned char c = (unsigned char)alphabet[k];
+        if (c <= ' ' || c > '~') {
+            fprintf(stderr, "%s: invalid alphabet: characters must be printable ASCII\n", PROGRAM_NAME);
+            return -1;
+        }
+        if (custom_decode_table[c] != DEC_INVALID) {
+            fprintf(stderr, "%s: invalid alphabet: '%c' appears twice\n", PROGRAM_NAME, c);
+            return -1;
+        }
+        custom_decode_table[c] = (unsigned char)k;
+        custom_chars[k] = (char)c;
+        lowercase |= IN_RANGE(c, 'a', 'z');
+    }
+    if (size < 64 && !lowercase) {
+        for (size_t k = 0; k < size; k++) {
+            if (IN_RANGE(custom_chars[k], 'A', 'Z')) {
+                custom_decode_table[custom_chars[k] - 'A' + 'a'] = (unsigned char)k;
+            }
+        }
+    }
+
+    if (!params->padding) {
+        if (params->encoding_type != ENC_BASE16 && custom_decode_table['='] != DEC_INVALID) {
+            fprintf(stderr, "%s: invalid alphabet: '=' is the padding; choose another with --padding\n", PROGRAM_NAME);
+            return -1;
+        }
+    } else if (params->encoding_type == ENC_BASE16) {
+        fprintf(stderr, "%s: --padding does not apply to base16\n", PROGRAM_NAME);
+        return -1;
+    } else if (strcmp(params->padding, "none") == 0) {
+        custom_pad = -1;
+    } else {
+        unsigned char c = (unsigned char)params->padding[0];
+        if (c <= ' ' || c > '~' || params->padding[1] != '\0' || custom_decode_table[c] != DEC_INVALID) {
+            fprintf(stderr, "%s: invalid padding: '%s'\n", PROGRAM_NAME, params->padding);
+            return -1;
+        }
+        custom_pad = c;
+    }
+
+    custom_encoding = params->encoding_type;
+    return 0;
+}
+
+/* Add the --emit output SPEC, ENC[,COLS]:PATH, to PARAMS */
+static int parse_emit(const char *spec, params_t *params) {
+    const char *colon = strchr(spec, ':');
+    const char *comma = strchr(spec, ',');
+    char name[16];
+    size_t name_len;
+    emit_t *emit;
+
+    // One slot is kept for the main encoding
+    if (params->emit_count == EMIT_MAX - 1) {
+        fprintf(stderr, "%s: at most %d --emit outputs\n", PROGRAM_NAME, EMIT_MAX - 1);
+        return -1;
+    }
+    if (!colon || colon[1] == '\0') {
+        fprintf(stderr, "%s: invalid output: '%s'\n", PROGRAM_NAME, spec);
+        return -1;
+    }
+    if (comma && comma > colon) {
+        comma = NULL;
+    }
+    name_len = (size_t)((comma ? comma : colon) - spec);
+    if (name_len >= sizeof(name)) {
+        name_len = sizeof(name) - 1;
+    }
+    memcpy(name, spec, name_len);
+    name[name_len] = '\0';
+
+    emit = &params->emit[params->emit_count];
+    emit->encoding_type = encoding_by_name(name);
+    if (emit->encoding_type == ENC_NONE || !builtin_decoder_ops(emit->encoding_type)) {
+        fprintf(stderr, "%s: invalid encoding for --emit: '%s'\n", PROGRAM_NAME, name);
+        return -1;
+    }
+    // Without COLS the output follows -w, which may come later on the command line
+    emit->wrap_column = (size_t)-1;
+    if (comma) {
+        char *endptr;
+        long val = strtol(comma + 1, &endptr, 10);
+        if (endptr != colon || comma + 1 == colon || val < 0) {
+            fprintf(stderr, "%s: invalid wrap size: '%.*s'\n", PROGRAM_NAME, (int)(colon - comma - 1), comma + 1);
+            return -1;
+        }
+        emit->wrap_column = (size_t)val;
+    }
+    emit->path = colon + 1;
+    params->emit_count++;
+    return 0;
+}
+
 int parse_arguments(int argc, char **argv, params_t *params) {
     int i;
     int encoding_set = 0;
+    int from_set = 0;
 
     // Set default values
     params->decode = 0;
@@ -920,6 +8252,32 @@ int parse_arguments(int argc, char **argv, params_t *params) {
     params->wrap_column = 76;
     params->encoding_type = ENC_NONE;
     params->input_file = "-";
+    params->output_file = NULL;
+    params->skip_bytes = 0;
+    params->count_bytes = DEC_COUNT_ALL;
+    params->write_index = NULL;
+    params->index_file = NULL;
+    params->index_interval = 0;
+    params->in_place = 0;
+    params->lines = 0;
+    params->alphabet = NULL;
+    params->padding = NULL;
+    params->stats = 0;
+    params->auto_detect = 0;
+    params->verbose = 0;
+    params->to_encoding = ENC_NONE;
+    params->emit_count = 0;
+    params->checksum = CHECKSUM_NONE;
+    params->checksum_file = NULL;
+    params->expect = NULL;
+    params->verify = NULL;
+    params->check = 0;
+    params->size = 0;
+
+    const char *stats_env = getenv("BASENC_STATS");
+    if (stats_env && *stats_env && strcmp(stats_env, "0") != 0) {
+        params->stats = 1;
+    }
 
     if (argc > 0) {
         PROGRAM_NAME = argv[0];
@@ -945,6 +8303,20 @@ int parse_arguments(int argc, char **argv, params_t *params) {
             params->decode = 1;
         } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ignore-garbage") == 0) {
             params->ignore_garbage = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            params->stats = 1;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            params->check = 1;
+        } else if (strcmp(argv[i], "--size") == 0) {
+            params->size = 1;
+        } else if (strcmp(argv[i], "--auto") == 0) {
+            params->auto_detect = 1;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            params->verbose = 1;
+        } else if (strcmp(argv[i], "--in-place") == 0) {
+            params->in_place = 1;
+        } else if (strcmp(argv[i], "--lines") == 0) {
+            params->lines = 1;
         } else if (strcmp(argv[i], "-w") == 0) {
             if (i + 1 < argc) {
                 char *endptr;
@@ -958,6 +8330,58 @@ int parse_arguments(int argc, char **argv, params_t *params) {
                 fprintf(stderr, "%s: option requires an argument -- 'w'\n", PROGRAM_NAME);
                 return -1;
             }
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 < argc) {
+                params->output_file = argv[++i];
+            } else {
+                fprintf(stderr, "%s: option requires an argument -- 'o'\n", PROGRAM_NAME);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            params->output_file = argv[i] + 9;
+        } else if (strcmp(argv[i], "--write-index") == 0 || strcmp(argv[i], "--index") == 0) {
+            if (i + 1 < argc) {
+                if (argv[i][2] == 'w') {
+                    params->write_index = argv[i + 1];
+                } else {
+                    params->index_file = argv[i + 1];
+                }
+                i++;
+            } else {
+                fprintf(stderr, "%s: option '%s' requires an argument\n", PROGRAM_NAME, argv[i]);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "--write-index=", 14) == 0) {
+            params->write_index = argv[i] + 14;
+        } else if (strncmp(argv[i], "--index=", 8) == 0) {
+            params->index_file = argv[i] + 8;
+        } else if (strncmp(argv[i], "--alphabet=", 11) == 0) {
+            params->alphabet = argv[i] + 11;
+        } else if (strncmp(argv[i], "--padding=", 10) == 0) {
+            params->padding = argv[i] + 10;
+        } else if (strncmp(argv[i], "--index-interval=", 17) == 0) {
+            char *endptr;
+            long val = strtol(argv[i] + 17, &endptr, 10);
+            if (*endptr != '\0' || val <= 0 || val > 1024 * 1024) {
+                fprintf(stderr, "%s: invalid index interval: '%s'\n", PROGRAM_NAME, argv[i] + 17);
+                return -1;
+            }
+            params->index_interval = (unsigned long long)val * 1024 * 1024;
+        } else if (strncmp(argv[i], "--skip-bytes=", 13) == 0 || strncmp(argv[i], "--count-bytes=", 14) == 0) {
+            const char *value = strchr(argv[i], '=') + 1;
+            char *endptr;
+            unsigned long long val;
+            errno = 0;
+            val = strtoull(value, &endptr, 10);
+            if (*value < '0' || *value > '9' || *endptr != '\0' || errno == ERANGE) {
+                fprintf(stderr, "%s: invalid number of bytes: '%s'\n", PROGRAM_NAME, value);
+                return -1;
+            }
+            if (argv[i][2] == 's') {
+                params->skip_bytes = val;
+            } else {
+                params->count_bytes = val;
+            }
         } else if (strncmp(argv[i], "--wrap=", 7) == 0) {
             char *endptr;
             long val = strtol(argv[i] + 7, &endptr, 10);
@@ -966,6 +8390,45 @@ int parse_arguments(int argc, char **argv, params_t *params) {
                 return -1;
             }
             params->wrap_column = (int)val;
+        } else if (strncmp(argv[i], "--from=", 7) == 0 || strncmp(argv[i], "--to=", 5) == 0) {
+            const char *name = strchr(argv[i], '=') + 1;
+            encoding_type_t e = encoding_by_name(name);
+            if (e == ENC_NONE || !builtin_decoder_ops(e)) {
+                fprintf(stderr, "%s: invalid encoding for transcoding: '%s'\n", PROGRAM_NAME, name);
+                return -1;
+            }
+            if (argv[i][2] == 't') {
+                params->to_encoding = e;
+            } else {
+                if (encoding_set && params->encoding_type != e) {
+                    fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
+                    return -1;
+                }
+                params->encoding_type = e;
+                encoding_set = 1;
+                from_set = 1;
+            }
+        } else if (strncmp(argv[i], "--checksum=", 11) == 0) {
+            const char *name = argv[i] + 11;
+            const char *colon = strchr(name, ':');
+            size_t len = colon ? (size_t)(colon - name) : strlen(name);
+            if (len == 6 && strncmp(name, "crc32c", 6) == 0) {
+                params->checksum = CHECKSUM_CRC32C;
+            } else if (len == 5 && strncmp(name, "xxh64", 5) == 0) {
+                params->checksum = CHECKSUM_XXH64;
+            } else {
+                fprintf(stderr, "%s: invalid checksum: '%s'\n", PROGRAM_NAME, name);
+                return -1;
+            }
+            params->checksum_file = colon && colon[1] != '\0' ? colon + 1 : NULL;
+        } else if (strncmp(argv[i], "--verify=", 9) == 0) {
+            params->verify = argv[i] + 9;
+        } else if (strncmp(argv[i], "--expect=", 9) == 0) {
+            params->expect = argv[i] + 9;
+        } else if (strncmp(argv[i], "--emit=", 7) == 0) {
+            if (parse_emit(argv[i] + 7, params) != 0) {
+                return -1;
+            }
         } else if (strcmp(argv[i], "--base64") == 0) {
             if (encoding_set && params->encoding_type != ENC_BASE64) {
                 fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
@@ -1022,6 +8485,48 @@ int parse_arguments(int argc, char **argv, params_t *params) {
             }
             params->encoding_type = ENC_Z85;
             encoding_set = 1;
+        } else if (strcmp(argv[i], "--qp") == 0) {
+            if (encoding_set && params->encoding_type != ENC_QP) {
+                fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
+                return -1;
+            }
+            params->encoding_type = ENC_QP;
+            encoding_set = 1;
+        } else if (strcmp(argv[i], "--percent") == 0) {
+            if (encoding_set && params->encoding_type != ENC_PERCENT) {
+                fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
+                return -1;
+            }
+            params->encoding_type = ENC_PERCENT;
+            encoding_set = 1;
+        } else if (strcmp(argv[i], "--uuencode") == 0) {
+            if (encoding_set && params->encoding_type != ENC_UUENCODE) {
+                fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
+                return -1;
+            }
+            params->encoding_type = ENC_UUENCODE;
+            encoding_set = 1;
+        } else if (strcmp(argv[i], "--ascii85") == 0) {
+            if (encoding_set && params->encoding_type != ENC_ASCII85) {
+                fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
+                return -1;
+            }
+            params->encoding_type = ENC_ASCII85;
+            encoding_set = 1;
+        } else if (strcmp(argv[i], "--base58") == 0) {
+            if (encoding_set && params->encoding_type != ENC_BASE58) {
+                fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
+                return -1;
+            }
+            params->encoding_type = ENC_BASE58;
+            encoding_set = 1;
+        } else if (strcmp(argv[i], "--base45") == 0) {
+            if (encoding_set && params->encoding_type != ENC_BASE45) {
+                fprintf(stderr, "%s: multiple encoding types specified\n", PROGRAM_NAME);
+                return -1;
+            }
+            params->encoding_type = ENC_BASE45;
+            encoding_set = 1;
         } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
             if (argv[i][1] != '-') {
                 size_t j;
@@ -1042,7 +8547,7 @@ int parse_arguments(int argc, char **argv, params_t *params) {
                                     return -1;
                                 }
                                 params->wrap_column = (int)val;
-                                j = strlen(argv[i]); 
+                                j = strlen(argv[i]) - 1;
                             } else if (i + 1 < argc) {
                                 char *endptr;
                                 long val = strtol(argv[++i], &endptr, 10);
@@ -1051,12 +8556,23 @@ int parse_arguments(int argc, char **argv, params_t *params) {
                                     return -1;
                                 }
                                 params->wrap_column = (int)val;
-                                j = strlen(argv[i-1]);
+                                j = strlen(argv[i]) - 1;
                             } else {
                                 fprintf(stderr, "%s: option requires an argument -- 'w'\n", PROGRAM_NAME);
                                 return -1;
                             }
                             break;
+                        case 'o':
+                            if (argv[i][j+1] != '\0') {
+                                params->output_file = &argv[i][j+1];
+                            } else if (i + 1 < argc) {
+                                params->output_file = argv[++i];
+                            } else {
+                                fprintf(stderr, "%s: option requires an argument -- 'o'\n", PROGRAM_NAME);
+                                return -1;
+                            }
+                            j = strlen(argv[i]) - 1;
+                            break;
                         default:
                             fprintf(stderr, "%s: invalid option -- '%c'\n", PROGRAM_NAME, argv[i][j]);
                             return -1;
@@ -1078,7 +8594,195 @@ int parse_arguments(int argc, char **argv, params_t *params) {
         }
     }
 
-    if (params->encoding_type == ENC_NONE) {
+    if (params->output_file && (params->output_file[0] == '\0' || strcmp(params->output_file, "-") == 0)) {
+        params->output_file = NULL;
+    }
+
+    if ((params->skip_bytes != 0 || params->count_bytes != DEC_COUNT_ALL) && !params->decode) {
+        fprintf(stderr, "%s: --skip-bytes and --count-bytes only apply when decoding\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->write_index && (params->skip_bytes != 0 || params->count_bytes != DEC_COUNT_ALL)) {
+        fprintf(stderr, "%s: --write-index cannot be combined with --skip-bytes or --count-bytes\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->in_place && (strcmp(params->input_file, "-") == 0 || params->output_file || params->skip_bytes != 0 ||
+                             params->count_bytes != DEC_COUNT_ALL || params->write_index || params->index_file ||
+                             params->auto_detect)) {
+        fprintf(stderr, "%s: --in-place needs a FILE and no output, range, index or --auto options\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->lines && (params->encoding_type == ENC_UUENCODE || params->encoding_type == ENC_QP)) {
+        fprintf(stderr, "%s: --lines cannot be combined with --%s\n", PROGRAM_NAME, encoding_name(params->encoding_type));
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if ((params->lines || params->encoding_type == ENC_BASE58 || params->encoding_type == ENC_ASCII85 ||
+         params->encoding_type == ENC_UUENCODE || params->encoding_type == ENC_QP ||
+         params->encoding_type == ENC_PERCENT) &&
+        (params->in_place || params->skip_bytes != 0 || params->count_bytes != DEC_COUNT_ALL || params->write_index ||
+         params->index_file)) {
+        fprintf(stderr, "%s: --%s cannot be combined with --in-place, ranges or indexes\n", PROGRAM_NAME,
+                params->lines ? "lines" : encoding_name(params->encoding_type));
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->index_interval != 0 && !params->write_index) {
+        fprintf(stderr, "%s: --index-interval only applies with --write-index\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->index_file && !params->decode) {
+        fprintf(stderr, "%s: --index only applies when decoding\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if ((params->alphabet || params->padding) && (params->in_place || params->write_index || params->index_file)) {
+        fprintf(stderr, "%s: --alphabet and --padding cannot be combined with --in-place or indexes\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->emit_count > 0) {
+        int k;
+
+        if (params->decode || params->auto_detect || from_set || params->lines || params->in_place ||
+            params->write_index || params->alphabet || params->padding) {
+            fprintf(stderr, "%s: --emit cannot be combined with -d, --auto, --from, --lines, --in-place, "
+                    "indexes, --alphabet or --padding\n", PROGRAM_NAME);
+            fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+            return -1;
+        }
+        if (params->output_file && !encoding_set) {
+            fprintf(stderr, "%s: -o with --emit needs an encoding type for it\n", PROGRAM_NAME);
+            fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+            return -1;
+        }
+        if (encoding_set && !builtin_decoder_ops(params->encoding_type)) {
+            fprintf(stderr, "%s: --emit cannot be combined with --%s\n", PROGRAM_NAME,
+                    encoding_name(params->encoding_type));
+            fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+            return -1;
+        }
+
+        // The main encoding, if any, is one more output, to -o or standard output
+        if (encoding_set) {
+            memmove(&params->emit[1], &params->emit[0], (size_t)params->emit_count * sizeof(emit_t));
+            params->emit[0].encoding_type = params->encoding_type;
+            params->emit[0].wrap_column = (size_t)-1;
+            params->emit[0].path = params->output_file ? params->output_file : "-";
+            params->emit_count++;
+        } else {
+            params->encoding_type = params->emit[0].encoding_type;
+        }
+
+        for (k = 0; k < params->emit_count; k++) {
+            int j;
+
+            if (params->emit[k].wrap_column == (size_t)-1) {
+                params->emit[k].wrap_column = (size_t)params->wrap_column;
+            }
+            for (j = 0; j < k; j++) {
+                if (strcmp(params->emit[j].path, params->emit[k].path) == 0) {
+                    fprintf(stderr, "%s: output '%s' given twice\n", PROGRAM_NAME, params->emit[k].path);
+                    fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    if (from_set != (params->to_encoding != ENC_NONE)) {
+        fprintf(stderr, "%s: --from and --to must be given together\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (from_set && (params->decode || params->auto_detect || params->lines || params->in_place ||
+                     params->skip_bytes != 0 || params->count_bytes != DEC_COUNT_ALL || params->write_index ||
+                     params->index_file || params->alphabet || params->padding)) {
+        fprintf(stderr, "%s: --from and --to cannot be combined with -d, --auto, --lines, --in-place, ranges, "
+                "indexes, --alphabet or --padding\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->checksum != CHECKSUM_NONE &&
+        (params->lines || params->in_place || params->emit_count > 0 || from_set ||
+         (encoding_set && !builtin_decoder_ops(params->encoding_type)))) {
+        fprintf(stderr, "%s: --checksum only applies to the block encodings, without --lines, --in-place, "
+                "--emit or --from\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->check && !params->decode) {
+        fprintf(stderr, "%s: --check only applies when decoding\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if ((params->check || params->size) &&
+        (params->output_file || params->in_place || params->lines || params->emit_count > 0 || from_set ||
+         params->skip_bytes != 0 || params->count_bytes != DEC_COUNT_ALL || params->write_index ||
+         params->index_file || params->verify || params->checksum != CHECKSUM_NONE ||
+         (encoding_set && !builtin_decoder_ops(params->encoding_type)))) {
+        fprintf(stderr, "%s: --check and --size need a block encoding, and no output, range, index, "
+                "--lines, --emit, --from, --verify or --checksum options\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->verify && (!params->decode || params->output_file || params->in_place || params->lines ||
+                           params->skip_bytes != 0 || params->count_bytes != DEC_COUNT_ALL || params->write_index ||
+                           (encoding_set && !builtin_decoder_ops(params->encoding_type)))) {
+        fprintf(stderr, "%s: --verify needs -d with a block encoding, and no -o, --in-place, --lines, "
+                "ranges or --write-index\n", PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->expect) {
+        size_t len = strlen(params->expect);
+        size_t k = 0;
+        while (k < len && isxdigit((unsigned char)params->expect[k])) {
+            k++;
+        }
+        if (params->checksum == CHECKSUM_NONE || !params->decode) {
+            fprintf(stderr, "%s: --expect needs -d and --checksum\n", PROGRAM_NAME);
+            fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+            return -1;
+        }
+        if (k != len || len != (params->checksum == CHECKSUM_CRC32C ? 8u : 16u)) {
+            fprintf(stderr, "%s: invalid checksum value: '%s'\n", PROGRAM_NAME, params->expect);
+            return -1;
+        }
+    }
+
+    if (params->auto_detect && (!params->decode || encoding_set || params->lines || params->in_place ||
+                                params->alphabet || params->padding)) {
+        fprintf(stderr, "%s: --auto needs -d and no encoding type, --lines, --in-place, --alphabet or --padding\n",
+                PROGRAM_NAME);
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (setup_custom_alphabet(params) != 0) {
+        fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
+        return -1;
+    }
+
+    if (params->encoding_type == ENC_NONE && !params->auto_detect) {
         fprintf(stderr, "%s: missing encoding type\n", PROGRAM_NAME);
         fprintf(stderr, "Try '%s --help' for more information.\n", PROGRAM_NAME);
         return -1;
@@ -1087,6 +8791,7 @@ int parse_arguments(int argc, char **argv, params_t *params) {
     return 0;
 }
 
+#ifndef BASENC_NO_MAIN
 int main(int argc, char **argv) {
     params_t params;
     FILE *input_stream;
@@ -1095,6 +8800,15 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
+    if (params.stats) {
+        stats_enabled = 1;
+        stats.start_ns = monotonic_ns();
+    }
+
+    if (params.in_place) {
+        do_in_place(&params);
+    }
+
     if (strcmp(params.input_file, "-") == 0) {
         input_stream = stdin;
         SET_BINARY_MODE(stdin);
@@ -1107,10 +8821,47 @@ int main(int argc, char **argv) {
 
     SET_BINARY_MODE(stdout);
 
+    if (params.auto_detect) {
+        params.encoding_type = detect_encoding(input_stream, params.ignore_garbage);
+        if (params.verbose) {
+            fprintf(stderr, "%s: detected %s\n", PROGRAM_NAME, encoding_name(params.encoding_type));
+        }
+    }
+
+    if (params.check || params.size) {
+        do_check(input_stream, &params);
+    }
+
+    if (params.emit_count > 0) {
+        do_emit(input_stream, &params);
+    }
+
+    if (params.to_encoding != ENC_NONE) {
+        do_transcode(input_stream, &params);
+    }
+
+    if (params.lines) {
+        do_lines(input_stream, &params);
+    } else if (params.encoding_type == ENC_BASE58) {
+        do_base58(input_stream, &params);
+    } else if (params.encoding_type == ENC_ASCII85) {
+        do_ascii85(input_stream, &params);
+    } else if (params.encoding_type == ENC_QP) {
+        do_qp(input_stream, &params);
+    } else if (params.encoding_type == ENC_PERCENT) {
+        do_percent(input_stream, &params);
+    } else if (params.encoding_type == ENC_UUENCODE) {
+        if (params.decode) {
+            do_uudecode(input_stream, &params);
+        }
+        do_uuencode(input_stream, &params);
+    }
+
     if (params.decode) {
-        do_decode(input_stream, params.input_file, stdout, params.ignore_garbage, params.encoding_type);
+        do_decode(input_stream, &params);
     } else {
-        do_encode(input_stream, params.input_file, stdout, params.wrap_column, params.encoding_type);
+        do_encode(input_stream, &params);
     }
     return EXIT_SUCCESS;
 }
+#endif
@@ -0,0 +1,584 @@
+#!/usr/bin/env python3
+"""
+basenc_bench.py - end-to-end benchmark harness for basenc
+
+Runs a built basenc binary over generated corpora and measures the whole
+command line (argument parsing, stdio, the block loop and the stream
+emitter that wraps output lines), not just the encoding kernels.  Every case is also run through the system's
+GNU basenc (or base64 for the base64 cases) when one is installed, and the
+outputs are compared byte for byte so that a speedup can never hide a
+correctness regression.
+
+Cases covered for every selected encoding and corpus size:
+  - encode with wrap widths 0, 64 and 76 (-w)
+  - decode round trips (-d) of the wrapped output, with and without -i
+  - decode of a garbage-laden stream with -i
+  - input given as a FILE operand and through a pipe on standard input
+
+A short list of edge cases (irregular layouts and the like) is then run
+once each and checked against the expected output; they are not timed.
+
+Reported per case: wall time, CPU time (user+sys) and peak RSS of the
+child process.  CPU time and peak RSS come from wait4() and are only
+available on POSIX systems; on Windows only wall time is reported.
+
+Usage:
+  python3 basenc_bench.py [--basenc PATH] [--sizes 0,3,4k,1M,16M]
+                          [--encodings base64,base32,...] [--wraps 0,64,76]
+                          [--repeat N] [--no-reference] [--json FILE]
+
+Exit status is 1 if any output differs from the reference (or from the
+original data for decode round trips), 0 otherwise.
+"""
+
+import argparse
+import base64
+import binascii
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ENCODINGS = [
+    "base64", "base64url", "base32", "base32hex",
+    "base16", "base2msbf", "base2lsbf", "z85",
+]
+
+# Bytes that are outside every supported alphabet, used to build the
+# garbage-laden decode corpora for -i.
+GARBAGE = b' \t",;|~\\'
+
+
+def parse_size(text):
+    text = text.strip().lower()
+    mult = 1
+    if text.endswith("k"):
+        mult, text = 1024, text[:-1]
+    elif text.endswith("m"):
+        mult, text = 1024 * 1024, text[:-1]
+    elif text.endswith("g"):
+        mult, text = 1024 * 1024 * 1024, text[:-1]
+    return int(text) * mult
+
+
+def human_size(n):
+    for unit in ("", "K", "M", "G"):
+        if n < 1024 or unit == "G":
+            return "%d%s" % (n, unit)
+        n //= 1024
+    return str(n)
+
+
+def find_basenc():
+    here = os.path.dirname(os.path.abspath(__file__))
+    root = os.path.normpath(os.path.join(here, "..", "..", ".."))
+    candidates = [
+        os.path.join(root, "tools_exe", "basenc.exe"),
+        os.path.join(root, "tools_exe", "basenc"),
+        os.path.join(here, "..", "basenc.exe"),
+        os.path.join(here, "..", "basenc"),
+        os.path.join(os.getcwd(), "basenc.exe"),
+        os.path.join(os.getcwd(), "basenc"),
+    ]
+    for path in candidates:
+        if os.path.isfile(path) and os.access(path, os.X_OK):
+            return os.path.abspath(path)
+    return None
+
+
+def find_reference(encoding):
+    """Return the reference command prefix for ENCODING, or None."""
+    gnu_basenc = shutil.which("basenc")
+    if gnu_basenc and is_gnu(gnu_basenc):
+        return [gnu_basenc, "--" + encoding]
+    if encoding == "base64":
+        gnu_base64 = shutil.which("base64")
+        if gnu_base64 and is_gnu(gnu_base64):
+            return [gnu_base64]
+    if encoding == "base32":
+        gnu_base32 = shutil.which("base32")
+        if gnu_base32 and is_gnu(gnu_base32):
+            return [gnu_base32]
+    return None
+
+
+_gnu_cache = {}
+
+
+def is_gnu(path):
+    if path not in _gnu_cache:
+        try:
+            out = subprocess.run([path, "--version"], stdout=subprocess.PIPE,
+                                 stderr=subprocess.DEVNULL, timeout=10).stdout
+            _gnu_cache[path] = b"GNU coreutils" in out
+        except (OSError, subprocess.SubprocessError):
+            _gnu_cache[path] = False
+    return _gnu_cache[path]
+
+
+def write_corpus(path, size, seed):
+    """Mostly random data with some zero runs, written in chunks so the
+    harness itself stays small (children inherit its RSS at fork time)."""
+    rng = random.Random(seed)
+    chunk = bytearray(rng.getrandbits(8) for _ in range(min(size, 1 << 16)))
+    with open(path, "wb") as f:
+        left = size
+        while left > 0:
+            piece = bytearray(chunk[:min(left, len(chunk))])
+            if len(piece) > 4096 and rng.randrange(4) == 0:
+                start = rng.randrange(0, len(piece) - 1024)
+                piece[start:start + 1024] = bytes(1024)
+            f.write(piece)
+            left -= len(piece)
+
+
+def write_noisy(src, dst, seed):
+    """Copy the encoded stream SRC to DST with a garbage byte after every
+    third 16-byte group."""
+    rng = random.Random(seed)
+    step = 0
+    with open(src, "rb") as fin, open(dst, "wb") as fout:
+        while True:
+            block = fin.read(1 << 16)
+            if not block:
+                break
+            out = bytearray()
+            for i in range(0, len(block), 16):
+                out += block[i:i + 16]
+                step += 1
+                if step % 3 == 0:
+                    out.append(GARBAGE[rng.randrange(len(GARBAGE))])
+            fout.write(out)
+
+
+def run_plain(argv, stdin=None):
+    proc = subprocess.run(argv, input=stdin, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    return proc.returncode, proc.stdout, proc.stderr.decode("utf-8", "replace").strip()
+
+
+def wrap_irregular(text, widths):
+    """Split TEXT into lines, taking line widths from WIDTHS in turn (the
+    last one repeats)."""
+    lines = []
+    i = k = 0
+    while i < len(text):
+        w = widths[min(k, len(widths) - 1)]
+        lines.append(text[i:i + w])
+        i += w
+        k += 1
+    return b"\n".join(lines) + b"\n"
+
+
+def edge_skip_irregular(basenc, workdir):
+    """--skip-bytes into a file whose line width changes after the first
+    line must not seek by the first line's width."""
+    rng = random.Random(33)
+    raw = bytes(rng.getrandbits(8) for _ in range(300000))
+    problems = []
+    for widths in ([76, 64], [76, 72], [76] * 10 + [64] * 2000 + [76]):
+        path = os.path.join(workdir, "irregular.b64")
+        with open(path, "wb") as f:
+            f.write(wrap_irregular(base64.b64encode(raw), widths))
+        for skip in (100000, 118652, 144574, 170496, 299990):
+            status, out, err = run_plain([basenc, "--base64", "-d", "--skip-bytes=%d" % skip,
+                                          "--count-bytes=64", path])
+            if status != 0 or out != raw[skip:skip + 64]:
+                problems.append("widths %s skip %d: wrong output (exit %d%s)" % (
+                    widths[:2], skip, status, (": " + err) if err else ""))
+    return problems
+
+
+def edge_emit_failure(basenc, workdir):
+    """A failing --emit output must not leave its siblings preallocated
+    and full of NUL bytes."""
+    src = os.path.join(workdir, "five.bin")
+    with open(src, "wb") as f:
+        f.write(b"hello")
+    z_out = os.path.join(workdir, "z.out")
+    b_out = os.path.join(workdir, "b.out")
+    problems = []
+    for emits in ((("z85", z_out), ("base64", b_out)),
+                  (("base64", b_out), ("base32", os.path.join(workdir, "missing", "x")))):
+        case = " ".join(enc for enc, _ in emits)
+        for path in (z_out, b_out):
+            if os.path.exists(path):
+                os.remove(path)
+        status, _, _ = run_plain([basenc] + ["--emit=%s:%s" % e for e in emits] + [src])
+        if status == 0:
+            problems.append("%s: exit 0" % case)
+        for path in (z_out, b_out):
+            if os.path.exists(path):
+                with open(path, "rb") as f:
+                    if b"\0" in f.read():
+                        problems.append("%s: %s left with NUL bytes" % (case, os.path.basename(path)))
+    return problems
+
+
+def edge_auto_zero_prefix(basenc, workdir):
+    """--auto on data that starts with a zero run, which encodes to one
+    repeated character that several alphabets accept."""
+    rng = random.Random(44)
+    problems = []
+    for zeros in (3000, 100000):
+        raw = bytes(zeros) + bytes(rng.getrandbits(8) for _ in range(5000))
+        for encoding in ("base64", "base32", "base16", "base32hex"):
+            src = os.path.join(workdir, "zero_prefix.bin")
+            enc = os.path.join(workdir, "zero_prefix.txt")
+            with open(src, "wb") as f:
+                f.write(raw)
+            with open(enc, "wb") as f:
+                f.write(run_plain([basenc, "--" + encoding, src])[1])
+            with open(enc, "rb") as f:
+                text = f.read()
+            for piped in (False, True):
+                argv = [basenc, "-d", "--auto"] + ([] if piped else [enc])
+                status, out, err = run_plain(argv, text if piped else None)
+                if status != 0 or out != raw:
+                    problems.append("%s %d zeros %s: wrong output (exit %d%s)" % (
+                        encoding, zeros, "pipe" if piped else "file", status, (": " + err) if err else ""))
+    return problems
+
+
+def edge_index_mismatch(basenc, workdir):
+    """--index must refuse an index built from another file of the same
+    size, and --index-interval needs --write-index."""
+    rng = random.Random(34)
+    paths = {}
+    for name in ("a", "b"):
+        raw = os.path.join(workdir, "index_%s.bin" % name)
+        with open(raw, "wb") as f:
+            f.write(bytes(rng.getrandbits(8) for _ in range(3 << 20)))
+        paths[name] = (raw, raw + ".b64", raw + ".idx")
+        run_plain([basenc, "--base64", "-o", raw + ".b64", "--write-index=" + raw + ".idx", raw])
+    problems = []
+    a_raw, a_enc, a_idx = paths["a"]
+    status, out, err = run_plain([basenc, "--base64", "-d", "--index=" + a_idx, "--skip-bytes=2000000",
+                                  "--count-bytes=64", a_enc])
+    with open(a_raw, "rb") as f:
+        f.seek(2000000)
+        if status != 0 or out != f.read(64):
+            problems.append("matching index: wrong output (exit %d%s)" % (status, (": " + err) if err else ""))
+    status, _, _ = run_plain([basenc, "--base64", "-d", "--index=" + a_idx, "--skip-bytes=2000000",
+                              "--count-bytes=64", paths["b"][1]])
+    if status == 0:
+        problems.append("index of another file accepted")
+    status, _, _ = run_plain([basenc, "--base64", "--index-interval=2", a_raw])
+    if status == 0:
+        problems.append("--index-interval without --write-index accepted")
+    return problems
+
+
+def edge_verify_fifo(basenc, workdir):
+    """--verify reads an original that is a named pipe instead of
+    refusing it (POSIX only)."""
+    if not hasattr(os, "mkfifo"):
+        return []
+    rng = random.Random(48)
+    raw = bytes(rng.getrandbits(8) for _ in range(200000))
+    enc = os.path.join(workdir, "verify.b64")
+    with open(enc, "wb") as f:
+        f.write(base64.encodebytes(raw))
+    problems = []
+    for original, expect in ((raw, 0), (raw[:-1], 1), (raw + b"x", 1)):
+        fifo = os.path.join(workdir, "verify.fifo")
+        if os.path.exists(fifo):
+            os.remove(fifo)
+        os.mkfifo(fifo)
+
+        def feed(data=original):
+            try:
+                with open(fifo, "wb") as f:
+                    f.write(data)
+            except (BrokenPipeError, OSError):
+                pass
+        feeder = threading.Thread(target=feed)
+        feeder.start()
+        status, _, err = run_plain([basenc, "--base64", "-d", "--verify=" + fifo, enc])
+        feeder.join()
+        if (status != 0) != bool(expect):
+            problems.append("original of %d bytes: exit %d%s" % (len(original), status, (": " + err) if err else ""))
+    return problems
+
+
+def edge_uuencode_short(basenc, workdir):
+    """--uuencode round trips of 1..90 bytes through pipes, where the
+    begin line and the first data line are both short, and a body from
+    Python's b2a_uu that goes straight from its last line to "end"."""
+    rng = random.Random(40)
+    problems = []
+    for size in range(1, 91):
+        raw = bytes(rng.getrandbits(8) for _ in range(size))
+        status, enc, err = run_plain([basenc, "--uuencode"], raw)
+        if status == 0:
+            status, out, err = run_plain([basenc, "--uuencode", "-d"], enc)
+        if status != 0 or out != raw:
+            problems.append("%d bytes: wrong output (exit %d%s)" % (size, status, (": " + err) if err else ""))
+    for size in (40, 41, 42):
+        raw = bytes(rng.getrandbits(8) for _ in range(size))
+        status, out, err = run_plain([basenc, "--uuencode", "-d"],
+                                     b"begin 644 x\n" + binascii.b2a_uu(raw) + b"end\n")
+        if status != 0 or out != raw:
+            problems.append("b2a_uu %d bytes: wrong output (exit %d%s)" % (size, status, (": " + err) if err else ""))
+    return problems
+
+
+def edge_index_irregular(basenc, workdir):
+    """An index built by decoding a file with random line lengths must
+    take --skip-bytes to the right place.  The first line is one
+    character, so entries hold columns past the first line's width."""
+    rng = random.Random(341)
+    raw = bytes(rng.getrandbits(8) for _ in range(3 << 20))
+    text = base64.b64encode(raw)
+    lines = [text[:1]]
+    i = 1
+    while i < len(text):
+        w = rng.randrange(1, 121)
+        lines.append(text[i:i + w])
+        i += w
+    enc = os.path.join(workdir, "index_irregular.b64")
+    idx = enc + ".idx"
+    with open(enc, "wb") as f:
+        f.write(b"\n".join(lines) + b"\n")
+    problems = []
+    status, _, err = run_plain([basenc, "--base64", "-d", "--write-index=" + idx, "-o", os.devnull, enc])
+    if status != 0:
+        return ["--write-index: exit %d%s" % (status, (": " + err) if err else "")]
+    for skip in (1, 1048577, 2000003, (3 << 20) - 20):
+        status, out, err = run_plain([basenc, "--base64", "-d", "--index=" + idx, "--skip-bytes=%d" % skip,
+                                      "--count-bytes=20", enc])
+        if status != 0 or out != raw[skip:skip + 20]:
+            problems.append("skip %d: wrong output (exit %d%s)" % (skip, status, (": " + err) if err else ""))
+    return problems
+
+
+EDGE_CASES = [
+    ("skip-bytes irregular lines", edge_skip_irregular),
+    ("emit failure cleanup", edge_emit_failure),
+    ("auto zero-prefixed input", edge_auto_zero_prefix),
+    ("index of another file", edge_index_mismatch),
+    ("index of irregular lines", edge_index_irregular),
+    ("verify against a fifo", edge_verify_fifo),
+    ("uuencode short inputs", edge_uuencode_short),
+]
+
+
+class Result(object):
+    def __init__(self, status, wall, cpu, rss, stderr):
+        self.status = status
+        self.wall = wall
+        self.cpu = cpu
+        self.rss = rss
+        self.stderr = stderr
+
+
+def run_once(cmd, infile, use_pipe, outfile):
+    """Run CMD once, reading INFILE as an operand or through a pipe."""
+    argv = list(cmd) if use_pipe else list(cmd) + [infile]
+    with open(outfile, "wb") as out, tempfile.TemporaryFile() as err:
+        start = time.perf_counter()
+        proc = subprocess.Popen(argv, stdin=subprocess.PIPE if use_pipe else subprocess.DEVNULL,
+                                stdout=out, stderr=err)
+        feeder = None
+        if use_pipe:
+            def feed():
+                try:
+                    with open(infile, "rb") as src:
+                        shutil.copyfileobj(src, proc.stdin, 1 << 16)
+                except (BrokenPipeError, OSError):
+                    pass
+                finally:
+                    try:
+                        proc.stdin.close()
+                    except OSError:
+                        pass
+            feeder = threading.Thread(target=feed)
+            feeder.start()
+        cpu = rss = None
+        if hasattr(os, "wait4"):
+            _, status, usage = os.wait4(proc.pid, 0)
+            proc.returncode = os.waitstatus_to_exitcode(status)
+            cpu = usage.ru_utime + usage.ru_stime
+            rss = usage.ru_maxrss * (1 if sys.platform == "darwin" else 1024)
+        else:
+            proc.wait()
+        wall = time.perf_counter() - start
+        if feeder:
+            feeder.join()
+        err.seek(0)
+        return Result(proc.returncode, wall, cpu, rss, err.read().decode("utf-8", "replace").strip())
+
+
+def run_best(cmd, infile, use_pipe, outfile, repeat):
+    best = None
+    for _ in range(repeat):
+        res = run_once(cmd, infile, use_pipe, outfile)
+        if best is None or res.wall < best.wall:
+            best = res
+    return best
+
+
+def same_file(a, b):
+    if os.path.getsize(a) != os.path.getsize(b):
+        return False
+    with open(a, "rb") as fa, open(b, "rb") as fb:
+        while True:
+            x = fa.read(1 << 20)
+            y = fb.read(1 << 20)
+            if x != y:
+                return False
+            if not x:
+                return True
+
+
+def fmt_time(t):
+    return "-" if t is None else "%.4f" % t
+
+
+def fmt_rss(r):
+    return "-" if r is None else "%.1fM" % (r / (1024.0 * 1024.0))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="End-to-end basenc benchmark and output comparison.")
+    ap.add_argument("--basenc", help="basenc binary under test (default: search tools_exe/ and CWD)")
+    ap.add_argument("--sizes", default="0,3,4k,1M,16M", help="comma separated corpus sizes")
+    ap.add_argument("--encodings", default=",".join(ENCODINGS), help="comma separated encodings")
+    ap.add_argument("--wraps", default="0,64,76", help="comma separated wrap widths")
+    ap.add_argument("--repeat", type=int, default=3, help="runs per case, the fastest is kept")
+    ap.add_argument("--no-reference", action="store_true", help="do not run GNU basenc/base64")
+    ap.add_argument("--json", help="also write per-case results as JSON lines to FILE")
+    args = ap.parse_args()
+
+    basenc = args.basenc or find_basenc()
+    if not basenc:
+        sys.stderr.write("basenc_bench: basenc binary not found, use --basenc PATH\n")
+        return 2
+    basenc = os.path.abspath(basenc)
+
+    sizes = [parse_size(s) for s in args.sizes.split(",") if s]
+    encodings = [e for e in args.encodings.split(",") if e]
+    wraps = [int(w) for w in args.wraps.split(",") if w]
+    for e in encodings:
+        if e not in ENCODINGS:
+            sys.stderr.write("basenc_bench: unknown encoding '%s'\n" % e)
+            return 2
+
+    json_out = open(args.json, "w") if args.json else None
+    failures = 0
+    cases = 0
+
+    # Peak RSS from wait4() includes whatever the child inherited from this
+    # process at fork time; show that floor so small numbers read correctly.
+    floor = run_once([basenc, "--version"], os.devnull, False, os.devnull)
+    if floor.rss is not None:
+        print("peak RSS floor (basenc --version): %s" % fmt_rss(floor.rss))
+
+    header = "%-34s %10s %10s %8s | %10s %10s %8s | %7s %s" % (
+        "case", "wall", "cpu", "rss", "ref wall", "ref cpu", "ref rss", "speedup", "check")
+    print(header)
+    print("-" * len(header))
+
+    workdir = tempfile.mkdtemp(prefix="basenc_bench_")
+    try:
+        for size in sizes:
+            for encoding in encodings:
+                n = size - size % 4 if encoding == "z85" else size
+                raw = os.path.join(workdir, "raw_%s_%d.bin" % (encoding, n))
+                write_corpus(raw, n, n)
+                ref = None if args.no_reference else find_reference(encoding)
+
+                for wrap in wraps:
+                    enc_file = os.path.join(workdir, "enc_%s_%d_w%d.txt" % (encoding, n, wrap))
+                    ours_out = os.path.join(workdir, "ours.out")
+                    ref_out = os.path.join(workdir, "ref.out")
+
+                    jobs = []
+                    for use_pipe in (False, True):
+                        jobs.append(("enc", wrap, use_pipe, False, raw,
+                                     ["-w", str(wrap)], enc_file))
+                    for use_pipe in (False, True):
+                        for ignore in (False, True):
+                            jobs.append(("dec", wrap, use_pipe, ignore, enc_file, ["-d"] + (["-i"] if ignore else []), raw))
+                    jobs.append(("dec-noisy", wrap, False, True, enc_file + ".noisy", ["-d", "-i"], raw))
+
+                    for kind, w, use_pipe, ignore, infile, extra, expected in jobs:
+                        if kind == "dec-noisy":
+                            write_noisy(enc_file, infile, n)
+
+                        name = "%s %s %s w%d %s%s" % (
+                            kind, encoding, human_size(n), w,
+                            "pipe" if use_pipe else "file", " -i" if ignore else "")
+                        ours = run_best([basenc, "--" + encoding] + extra, infile, use_pipe, ours_out, args.repeat)
+                        theirs = None
+                        if ref:
+                            theirs = run_best(ref + extra, infile, use_pipe, ref_out, args.repeat)
+
+                        problems = []
+                        if ours.status != 0:
+                            problems.append("exit %d%s" % (ours.status, (": " + ours.stderr) if ours.stderr else ""))
+                        if theirs is not None:
+                            if theirs.status != ours.status:
+                                problems.append("exit status differs from reference (%d)" % theirs.status)
+                            if not same_file(ours_out, ref_out):
+                                problems.append("output differs from reference")
+                        if kind == "enc" and not use_pipe:
+                            # Keep the encoded stream for the decode jobs;
+                            # prefer the reference output when there is one.
+                            shutil.copyfile(ref_out if theirs is not None and theirs.status == 0 else ours_out,
+                                            enc_file)
+                        if kind != "enc" and not same_file(ours_out, expected):
+                            problems.append("round trip differs from original")
+
+                        cases += 1
+                        if problems:
+                            failures += 1
+                        speedup = "-"
+                        if theirs is not None and ours.wall > 0:
+                            speedup = "%.2fx" % (theirs.wall / ours.wall)
+                        print("%-34s %10s %10s %8s | %10s %10s %8s | %7s %s" % (
+                            name, fmt_time(ours.wall), fmt_time(ours.cpu), fmt_rss(ours.rss),
+                            fmt_time(theirs.wall if theirs else None),
+                            fmt_time(theirs.cpu if theirs else None),
+                            fmt_rss(theirs.rss if theirs else None),
+                            speedup, "ok" if not problems else "FAIL: " + "; ".join(problems)))
+                        sys.stdout.flush()
+
+                        if json_out:
+                            json_out.write(json.dumps({
+                                "case": name, "kind": kind, "encoding": encoding, "size": n,
+                                "wrap": w, "input": "pipe" if use_pipe else "file",
+                                "ignore_garbage": ignore,
+                                "wall": ours.wall, "cpu": ours.cpu, "rss": ours.rss,
+                                "ref_wall": theirs.wall if theirs else None,
+                                "ref_cpu": theirs.cpu if theirs else None,
+                                "ref_rss": theirs.rss if theirs else None,
+                                "ok": not problems, "problems": problems,
+                            }) + "\n")
+
+        for name, check in EDGE_CASES:
+            problems = check(basenc, workdir)
+            cases += 1
+            if problems:
+                failures += 1
+            print("%-34s %s" % (name, "ok" if not problems else "FAIL: " + "; ".join(problems)))
+            sys.stdout.flush()
+            if json_out:
+                json_out.write(json.dumps({"case": name, "kind": "edge", "ok": not problems,
+                                           "problems": problems}) + "\n")
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+        if json_out:
+            json_out.close()
+
+    print("-" * len(header))
+    print("%d cases, %d failed" % (cases, failures))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())